@@ -0,0 +1,291 @@
+#include "checkpoint.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "base/cxx.h"
+
+namespace psyence {
+namespace base {
+namespace checkpoint {
+
+namespace {
+
+// Alignment of the table and of each section.
+const size_t ALIGN = 64;
+
+const char MAGIC[8] = {'P', 'S', 'Y', 'C', 'K', 'P', 'T', '\0'};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_sections;
+    uint64_t table_checksum;
+    uint64_t file_size;
+    uint8_t reserved[32];
+};
+
+struct TableEntry {
+    char name[MAX_SECTION_NAME_LEN + 1];
+    uint64_t offset;
+    uint64_t size;
+    uint64_t checksum;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(Header) == ALIGN, "Header must fill one alignment unit");
+static_assert(sizeof(TableEntry) == ALIGN,
+              "TableEntry must fill one alignment unit");
+
+size_t AlignUp(size_t x) {
+    return (x + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+// Write all of "data", retrying short writes and interrupts (only
+// async-signal-safe calls).
+bool WriteAll(int fd, const void* data, size_t size) {
+    auto p = static_cast<const uint8_t*>(data);
+    while (size) {
+        auto n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+const uint64_t PRIME_1 = 0x9E3779B185EBCA87ull;
+const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t PRIME_3 = 0x165667B19E3779F9ull;
+
+uint64_t RotateLeft(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+uint64_t Round(uint64_t acc, uint64_t lane) {
+    return RotateLeft(acc + lane * PRIME_2, 31) * PRIME_1;
+}
+
+uint64_t LoadWord(const uint8_t* p) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+}  // namespace
+
+uint64_t Checksum(const void* data, size_t size) {
+    // Four independent lanes over 32-byte blocks keep several multiplies in
+    // flight, then the rest goes a word and a byte at a time.
+    auto p = static_cast<const uint8_t*>(data);
+    uint64_t lanes[4] = {PRIME_1 + PRIME_2, PRIME_2, 0, 0 - PRIME_1};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (size_t k = 0; k < 4; ++k) {
+            lanes[k] = Round(lanes[k], LoadWord(&p[i + k * 8]));
+        }
+    }
+    uint64_t x = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) +
+                 RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+    x += size;
+    for (; i + 8 <= size; i += 8) {
+        x = RotateLeft(x ^ Round(0, LoadWord(&p[i])), 27) * PRIME_1 + PRIME_3;
+    }
+    for (; i < size; ++i) {
+        auto byte = static_cast<uint64_t>(p[i]);
+        x = RotateLeft(x ^ (byte * PRIME_3), 11) * PRIME_1;
+    }
+    x ^= x >> 33;
+    x *= PRIME_2;
+    x ^= x >> 29;
+    x *= PRIME_3;
+    return x ^ (x >> 32);
+}
+
+void CheckpointWriter::Add(const char* name, const void* data, size_t size) {
+    assert(strlen(name) <= MAX_SECTION_NAME_LEN);
+    for (auto& it : sections_) {
+        assert(it.name != name);
+        UNUSED(it);
+    }
+    sections_.push_back({name, data, size, ""});
+}
+
+void CheckpointWriter::AddCopy(const char* name, const void* data,
+                               size_t size) {
+    Add(name, nullptr, size);
+    sections_.back().copy.assign(static_cast<const char*>(data), size);
+}
+
+const void* CheckpointWriter::SectionData(const Section& section) const {
+    return section.data ? section.data : section.copy.data();
+}
+
+void CheckpointWriter::Prepare(const char* filename) {
+    // Lay out the table and sections (checksums are left to SavePrepared()).
+    auto table_size = sections_.size() * sizeof(TableEntry);
+    head_.assign(sizeof(Header) + table_size, 0);
+    size_t offset = head_.size();
+    for (size_t i = 0; i < sections_.size(); ++i) {
+        auto& section = sections_[i];
+        TableEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        strcpy(entry.name, section.name.c_str());
+        entry.offset = offset;
+        entry.size = section.size;
+        memcpy(&head_[sizeof(Header) + i * sizeof(TableEntry)], &entry,
+               sizeof(entry));
+        offset = AlignUp(offset + section.size);
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = CHECKPOINT_VERSION;
+    header.num_sections = static_cast<uint32_t>(sections_.size());
+    header.file_size = offset;
+    memcpy(head_.data(), &header, sizeof(header));
+
+    filename_ = filename;
+    tmp_filename_ = filename_ + ".tmp";
+}
+
+bool CheckpointWriter::SavePrepared() {
+    // Checksum the sections into the table, and the table into the header, in
+    // place.
+    auto table = &head_[sizeof(Header)];
+    for (size_t i = 0; i < sections_.size(); ++i) {
+        auto& section = sections_[i];
+        auto checksum = Checksum(SectionData(section), section.size);
+        memcpy(&table[i * sizeof(TableEntry) + offsetof(TableEntry, checksum)],
+               &checksum, sizeof(checksum));
+    }
+    auto table_checksum = Checksum(table, head_.size() - sizeof(Header));
+    memcpy(&head_[offsetof(Header, table_checksum)], &table_checksum,
+           sizeof(table_checksum));
+
+    // Write it all to a temporary file, then swap that in.
+    auto fd = open(tmp_filename_.c_str(), O_WRONLY | O_CREAT | O_TRUNC |
+                   O_CLOEXEC, 0666);
+    if (fd < 0) {
+        return false;
+    }
+    auto ok = WriteAll(fd, head_.data(), head_.size());
+    static const uint8_t padding[ALIGN] = {};
+    for (size_t i = 0; ok && i < sections_.size(); ++i) {
+        auto& section = sections_[i];
+        ok = WriteAll(fd, SectionData(section), section.size) &&
+             WriteAll(fd, padding, AlignUp(section.size) - section.size);
+    }
+    ok = !fsync(fd) && ok;
+    ok = !close(fd) && ok;
+    ok = ok && !rename(tmp_filename_.c_str(), filename_.c_str());
+    if (!ok) {
+        unlink(tmp_filename_.c_str());
+    }
+    return ok;
+}
+
+bool CheckpointWriter::Save(const char* filename) {
+    Prepare(filename);
+    return SavePrepared();
+}
+
+CheckpointReader::~CheckpointReader() {
+    Close();
+}
+
+bool CheckpointReader::Open(const char* filename) {
+    Close();
+
+    // Read front to back once to verify, so have it all read ahead.
+    if (!file_.Open(filename, AccessPattern::SEQUENTIAL, true) ||
+            file_.size() < sizeof(Header)) {
+        Close();
+        return false;
+    }
+    auto map = file_.data();
+    auto map_size = file_.size();
+
+    Header header;
+    memcpy(&header, map, sizeof(header));
+    auto table_size = static_cast<size_t>(header.num_sections) *
+                      sizeof(TableEntry);
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) ||
+            header.version != CHECKPOINT_VERSION ||
+            header.file_size != map_size ||
+            map_size - sizeof(Header) < table_size ||
+            Checksum(&map[sizeof(Header)], table_size) !=
+                header.table_checksum) {
+        Close();
+        return false;
+    }
+
+    for (size_t i = 0; i < header.num_sections; ++i) {
+        TableEntry entry;
+        memcpy(&entry, &map[sizeof(Header) + i * sizeof(TableEntry)],
+               sizeof(entry));
+        entry.name[MAX_SECTION_NAME_LEN] = '\0';
+        if (entry.offset % ALIGN || map_size < entry.offset ||
+                map_size - entry.offset < entry.size ||
+                Checksum(&map[entry.offset], entry.size) != entry.checksum) {
+            Close();
+            return false;
+        }
+        sections_.push_back({entry.name, &map[entry.offset], entry.size});
+    }
+    return true;
+}
+
+void CheckpointReader::Close() {
+    file_.Close();
+    sections_.clear();
+}
+
+bool CheckpointReader::Get(const char* name, const void** data,
+                           size_t* size) const {
+    for (auto& it : sections_) {
+        if (it.name == name) {
+            *data = it.data;
+            *size = it.size;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CheckpointReader::GetOffset(const char* name, size_t* offset,
+                                 size_t* size) const {
+    const void* data;
+    if (!Get(name, &data, size)) {
+        return false;
+    }
+    *offset = static_cast<size_t>(static_cast<const uint8_t*>(data) -
+                                  file_.data());
+    return true;
+}
+
+bool CheckpointReader::CopyTo(const char* name, size_t size,
+                              void* out) const {
+    const void* data;
+    size_t got_size;
+    if (!Get(name, &data, &got_size) || got_size != size) {
+        return false;
+    }
+    memcpy(out, data, size);
+    return true;
+}
+
+}  // namespace checkpoint
+}  // namespace base
+}  // namespace psyence
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "base/file.h"
+
+using psyence::base::file::AccessPattern;
+using psyence::base::file::MappedFile;
+using std::string;
+using std::vector;
+
+namespace psyence {
+namespace base {
+namespace checkpoint {
+
+// Checkpoint files: named binary sections, checksummed and 64-byte aligned.
+//
+// Layout:
+// * Header (64 bytes): magic, format version, number of sections, checksum of
+//   the section table, and total file size.
+// * Section table (64 bytes per section): name, offset, size and checksum of
+//   each section's data.
+// * Each section's data, starting at a multiple of 64 bytes (zero padded).
+//
+// Everything is in the writer's byte order.  The reader maps the file and
+// verifies every checksum up front, so sections can be copied straight out of
+// the page cache into place.
+
+// Version of the format, bumped on any incompatible change.
+const uint32_t CHECKPOINT_VERSION = 1;
+
+// Maximum length of a section name.
+const size_t MAX_SECTION_NAME_LEN = 31;
+
+// 64-bit checksum of "size" bytes (four xxHash64-style lanes).
+uint64_t Checksum(const void* data, size_t size);
+
+// Collects sections and writes them out as one checkpoint file.
+class CheckpointWriter {
+  public:
+    // Add a section.
+    //
+    // Only the pointer is kept, so "data" must stay valid and unchanged until
+    // Save().  Names must be unique.
+    void Add(const char* name, const void* data, size_t size);
+
+    // Add a section holding a copy of "data" (for small things like headers
+    // that would not outlive the call).
+    void AddCopy(const char* name, const void* data, size_t size);
+
+    // Write the sections to the file.
+    //
+    // Writes to "<filename>.tmp" then renames it over the file, so a crash
+    // never leaves a half-written checkpoint behind.  Returns false on any I/O
+    // error.
+    bool Save(const char* filename);
+
+    // Save() in two steps, for writing from the child of a fork() in a
+    // multithreaded process, where only async-signal-safe calls are allowed.
+    //
+    // Prepare() lays out the file and allocates everything that writing it
+    // takes, before the fork.  SavePrepared() checksums and writes it with
+    // just open(), write(), fsync(), close(), rename() and unlink(), allocating
+    // nothing.  Sections must not be added in between.
+    void Prepare(const char* filename);
+    bool SavePrepared();
+
+  private:
+    struct Section {
+        string name;
+        const void* data;
+        size_t size;
+        string copy;
+    };
+
+    // Where a section's bytes are (its own copy if it has one).
+    const void* SectionData(const Section& section) const;
+
+    vector<Section> sections_;
+
+    // Laid out by Prepare(): the header and table (to be checksummed), and the
+    // file names.
+    vector<uint8_t> head_;
+    string filename_;
+    string tmp_filename_;
+};
+
+// Maps a checkpoint file and hands out its sections.
+class CheckpointReader {
+  public:
+    // Unmap the file.
+    ~CheckpointReader();
+
+    // Map the file and verify it.
+    //
+    // Returns false if the file is missing, of another format version, or fails
+    // any size or checksum check.
+    bool Open(const char* filename);
+
+    // Unmap the file (done by Open() and the destructor too).
+    void Close();
+
+    // Get a section's data and size.
+    //
+    // The data is valid until Close().  Returns false if there is no such
+    // section.
+    bool Get(const char* name, const void** data, size_t* size) const;
+
+    // Get where a section's data starts in the file, and its size (to map it
+    // again on its own, eg to outlive the reader).
+    //
+    // Returns false if there is no such section.
+    bool GetOffset(const char* name, size_t* offset, size_t* size) const;
+
+    // Copy a section of exactly "size" bytes to "out".
+    //
+    // Sections are only 64-byte aligned in the file, so they are copied out of
+    // the mapping rather than mapped into place (which takes page alignment).
+    //
+    // Returns false if there is no such section or it is of another size.
+    bool CopyTo(const char* name, size_t size, void* out) const;
+
+  private:
+    struct Section {
+        string name;
+        const uint8_t* data;
+        size_t size;
+    };
+
+    // The mapping.
+    MappedFile file_;
+
+    // Verified sections, pointing into the mapping.
+    vector<Section> sections_;
+};
+
+}  // namespace checkpoint
+}  // namespace base
+}  // namespace psyence
@@ -0,0 +1,117 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+
+#include "base/checkpoint.h"
+#include "base/cxx.h"
+#include "base/file.h"
+
+using psyence::base::checkpoint::CheckpointReader;
+using psyence::base::checkpoint::CheckpointWriter;
+using psyence::base::checkpoint::Checksum;
+using psyence::base::file::FileSize;
+using psyence::base::file::FileToString;
+using std::vector;
+
+int main() {
+    auto filename = "checkpoint_test.bin";
+
+    // Sections of odd sizes, to exercise the padding.
+    vector<float> floats(1000);
+    for (size_t i = 0; i < floats.size(); ++i) {
+        floats[i] = static_cast<float>(i) / 7;
+    }
+    uint8_t bytes[3] = {1, 2, 3};
+    uint64_t count = 42;
+    {
+        CheckpointWriter writer;
+        writer.Add("floats", floats.data(), floats.size() * sizeof(float));
+        writer.Add("bytes", bytes, sizeof(bytes));
+        writer.AddCopy("count", &count, sizeof(count));
+        count = 0;
+        auto ok = writer.Save(filename);
+        assert(ok);
+        UNUSED(ok);
+    }
+
+    {
+        CheckpointReader reader;
+        auto ok = reader.Open(filename);
+        assert(ok);
+        UNUSED(ok);
+        const void* data;
+        size_t size;
+        ok = reader.Get("floats", &data, &size);
+        assert(ok);
+        assert(size == floats.size() * sizeof(float));
+        assert(!(reinterpret_cast<uintptr_t>(data) % 64));
+        assert(!memcmp(data, floats.data(), size));
+        uint8_t got_bytes[3];
+        ok = reader.CopyTo("bytes", sizeof(got_bytes), got_bytes);
+        assert(ok);
+        assert(!memcmp(got_bytes, bytes, sizeof(bytes)));
+        ok = reader.CopyTo("bytes", 2, got_bytes);
+        assert(!ok);
+        ok = reader.CopyTo("count", sizeof(count), &count);
+        assert(ok);
+        assert(count == 42);
+        ok = reader.Get("missing", &data, &size);
+        assert(!ok);
+        size_t offset;
+        ok = reader.GetOffset("bytes", &offset, &size);
+        assert(ok);
+        assert(size == sizeof(bytes) && !(offset % 64));
+        auto whole = FileToString(filename);
+        assert(!memcmp(&whole[offset], bytes, sizeof(bytes)));
+        ok = reader.GetOffset("missing", &offset, &size);
+        assert(!ok);
+    }
+
+    // Any flipped bit must be caught: in the header, the table, and the first
+    // and last sections.
+    size_t file_size;
+    auto ok = FileSize(filename, &file_size);
+    assert(ok);
+    UNUSED(ok);
+    for (auto offset : {size_t(0), size_t(100), size_t(1000),
+                        file_size - 64}) {
+        FILE* f = fopen(filename, "r+b");
+        fseek(f, static_cast<long>(offset), SEEK_SET);
+        auto c = fgetc(f);
+        fseek(f, static_cast<long>(offset), SEEK_SET);
+        fputc(c ^ 0x10, f);
+        fclose(f);
+
+        CheckpointReader reader;
+        ok = reader.Open(filename);
+        assert(!ok);
+
+        f = fopen(filename, "r+b");
+        fseek(f, static_cast<long>(offset), SEEK_SET);
+        fputc(c, f);
+        fclose(f);
+        ok = reader.Open(filename);
+        assert(ok);
+    }
+
+    // So must a short file.
+    assert(!truncate(filename, static_cast<off_t>(file_size - 64)));
+    CheckpointReader reader;
+    ok = reader.Open(filename);
+    assert(!ok);
+    ok = reader.Open("no_such_checkpoint.bin");
+    assert(!ok);
+
+    // The checksum sees every byte, whatever the length.
+    uint8_t buf[100] = {};
+    for (size_t size = 1; size < sizeof(buf); ++size) {
+        auto before = Checksum(buf, size);
+        buf[size - 1] = 1;
+        assert(Checksum(buf, size) != before);
+        buf[size - 1] = 0;
+    }
+
+    remove(filename);
+}
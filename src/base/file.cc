@@ -2,7 +2,10 @@
 
 #include <cassert>
 #include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 namespace psyence {
 namespace base {
@@ -66,6 +69,73 @@ string FileToString(const char* filename) {
     return s;
 }
 
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const char* filename, AccessPattern pattern,
+                      bool will_need) {
+    Close();
+
+    auto fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st)) {
+        close(fd);
+        return false;
+    }
+    auto size = static_cast<size_t>(st.st_size);
+    if (size) {
+        // The mapping keeps the file open after the descriptor is closed.
+        auto map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        data_ = static_cast<uint8_t*>(map);
+    }
+    close(fd);
+    size_ = size;
+    is_open_ = true;
+    Advise(pattern, will_need);
+    return true;
+}
+
+void MappedFile::Advise(AccessPattern pattern, bool will_need) {
+    if (!data_) {
+        return;
+    }
+
+    // Advice values aren't flags, so each is its own call.
+    int advice = MADV_NORMAL;
+    switch (pattern) {
+    case AccessPattern::NORMAL:
+        advice = MADV_NORMAL;
+        break;
+    case AccessPattern::SEQUENTIAL:
+        advice = MADV_SEQUENTIAL;
+        break;
+    case AccessPattern::RANDOM:
+        advice = MADV_RANDOM;
+        break;
+    }
+    madvise(data_, size_, advice);
+    if (will_need) {
+        madvise(data_, size_, MADV_WILLNEED);
+    }
+}
+
+void MappedFile::Close() {
+    if (data_) {
+        munmap(data_, size_);
+        data_ = nullptr;
+    }
+    size_ = 0;
+    is_open_ = false;
+}
+
 }  // namespace file
 }  // namespace base
 }  // namespace psyence
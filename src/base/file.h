@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 using std::string;
@@ -30,6 +32,54 @@ bool LoadFile(const char* filename, size_t* num_bytes, uint8_t** buf);
 // Crashes on failure.
 string FileToString(const char* filename);
 
+// How a mapped file is going to be read, for the kernel's readahead.
+enum class AccessPattern {
+    // Default readahead.
+    NORMAL,
+
+    // Front to back: read ahead aggressively and drop pages behind.
+    SEQUENTIAL,
+
+    // Scattered: don't read ahead.
+    RANDOM,
+};
+
+// A whole file mapped read-only into memory.
+//
+// Pages are read in from the page cache on first touch and shared with it, so
+// opening costs no copy and no allocation however big the file is.
+class MappedFile {
+  public:
+    // Accessors.
+    bool is_open() const { return is_open_; }
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // Unmap the file.
+    ~MappedFile();
+
+    // Map the file, and advise the kernel of the access pattern (see
+    // Advise()).
+    //
+    // Returns false if the file can't be opened or mapped.  An empty file maps
+    // to no data.
+    bool Open(const char* filename,
+              AccessPattern pattern = AccessPattern::NORMAL,
+              bool will_need = false);
+
+    // Advise the kernel how the mapping is going to be read from now on, and
+    // whether to start reading it all in now.
+    void Advise(AccessPattern pattern, bool will_need = false);
+
+    // Unmap the file.
+    void Close();
+
+  private:
+    bool is_open_{false};
+    uint8_t* data_{nullptr};
+    size_t size_{0};
+};
+
 }  // namespace file
 }  // namespace base
 }  // namespace psyence
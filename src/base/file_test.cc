@@ -1,12 +1,16 @@
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
+#include "base/cxx.h"
 #include "base/file.h"
 
+using psyence::base::file::AccessPattern;
 using psyence::base::file::FileSize;
 using psyence::base::file::FileToString;
 using psyence::base::file::LoadFileTo;
+using psyence::base::file::MappedFile;
 
 int main() {
     auto filename = "test.bin";
@@ -33,5 +37,25 @@ int main() {
     string buf2 = FileToString(filename);
     assert(buf == buf2);
 
+    // Mapped, the same bytes are in place, whatever the access advice.
+    MappedFile mapped;
+    auto ok = mapped.Open(filename, AccessPattern::SEQUENTIAL, true);
+    assert(ok);
+    UNUSED(ok);
+    assert(mapped.is_open());
+    assert(mapped.size() == count);
+    assert(!memcmp(mapped.data(), a.data(), count));
+    mapped.Advise(AccessPattern::RANDOM);
+    assert(!memcmp(mapped.data(), a.data(), count));
+    mapped.Close();
+    assert(!mapped.is_open() && !mapped.data());
+
+    // Empty files map to no data, and missing ones don't map.
+    fclose(fopen(filename, "w"));
+    ok = mapped.Open(filename);
+    assert(ok);
+    assert(!mapped.size() && !mapped.data());
     remove(filename);
+    ok = mapped.Open(filename);
+    assert(!ok);
 }
@@ -0,0 +1,69 @@
+#include "isa.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace psyence {
+namespace base {
+namespace simd {
+
+Isa DetectIsa() {
+    if (IsaSupported(Isa::AVX512)) {
+        return Isa::AVX512;
+    }
+    if (IsaSupported(Isa::AVX2)) {
+        return Isa::AVX2;
+    }
+    if (IsaSupported(Isa::SSE42)) {
+        return Isa::SSE42;
+    }
+    return Isa::SCALAR;
+}
+
+bool IsaSupported(Isa isa) {
+    // Also checks that the OS saves the wider registers (XGETBV).
+    __builtin_cpu_init();
+    switch (isa) {
+    case Isa::SCALAR:
+        return true;
+    case Isa::SSE42:
+        return __builtin_cpu_supports("sse4.2");
+    case Isa::AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case Isa::AVX512:
+        return __builtin_cpu_supports("avx512f") &&
+               __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    assert(false);
+    return false;
+}
+
+const char* IsaName(Isa isa) {
+    switch (isa) {
+    case Isa::SCALAR:
+        return "scalar";
+    case Isa::SSE42:
+        return "sse4.2";
+    case Isa::AVX2:
+        return "avx2";
+    case Isa::AVX512:
+        return "avx512";
+    }
+    assert(false);
+    return "";
+}
+
+bool ParseIsa(const char* name, Isa* isa) {
+    Isa isas[] = {Isa::SCALAR, Isa::SSE42, Isa::AVX2, Isa::AVX512};
+    for (auto& it : isas) {
+        if (!strcmp(name, IsaName(it))) {
+            *isa = it;
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace simd
+}  // namespace base
+}  // namespace psyence
@@ -0,0 +1,35 @@
+#pragma once
+
+namespace psyence {
+namespace base {
+namespace simd {
+
+// Instruction set levels that we have kernels for, from least to most capable.
+//
+// We ship one binary across mixed hardware, so we never compile with
+// -march=native.  Instead, each kernel is compiled for every level with
+// per-function target attributes and the best one is picked at startup.
+enum class Isa {
+    SCALAR,
+    SSE42,
+    AVX2,
+    AVX512,
+};
+
+// Get the most capable instruction set level that this CPU (and OS) supports.
+Isa DetectIsa();
+
+// Whether this CPU supports the given instruction set level.
+bool IsaSupported(Isa isa);
+
+// Human-readable name of the instruction set level.
+const char* IsaName(Isa isa);
+
+// Parse an instruction set level from its name (see IsaName()).
+//
+// Returns true on success, false if the name is unknown.
+bool ParseIsa(const char* name, Isa* isa);
+
+}  // namespace simd
+}  // namespace base
+}  // namespace psyence
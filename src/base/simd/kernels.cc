@@ -0,0 +1,1090 @@
+#include "kernels.h"
+
+#include <cassert>
+#include <cstring>
+#include <immintrin.h>
+
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+
+namespace psyence {
+namespace base {
+namespace simd {
+
+namespace {
+
+// Table of kernel implementations for one instruction set level.
+struct KernelTable {
+    float (*dot)(const float* a, const float* b, size_t count);
+    void (*mat_vec)(const float* mat, size_t num_rows, size_t num_cols,
+                    const float* x, float* y);
+    void (*mat_mat)(const float* mat, size_t num_rows, size_t num_cols,
+                    const float* xs, size_t num_vecs, float* ys,
+                    size_t ys_stride);
+    float (*sum)(const float* x, size_t count);
+    float (*sum_squared_gaps)(const float* x, size_t count, float mean);
+    void (*standardize)(float mean, float std, size_t count, float* x);
+    void (*axpy)(float alpha, const float* x, size_t count, float* y);
+    void (*bf16_to_float)(const uint16_t* x, size_t count, float* y);
+    void (*round_to_bf16)(const float* x, size_t count, uint32_t seed,
+                          uint16_t* y);
+    void (*scale_bytes_to_float)(const uint8_t* x, size_t count, float scale,
+                                 float* y);
+    void (*byte_swap)(const void* x, size_t count, size_t width, void* y);
+};
+
+// Byte shuffle that reverses each value of 2, 4 or 8 bytes in a 16-byte lane.
+const uint8_t BYTE_SWAP_SHUFFLES[3][16] = {
+    {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+    {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12},
+    {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8},
+};
+
+// Index into BYTE_SWAP_SHUFFLES of a value width.
+size_t ByteSwapShuffleIndex(size_t width) {
+    return width == 2 ? 0 : width == 4 ? 1 : 2;
+}
+
+// Constants of the noise hash used for stochastic rounding.
+//
+// Element i of a call gets the noise Hash(seed + i * NOISE_STEP), where Hash is
+// the "lowbias32" integer hash.  Every level computes exactly this, so the
+// rounding is the same on all of them.
+const uint32_t NOISE_STEP = 0x9E3779B9u;
+const uint32_t NOISE_MUL_0 = 0x7FEB352Du;
+const uint32_t NOISE_MUL_1 = 0x846CA68Bu;
+
+// -----------------------------------------------------------------------------
+// Scalar.
+//
+// Reference implementations, also used for the tails of the vector kernels.
+
+namespace scalar {
+
+float Dot(const float* a, const float* b, size_t count) {
+    float sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+void MatVec(const float* mat, size_t num_rows, size_t num_cols,
+            const float* x, float* y) {
+    for (size_t i = 0; i < num_rows; ++i) {
+        y[i] = Dot(&mat[i * num_cols], x, num_cols);
+    }
+}
+
+void MatMat(const float* mat, size_t num_rows, size_t num_cols,
+            const float* xs, size_t num_vecs, float* ys, size_t ys_stride) {
+    for (size_t v = 0; v < num_vecs; ++v) {
+        MatVec(mat, num_rows, num_cols, &xs[v * num_cols], &ys[v * ys_stride]);
+    }
+}
+
+float Sum(const float* x, size_t count) {
+    float sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += x[i];
+    }
+    return sum;
+}
+
+float SumSquaredGaps(const float* x, size_t count, float mean) {
+    float sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+        auto gap = x[i] - mean;
+        sum += gap * gap;
+    }
+    return sum;
+}
+
+void Standardize(float mean, float std, size_t count, float* x) {
+    for (size_t i = 0; i < count; ++i) {
+        x[i] = (x[i] - mean) / std;
+    }
+}
+
+void Axpy(float alpha, const float* x, size_t count, float* y) {
+    for (size_t i = 0; i < count; ++i) {
+        y[i] += alpha * x[i];
+    }
+}
+
+uint32_t NoiseHash(uint32_t x) {
+    x ^= x >> 16;
+    x *= NOISE_MUL_0;
+    x ^= x >> 15;
+    x *= NOISE_MUL_1;
+    x ^= x >> 16;
+    return x;
+}
+
+void Bf16ToFloat(const uint16_t* x, size_t count, float* y) {
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t bits = static_cast<uint32_t>(x[i]) << 16;
+        memcpy(&y[i], &bits, sizeof(bits));
+    }
+}
+
+void RoundToBf16(const float* x, size_t count, uint32_t seed, uint16_t* y) {
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t bits;
+        memcpy(&bits, &x[i], sizeof(bits));
+        auto noise = NoiseHash(seed + static_cast<uint32_t>(i) * NOISE_STEP);
+        y[i] = static_cast<uint16_t>((bits + (noise >> 16)) >> 16);
+    }
+}
+
+void ScaleBytesToFloat(const uint8_t* x, size_t count, float scale,
+                       float* y) {
+    for (size_t i = 0; i < count; ++i) {
+        y[i] = static_cast<float>(x[i]) * scale;
+    }
+}
+
+void ByteSwap(const void* x, size_t count, size_t width, void* y) {
+    auto in = static_cast<const uint8_t*>(x);
+    auto out = static_cast<uint8_t*>(y);
+    if (width == 1) {
+        memmove(out, in, count);
+        return;
+    }
+    assert(width == 2 || width == 4 || width == 8);
+    for (size_t i = 0; i < count * width; i += width) {
+        uint8_t value[8];
+        memcpy(value, &in[i], width);
+        for (size_t j = 0; j < width; ++j) {
+            out[i + j] = value[width - 1 - j];
+        }
+    }
+}
+
+const KernelTable TABLE = {
+    Dot, MatVec, MatMat, Sum, SumSquaredGaps, Standardize, Axpy, Bf16ToFloat,
+    RoundToBf16, ScaleBytesToFloat, ByteSwap,
+};
+
+}  // namespace scalar
+
+// -----------------------------------------------------------------------------
+// SSE4.2: 4 lanes, two accumulators.
+
+namespace sse42 {
+
+TARGET_SSE42 float HSum(__m128 v) {
+    auto shuf = _mm_movehdup_ps(v);
+    auto sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+TARGET_SSE42 float Dot(const float* a, const float* b, size_t count) {
+    auto acc0 = _mm_setzero_ps();
+    auto acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(&a[i]),
+                                           _mm_loadu_ps(&b[i])));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(&a[i + 4]),
+                                           _mm_loadu_ps(&b[i + 4])));
+    }
+    float tail = 0;
+    for (; i < count; ++i) {
+        tail += a[i] * b[i];
+    }
+    return HSum(_mm_add_ps(acc0, acc1)) + tail;
+}
+
+TARGET_SSE42 void MatVec(const float* mat, size_t num_rows,
+                         size_t num_cols, const float* x, float* y) {
+    size_t r = 0;
+    for (; r + 4 <= num_rows; r += 4) {
+        auto m0 = &mat[r * num_cols];
+        auto m1 = m0 + num_cols;
+        auto m2 = m1 + num_cols;
+        auto m3 = m2 + num_cols;
+        auto a00 = _mm_setzero_ps();
+        auto a01 = _mm_setzero_ps();
+        auto a10 = _mm_setzero_ps();
+        auto a11 = _mm_setzero_ps();
+        auto a20 = _mm_setzero_ps();
+        auto a21 = _mm_setzero_ps();
+        auto a30 = _mm_setzero_ps();
+        auto a31 = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= num_cols; i += 8) {
+            auto x0 = _mm_loadu_ps(&x[i]);
+            auto x1 = _mm_loadu_ps(&x[i + 4]);
+            a00 = _mm_add_ps(a00, _mm_mul_ps(_mm_loadu_ps(&m0[i]), x0));
+            a01 = _mm_add_ps(a01, _mm_mul_ps(_mm_loadu_ps(&m0[i + 4]), x1));
+            a10 = _mm_add_ps(a10, _mm_mul_ps(_mm_loadu_ps(&m1[i]), x0));
+            a11 = _mm_add_ps(a11, _mm_mul_ps(_mm_loadu_ps(&m1[i + 4]), x1));
+            a20 = _mm_add_ps(a20, _mm_mul_ps(_mm_loadu_ps(&m2[i]), x0));
+            a21 = _mm_add_ps(a21, _mm_mul_ps(_mm_loadu_ps(&m2[i + 4]), x1));
+            a30 = _mm_add_ps(a30, _mm_mul_ps(_mm_loadu_ps(&m3[i]), x0));
+            a31 = _mm_add_ps(a31, _mm_mul_ps(_mm_loadu_ps(&m3[i + 4]), x1));
+        }
+        float t0 = 0;
+        float t1 = 0;
+        float t2 = 0;
+        float t3 = 0;
+        for (; i < num_cols; ++i) {
+            t0 += m0[i] * x[i];
+            t1 += m1[i] * x[i];
+            t2 += m2[i] * x[i];
+            t3 += m3[i] * x[i];
+        }
+        y[r] = HSum(_mm_add_ps(a00, a01)) + t0;
+        y[r + 1] = HSum(_mm_add_ps(a10, a11)) + t1;
+        y[r + 2] = HSum(_mm_add_ps(a20, a21)) + t2;
+        y[r + 3] = HSum(_mm_add_ps(a30, a31)) + t3;
+    }
+    for (; r < num_rows; ++r) {
+        y[r] = Dot(&mat[r * num_cols], x, num_cols);
+    }
+}
+
+// Four vectors at a time against each row, so each load of the matrix feeds
+// all four.  Each (row, vector) pair accumulates exactly like Dot().
+TARGET_SSE42 void MatMat(const float* mat, size_t num_rows, size_t num_cols,
+                         const float* xs, size_t num_vecs, float* ys,
+                         size_t ys_stride) {
+    size_t v = 0;
+    for (; v + 4 <= num_vecs; v += 4) {
+        auto x0 = &xs[v * num_cols];
+        auto x1 = x0 + num_cols;
+        auto x2 = x1 + num_cols;
+        auto x3 = x2 + num_cols;
+        auto y0 = &ys[v * ys_stride];
+        auto y1 = y0 + ys_stride;
+        auto y2 = y1 + ys_stride;
+        auto y3 = y2 + ys_stride;
+        for (size_t r = 0; r < num_rows; ++r) {
+            auto m = &mat[r * num_cols];
+            auto a00 = _mm_setzero_ps();
+            auto a01 = _mm_setzero_ps();
+            auto a10 = _mm_setzero_ps();
+            auto a11 = _mm_setzero_ps();
+            auto a20 = _mm_setzero_ps();
+            auto a21 = _mm_setzero_ps();
+            auto a30 = _mm_setzero_ps();
+            auto a31 = _mm_setzero_ps();
+            size_t i = 0;
+            for (; i + 8 <= num_cols; i += 8) {
+                auto m0 = _mm_loadu_ps(&m[i]);
+                auto m1 = _mm_loadu_ps(&m[i + 4]);
+                a00 = _mm_add_ps(a00, _mm_mul_ps(m0, _mm_loadu_ps(&x0[i])));
+                a01 = _mm_add_ps(a01, _mm_mul_ps(m1, _mm_loadu_ps(&x0[i + 4])));
+                a10 = _mm_add_ps(a10, _mm_mul_ps(m0, _mm_loadu_ps(&x1[i])));
+                a11 = _mm_add_ps(a11, _mm_mul_ps(m1, _mm_loadu_ps(&x1[i + 4])));
+                a20 = _mm_add_ps(a20, _mm_mul_ps(m0, _mm_loadu_ps(&x2[i])));
+                a21 = _mm_add_ps(a21, _mm_mul_ps(m1, _mm_loadu_ps(&x2[i + 4])));
+                a30 = _mm_add_ps(a30, _mm_mul_ps(m0, _mm_loadu_ps(&x3[i])));
+                a31 = _mm_add_ps(a31, _mm_mul_ps(m1, _mm_loadu_ps(&x3[i + 4])));
+            }
+            float t0 = 0;
+            float t1 = 0;
+            float t2 = 0;
+            float t3 = 0;
+            for (; i < num_cols; ++i) {
+                t0 += m[i] * x0[i];
+                t1 += m[i] * x1[i];
+                t2 += m[i] * x2[i];
+                t3 += m[i] * x3[i];
+            }
+            y0[r] = HSum(_mm_add_ps(a00, a01)) + t0;
+            y1[r] = HSum(_mm_add_ps(a10, a11)) + t1;
+            y2[r] = HSum(_mm_add_ps(a20, a21)) + t2;
+            y3[r] = HSum(_mm_add_ps(a30, a31)) + t3;
+        }
+    }
+    for (; v < num_vecs; ++v) {
+        MatVec(mat, num_rows, num_cols, &xs[v * num_cols],
+               &ys[v * ys_stride]);
+    }
+}
+
+TARGET_SSE42 float Sum(const float* x, size_t count) {
+    auto acc0 = _mm_setzero_ps();
+    auto acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_loadu_ps(&x[i]));
+        acc1 = _mm_add_ps(acc1, _mm_loadu_ps(&x[i + 4]));
+    }
+    float tail = 0;
+    for (; i < count; ++i) {
+        tail += x[i];
+    }
+    return HSum(_mm_add_ps(acc0, acc1)) + tail;
+}
+
+TARGET_SSE42 float SumSquaredGaps(const float* x, size_t count, float mean) {
+    auto mean_v = _mm_set1_ps(mean);
+    auto acc0 = _mm_setzero_ps();
+    auto acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto gap0 = _mm_sub_ps(_mm_loadu_ps(&x[i]), mean_v);
+        auto gap1 = _mm_sub_ps(_mm_loadu_ps(&x[i + 4]), mean_v);
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(gap0, gap0));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(gap1, gap1));
+    }
+    float tail = 0;
+    for (; i < count; ++i) {
+        auto gap = x[i] - mean;
+        tail += gap * gap;
+    }
+    return HSum(_mm_add_ps(acc0, acc1)) + tail;
+}
+
+TARGET_SSE42 void Standardize(float mean, float std, size_t count, float* x) {
+    auto mean_v = _mm_set1_ps(mean);
+    auto std_v = _mm_set1_ps(std);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto v = _mm_sub_ps(_mm_loadu_ps(&x[i]), mean_v);
+        _mm_storeu_ps(&x[i], _mm_div_ps(v, std_v));
+    }
+    for (; i < count; ++i) {
+        x[i] = (x[i] - mean) / std;
+    }
+}
+
+TARGET_SSE42 void Axpy(float alpha, const float* x, size_t count, float* y) {
+    auto alpha_v = _mm_set1_ps(alpha);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto v = _mm_mul_ps(alpha_v, _mm_loadu_ps(&x[i]));
+        _mm_storeu_ps(&y[i], _mm_add_ps(_mm_loadu_ps(&y[i]), v));
+    }
+    for (; i < count; ++i) {
+        y[i] += alpha * x[i];
+    }
+}
+
+TARGET_SSE42 __m128i NoiseHash(__m128i x) {
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    x = _mm_mullo_epi32(x, _mm_set1_epi32(static_cast<int>(NOISE_MUL_0)));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+    x = _mm_mullo_epi32(x, _mm_set1_epi32(static_cast<int>(NOISE_MUL_1)));
+    return _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+}
+
+TARGET_SSE42 void Bf16ToFloat(const uint16_t* x, size_t count, float* y) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto v = _mm_cvtepu16_epi32(_mm_loadl_epi64(
+            reinterpret_cast<const __m128i*>(&x[i])));
+        _mm_storeu_ps(&y[i], _mm_castsi128_ps(_mm_slli_epi32(v, 16)));
+    }
+    scalar::Bf16ToFloat(&x[i], count - i, &y[i]);
+}
+
+TARGET_SSE42 void RoundToBf16(const float* x, size_t count, uint32_t seed,
+                              uint16_t* y) {
+    auto step_v = _mm_set1_epi32(static_cast<int>(NOISE_STEP * 4));
+    auto counter = _mm_add_epi32(
+        _mm_set1_epi32(static_cast<int>(seed)),
+        _mm_mullo_epi32(_mm_setr_epi32(0, 1, 2, 3),
+                        _mm_set1_epi32(static_cast<int>(NOISE_STEP))));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        auto noise = _mm_srli_epi32(NoiseHash(counter), 16);
+        auto bits = _mm_castps_si128(_mm_loadu_ps(&x[i]));
+        auto v = _mm_srli_epi32(_mm_add_epi32(bits, noise), 16);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&y[i]),
+                         _mm_packus_epi32(v, v));
+        counter = _mm_add_epi32(counter, step_v);
+    }
+    scalar::RoundToBf16(&x[i], count - i,
+                        seed + static_cast<uint32_t>(i) * NOISE_STEP, &y[i]);
+}
+
+TARGET_SSE42 void ScaleBytesToFloat(const uint8_t* x, size_t count,
+                                    float scale, float* y) {
+    auto scale_v = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&x[i]));
+        for (size_t j = 0; j < 16; j += 4) {
+            auto f = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(v));
+            _mm_storeu_ps(&y[i + j], _mm_mul_ps(f, scale_v));
+            v = _mm_srli_si128(v, 4);
+        }
+    }
+    scalar::ScaleBytesToFloat(&x[i], count - i, scale, &y[i]);
+}
+
+TARGET_SSE42 void ByteSwap(const void* x, size_t count, size_t width,
+                           void* y) {
+    if (width == 1) {
+        scalar::ByteSwap(x, count, width, y);
+        return;
+    }
+    auto in = static_cast<const uint8_t*>(x);
+    auto out = static_cast<uint8_t*>(y);
+    auto shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+        BYTE_SWAP_SHUFFLES[ByteSwapShuffleIndex(width)]));
+    auto num_bytes = count * width;
+    size_t i = 0;
+    for (; i + 16 <= num_bytes; i += 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&in[i]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]),
+                         _mm_shuffle_epi8(v, shuffle));
+    }
+    scalar::ByteSwap(&in[i], (num_bytes - i) / width, width, &out[i]);
+}
+
+const KernelTable TABLE = {
+    Dot, MatVec, MatMat, Sum, SumSquaredGaps, Standardize, Axpy, Bf16ToFloat,
+    RoundToBf16, ScaleBytesToFloat, ByteSwap,
+};
+
+}  // namespace sse42
+
+// -----------------------------------------------------------------------------
+// AVX2 + FMA: 8 lanes, two accumulators.
+
+namespace avx2 {
+
+TARGET_AVX2 float HSum(__m256 v) {
+    auto lo = _mm256_castps256_ps128(v);
+    auto hi = _mm256_extractf128_ps(v, 1);
+    return sse42::HSum(_mm_add_ps(lo, hi));
+}
+
+TARGET_AVX2 float Dot(const float* a, const float* b, size_t count) {
+    auto acc0 = _mm256_setzero_ps();
+    auto acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i]),
+                               acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[i + 8]),
+                               _mm256_loadu_ps(&b[i + 8]), acc1);
+    }
+    float tail = 0;
+    for (; i < count; ++i) {
+        tail += a[i] * b[i];
+    }
+    return HSum(_mm256_add_ps(acc0, acc1)) + tail;
+}
+
+TARGET_AVX2 void MatVec(const float* mat, size_t num_rows,
+                        size_t num_cols, const float* x, float* y) {
+    size_t r = 0;
+    for (; r + 4 <= num_rows; r += 4) {
+        auto m0 = &mat[r * num_cols];
+        auto m1 = m0 + num_cols;
+        auto m2 = m1 + num_cols;
+        auto m3 = m2 + num_cols;
+        auto a00 = _mm256_setzero_ps();
+        auto a01 = _mm256_setzero_ps();
+        auto a10 = _mm256_setzero_ps();
+        auto a11 = _mm256_setzero_ps();
+        auto a20 = _mm256_setzero_ps();
+        auto a21 = _mm256_setzero_ps();
+        auto a30 = _mm256_setzero_ps();
+        auto a31 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= num_cols; i += 16) {
+            auto x0 = _mm256_loadu_ps(&x[i]);
+            auto x1 = _mm256_loadu_ps(&x[i + 8]);
+            a00 = _mm256_fmadd_ps(_mm256_loadu_ps(&m0[i]), x0, a00);
+            a01 = _mm256_fmadd_ps(_mm256_loadu_ps(&m0[i + 8]), x1, a01);
+            a10 = _mm256_fmadd_ps(_mm256_loadu_ps(&m1[i]), x0, a10);
+            a11 = _mm256_fmadd_ps(_mm256_loadu_ps(&m1[i + 8]), x1, a11);
+            a20 = _mm256_fmadd_ps(_mm256_loadu_ps(&m2[i]), x0, a20);
+            a21 = _mm256_fmadd_ps(_mm256_loadu_ps(&m2[i + 8]), x1, a21);
+            a30 = _mm256_fmadd_ps(_mm256_loadu_ps(&m3[i]), x0, a30);
+            a31 = _mm256_fmadd_ps(_mm256_loadu_ps(&m3[i + 8]), x1, a31);
+        }
+        float t0 = 0;
+        float t1 = 0;
+        float t2 = 0;
+        float t3 = 0;
+        for (; i < num_cols; ++i) {
+            t0 += m0[i] * x[i];
+            t1 += m1[i] * x[i];
+            t2 += m2[i] * x[i];
+            t3 += m3[i] * x[i];
+        }
+        y[r] = HSum(_mm256_add_ps(a00, a01)) + t0;
+        y[r + 1] = HSum(_mm256_add_ps(a10, a11)) + t1;
+        y[r + 2] = HSum(_mm256_add_ps(a20, a21)) + t2;
+        y[r + 3] = HSum(_mm256_add_ps(a30, a31)) + t3;
+    }
+    for (; r < num_rows; ++r) {
+        y[r] = Dot(&mat[r * num_cols], x, num_cols);
+    }
+}
+
+TARGET_AVX2 void MatMat(const float* mat, size_t num_rows, size_t num_cols,
+                        const float* xs, size_t num_vecs, float* ys,
+                        size_t ys_stride) {
+    size_t v = 0;
+    for (; v + 4 <= num_vecs; v += 4) {
+        auto x0 = &xs[v * num_cols];
+        auto x1 = x0 + num_cols;
+        auto x2 = x1 + num_cols;
+        auto x3 = x2 + num_cols;
+        auto y0 = &ys[v * ys_stride];
+        auto y1 = y0 + ys_stride;
+        auto y2 = y1 + ys_stride;
+        auto y3 = y2 + ys_stride;
+        for (size_t r = 0; r < num_rows; ++r) {
+            auto m = &mat[r * num_cols];
+            auto a00 = _mm256_setzero_ps();
+            auto a01 = _mm256_setzero_ps();
+            auto a10 = _mm256_setzero_ps();
+            auto a11 = _mm256_setzero_ps();
+            auto a20 = _mm256_setzero_ps();
+            auto a21 = _mm256_setzero_ps();
+            auto a30 = _mm256_setzero_ps();
+            auto a31 = _mm256_setzero_ps();
+            size_t i = 0;
+            for (; i + 16 <= num_cols; i += 16) {
+                auto m0 = _mm256_loadu_ps(&m[i]);
+                auto m1 = _mm256_loadu_ps(&m[i + 8]);
+                a00 = _mm256_fmadd_ps(m0, _mm256_loadu_ps(&x0[i]), a00);
+                a01 = _mm256_fmadd_ps(m1, _mm256_loadu_ps(&x0[i + 8]), a01);
+                a10 = _mm256_fmadd_ps(m0, _mm256_loadu_ps(&x1[i]), a10);
+                a11 = _mm256_fmadd_ps(m1, _mm256_loadu_ps(&x1[i + 8]), a11);
+                a20 = _mm256_fmadd_ps(m0, _mm256_loadu_ps(&x2[i]), a20);
+                a21 = _mm256_fmadd_ps(m1, _mm256_loadu_ps(&x2[i + 8]), a21);
+                a30 = _mm256_fmadd_ps(m0, _mm256_loadu_ps(&x3[i]), a30);
+                a31 = _mm256_fmadd_ps(m1, _mm256_loadu_ps(&x3[i + 8]), a31);
+            }
+            float t0 = 0;
+            float t1 = 0;
+            float t2 = 0;
+            float t3 = 0;
+            for (; i < num_cols; ++i) {
+                t0 += m[i] * x0[i];
+                t1 += m[i] * x1[i];
+                t2 += m[i] * x2[i];
+                t3 += m[i] * x3[i];
+            }
+            y0[r] = HSum(_mm256_add_ps(a00, a01)) + t0;
+            y1[r] = HSum(_mm256_add_ps(a10, a11)) + t1;
+            y2[r] = HSum(_mm256_add_ps(a20, a21)) + t2;
+            y3[r] = HSum(_mm256_add_ps(a30, a31)) + t3;
+        }
+    }
+    for (; v < num_vecs; ++v) {
+        MatVec(mat, num_rows, num_cols, &xs[v * num_cols],
+               &ys[v * ys_stride]);
+    }
+}
+
+TARGET_AVX2 float Sum(const float* x, size_t count) {
+    auto acc0 = _mm256_setzero_ps();
+    auto acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        acc0 = _mm256_add_ps(acc0, _mm256_loadu_ps(&x[i]));
+        acc1 = _mm256_add_ps(acc1, _mm256_loadu_ps(&x[i + 8]));
+    }
+    float tail = 0;
+    for (; i < count; ++i) {
+        tail += x[i];
+    }
+    return HSum(_mm256_add_ps(acc0, acc1)) + tail;
+}
+
+TARGET_AVX2 float SumSquaredGaps(const float* x, size_t count, float mean) {
+    auto mean_v = _mm256_set1_ps(mean);
+    auto acc0 = _mm256_setzero_ps();
+    auto acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        auto gap0 = _mm256_sub_ps(_mm256_loadu_ps(&x[i]), mean_v);
+        auto gap1 = _mm256_sub_ps(_mm256_loadu_ps(&x[i + 8]), mean_v);
+        acc0 = _mm256_fmadd_ps(gap0, gap0, acc0);
+        acc1 = _mm256_fmadd_ps(gap1, gap1, acc1);
+    }
+    float tail = 0;
+    for (; i < count; ++i) {
+        auto gap = x[i] - mean;
+        tail += gap * gap;
+    }
+    return HSum(_mm256_add_ps(acc0, acc1)) + tail;
+}
+
+TARGET_AVX2 void Standardize(float mean, float std, size_t count, float* x) {
+    auto mean_v = _mm256_set1_ps(mean);
+    auto std_v = _mm256_set1_ps(std);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto v = _mm256_sub_ps(_mm256_loadu_ps(&x[i]), mean_v);
+        _mm256_storeu_ps(&x[i], _mm256_div_ps(v, std_v));
+    }
+    for (; i < count; ++i) {
+        x[i] = (x[i] - mean) / std;
+    }
+}
+
+TARGET_AVX2 void Axpy(float alpha, const float* x, size_t count, float* y) {
+    auto alpha_v = _mm256_set1_ps(alpha);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto v = _mm256_fmadd_ps(alpha_v, _mm256_loadu_ps(&x[i]),
+                                 _mm256_loadu_ps(&y[i]));
+        _mm256_storeu_ps(&y[i], v);
+    }
+    for (; i < count; ++i) {
+        y[i] += alpha * x[i];
+    }
+}
+
+TARGET_AVX2 __m256i NoiseHash(__m256i x) {
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32(static_cast<int>(NOISE_MUL_0)));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32(static_cast<int>(NOISE_MUL_1)));
+    return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+}
+
+TARGET_AVX2 void Bf16ToFloat(const uint16_t* x, size_t count, float* y) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto v = _mm256_cvtepu16_epi32(_mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(&x[i])));
+        _mm256_storeu_ps(&y[i], _mm256_castsi256_ps(_mm256_slli_epi32(v, 16)));
+    }
+    scalar::Bf16ToFloat(&x[i], count - i, &y[i]);
+}
+
+TARGET_AVX2 void RoundToBf16(const float* x, size_t count, uint32_t seed,
+                             uint16_t* y) {
+    auto step_v = _mm256_set1_epi32(static_cast<int>(NOISE_STEP * 8));
+    auto counter = _mm256_add_epi32(
+        _mm256_set1_epi32(static_cast<int>(seed)),
+        _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                           _mm256_set1_epi32(static_cast<int>(NOISE_STEP))));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto noise = _mm256_srli_epi32(NoiseHash(counter), 16);
+        auto bits = _mm256_castps_si256(_mm256_loadu_ps(&x[i]));
+        auto v = _mm256_srli_epi32(_mm256_add_epi32(bits, noise), 16);
+
+        // Packing works within each 128-bit lane, so gather the two halves.
+        auto packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&y[i]),
+                         _mm256_castsi256_si128(packed));
+        counter = _mm256_add_epi32(counter, step_v);
+    }
+    scalar::RoundToBf16(&x[i], count - i,
+                        seed + static_cast<uint32_t>(i) * NOISE_STEP, &y[i]);
+}
+
+TARGET_AVX2 void ScaleBytesToFloat(const uint8_t* x, size_t count,
+                                   float scale, float* y) {
+    auto scale_v = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        auto v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+            reinterpret_cast<const __m128i*>(&x[i])));
+        _mm256_storeu_ps(&y[i], _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale_v));
+    }
+    sse42::ScaleBytesToFloat(&x[i], count - i, scale, &y[i]);
+}
+
+TARGET_AVX2 void ByteSwap(const void* x, size_t count, size_t width,
+                          void* y) {
+    if (width == 1) {
+        scalar::ByteSwap(x, count, width, y);
+        return;
+    }
+    auto in = static_cast<const uint8_t*>(x);
+    auto out = static_cast<uint8_t*>(y);
+
+    // The shuffle works within each 16-byte lane, which values never cross.
+    auto shuffle = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+            BYTE_SWAP_SHUFFLES[ByteSwapShuffleIndex(width)])));
+    auto num_bytes = count * width;
+    size_t i = 0;
+    for (; i + 32 <= num_bytes; i += 32) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&in[i]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[i]),
+                            _mm256_shuffle_epi8(v, shuffle));
+    }
+    sse42::ByteSwap(&in[i], (num_bytes - i) / width, width, &out[i]);
+}
+
+const KernelTable TABLE = {
+    Dot, MatVec, MatMat, Sum, SumSquaredGaps, Standardize, Axpy, Bf16ToFloat,
+    RoundToBf16, ScaleBytesToFloat, ByteSwap,
+};
+
+}  // namespace avx2
+
+// -----------------------------------------------------------------------------
+// AVX-512: 16 lanes, two accumulators.
+
+namespace avx512 {
+
+TARGET_AVX512 float HSum(__m512 v) {
+    auto lo = _mm512_castps512_ps256(v);
+    auto hi = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1));
+    return avx2::HSum(_mm256_add_ps(lo, hi));
+}
+
+TARGET_AVX512 float Dot(const float* a, const float* b, size_t count) {
+    auto acc0 = _mm512_setzero_ps();
+    auto acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(&a[i]), _mm512_loadu_ps(&b[i]),
+                               acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(&a[i + 16]),
+                               _mm512_loadu_ps(&b[i + 16]), acc1);
+    }
+    float tail = 0;
+    for (; i < count; ++i) {
+        tail += a[i] * b[i];
+    }
+    return HSum(_mm512_add_ps(acc0, acc1)) + tail;
+}
+
+TARGET_AVX512 void MatVec(const float* mat, size_t num_rows,
+                          size_t num_cols, const float* x, float* y) {
+    size_t r = 0;
+    for (; r + 4 <= num_rows; r += 4) {
+        auto m0 = &mat[r * num_cols];
+        auto m1 = m0 + num_cols;
+        auto m2 = m1 + num_cols;
+        auto m3 = m2 + num_cols;
+        auto a00 = _mm512_setzero_ps();
+        auto a01 = _mm512_setzero_ps();
+        auto a10 = _mm512_setzero_ps();
+        auto a11 = _mm512_setzero_ps();
+        auto a20 = _mm512_setzero_ps();
+        auto a21 = _mm512_setzero_ps();
+        auto a30 = _mm512_setzero_ps();
+        auto a31 = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 32 <= num_cols; i += 32) {
+            auto x0 = _mm512_loadu_ps(&x[i]);
+            auto x1 = _mm512_loadu_ps(&x[i + 16]);
+            a00 = _mm512_fmadd_ps(_mm512_loadu_ps(&m0[i]), x0, a00);
+            a01 = _mm512_fmadd_ps(_mm512_loadu_ps(&m0[i + 16]), x1, a01);
+            a10 = _mm512_fmadd_ps(_mm512_loadu_ps(&m1[i]), x0, a10);
+            a11 = _mm512_fmadd_ps(_mm512_loadu_ps(&m1[i + 16]), x1, a11);
+            a20 = _mm512_fmadd_ps(_mm512_loadu_ps(&m2[i]), x0, a20);
+            a21 = _mm512_fmadd_ps(_mm512_loadu_ps(&m2[i + 16]), x1, a21);
+            a30 = _mm512_fmadd_ps(_mm512_loadu_ps(&m3[i]), x0, a30);
+            a31 = _mm512_fmadd_ps(_mm512_loadu_ps(&m3[i + 16]), x1, a31);
+        }
+        float t0 = 0;
+        float t1 = 0;
+        float t2 = 0;
+        float t3 = 0;
+        for (; i < num_cols; ++i) {
+            t0 += m0[i] * x[i];
+            t1 += m1[i] * x[i];
+            t2 += m2[i] * x[i];
+            t3 += m3[i] * x[i];
+        }
+        y[r] = HSum(_mm512_add_ps(a00, a01)) + t0;
+        y[r + 1] = HSum(_mm512_add_ps(a10, a11)) + t1;
+        y[r + 2] = HSum(_mm512_add_ps(a20, a21)) + t2;
+        y[r + 3] = HSum(_mm512_add_ps(a30, a31)) + t3;
+    }
+    for (; r < num_rows; ++r) {
+        y[r] = Dot(&mat[r * num_cols], x, num_cols);
+    }
+}
+
+TARGET_AVX512 void MatMat(const float* mat, size_t num_rows, size_t num_cols,
+                          const float* xs, size_t num_vecs, float* ys,
+                          size_t ys_stride) {
+    size_t v = 0;
+    for (; v + 4 <= num_vecs; v += 4) {
+        auto x0 = &xs[v * num_cols];
+        auto x1 = x0 + num_cols;
+        auto x2 = x1 + num_cols;
+        auto x3 = x2 + num_cols;
+        auto y0 = &ys[v * ys_stride];
+        auto y1 = y0 + ys_stride;
+        auto y2 = y1 + ys_stride;
+        auto y3 = y2 + ys_stride;
+        for (size_t r = 0; r < num_rows; ++r) {
+            auto m = &mat[r * num_cols];
+            auto a00 = _mm512_setzero_ps();
+            auto a01 = _mm512_setzero_ps();
+            auto a10 = _mm512_setzero_ps();
+            auto a11 = _mm512_setzero_ps();
+            auto a20 = _mm512_setzero_ps();
+            auto a21 = _mm512_setzero_ps();
+            auto a30 = _mm512_setzero_ps();
+            auto a31 = _mm512_setzero_ps();
+            size_t i = 0;
+            for (; i + 32 <= num_cols; i += 32) {
+                auto m0 = _mm512_loadu_ps(&m[i]);
+                auto m1 = _mm512_loadu_ps(&m[i + 16]);
+                a00 = _mm512_fmadd_ps(m0, _mm512_loadu_ps(&x0[i]), a00);
+                a01 = _mm512_fmadd_ps(m1, _mm512_loadu_ps(&x0[i + 16]), a01);
+                a10 = _mm512_fmadd_ps(m0, _mm512_loadu_ps(&x1[i]), a10);
+                a11 = _mm512_fmadd_ps(m1, _mm512_loadu_ps(&x1[i + 16]), a11);
+                a20 = _mm512_fmadd_ps(m0, _mm512_loadu_ps(&x2[i]), a20);
+                a21 = _mm512_fmadd_ps(m1, _mm512_loadu_ps(&x2[i + 16]), a21);
+                a30 = _mm512_fmadd_ps(m0, _mm512_loadu_ps(&x3[i]), a30);
+                a31 = _mm512_fmadd_ps(m1, _mm512_loadu_ps(&x3[i + 16]), a31);
+            }
+            float t0 = 0;
+            float t1 = 0;
+            float t2 = 0;
+            float t3 = 0;
+            for (; i < num_cols; ++i) {
+                t0 += m[i] * x0[i];
+                t1 += m[i] * x1[i];
+                t2 += m[i] * x2[i];
+                t3 += m[i] * x3[i];
+            }
+            y0[r] = HSum(_mm512_add_ps(a00, a01)) + t0;
+            y1[r] = HSum(_mm512_add_ps(a10, a11)) + t1;
+            y2[r] = HSum(_mm512_add_ps(a20, a21)) + t2;
+            y3[r] = HSum(_mm512_add_ps(a30, a31)) + t3;
+        }
+    }
+    for (; v < num_vecs; ++v) {
+        MatVec(mat, num_rows, num_cols, &xs[v * num_cols],
+               &ys[v * ys_stride]);
+    }
+}
+
+TARGET_AVX512 float Sum(const float* x, size_t count) {
+    auto acc0 = _mm512_setzero_ps();
+    auto acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        acc0 = _mm512_add_ps(acc0, _mm512_loadu_ps(&x[i]));
+        acc1 = _mm512_add_ps(acc1, _mm512_loadu_ps(&x[i + 16]));
+    }
+    float tail = 0;
+    for (; i < count; ++i) {
+        tail += x[i];
+    }
+    return HSum(_mm512_add_ps(acc0, acc1)) + tail;
+}
+
+TARGET_AVX512 float SumSquaredGaps(const float* x, size_t count, float mean) {
+    auto mean_v = _mm512_set1_ps(mean);
+    auto acc0 = _mm512_setzero_ps();
+    auto acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        auto gap0 = _mm512_sub_ps(_mm512_loadu_ps(&x[i]), mean_v);
+        auto gap1 = _mm512_sub_ps(_mm512_loadu_ps(&x[i + 16]), mean_v);
+        acc0 = _mm512_fmadd_ps(gap0, gap0, acc0);
+        acc1 = _mm512_fmadd_ps(gap1, gap1, acc1);
+    }
+    float tail = 0;
+    for (; i < count; ++i) {
+        auto gap = x[i] - mean;
+        tail += gap * gap;
+    }
+    return HSum(_mm512_add_ps(acc0, acc1)) + tail;
+}
+
+TARGET_AVX512 void Standardize(float mean, float std, size_t count, float* x) {
+    auto mean_v = _mm512_set1_ps(mean);
+    auto std_v = _mm512_set1_ps(std);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        auto v = _mm512_sub_ps(_mm512_loadu_ps(&x[i]), mean_v);
+        _mm512_storeu_ps(&x[i], _mm512_div_ps(v, std_v));
+    }
+    for (; i < count; ++i) {
+        x[i] = (x[i] - mean) / std;
+    }
+}
+
+TARGET_AVX512 void Axpy(float alpha, const float* x, size_t count, float* y) {
+    auto alpha_v = _mm512_set1_ps(alpha);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        auto v = _mm512_fmadd_ps(alpha_v, _mm512_loadu_ps(&x[i]),
+                                 _mm512_loadu_ps(&y[i]));
+        _mm512_storeu_ps(&y[i], v);
+    }
+    for (; i < count; ++i) {
+        y[i] += alpha * x[i];
+    }
+}
+
+TARGET_AVX512 __m512i NoiseHash(__m512i x) {
+    x = _mm512_xor_si512(x, _mm512_srli_epi32(x, 16));
+    x = _mm512_mullo_epi32(x, _mm512_set1_epi32(static_cast<int>(NOISE_MUL_0)));
+    x = _mm512_xor_si512(x, _mm512_srli_epi32(x, 15));
+    x = _mm512_mullo_epi32(x, _mm512_set1_epi32(static_cast<int>(NOISE_MUL_1)));
+    return _mm512_xor_si512(x, _mm512_srli_epi32(x, 16));
+}
+
+TARGET_AVX512 void Bf16ToFloat(const uint16_t* x, size_t count, float* y) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        auto v = _mm512_cvtepu16_epi32(_mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(&x[i])));
+        _mm512_storeu_ps(&y[i], _mm512_castsi512_ps(_mm512_slli_epi32(v, 16)));
+    }
+    scalar::Bf16ToFloat(&x[i], count - i, &y[i]);
+}
+
+TARGET_AVX512 void RoundToBf16(const float* x, size_t count, uint32_t seed,
+                               uint16_t* y) {
+    auto step_v = _mm512_set1_epi32(static_cast<int>(NOISE_STEP * 16));
+    auto counter = _mm512_add_epi32(
+        _mm512_set1_epi32(static_cast<int>(seed)),
+        _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+                                             11, 12, 13, 14, 15),
+                           _mm512_set1_epi32(static_cast<int>(NOISE_STEP))));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        auto noise = _mm512_srli_epi32(NoiseHash(counter), 16);
+        auto bits = _mm512_castps_si512(_mm512_loadu_ps(&x[i]));
+        auto v = _mm512_srli_epi32(_mm512_add_epi32(bits, noise), 16);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&y[i]),
+                            _mm512_cvtepi32_epi16(v));
+        counter = _mm512_add_epi32(counter, step_v);
+    }
+    scalar::RoundToBf16(&x[i], count - i,
+                        seed + static_cast<uint32_t>(i) * NOISE_STEP, &y[i]);
+}
+
+TARGET_AVX512 void ScaleBytesToFloat(const uint8_t* x, size_t count,
+                                     float scale, float* y) {
+    auto scale_v = _mm512_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        auto v = _mm512_cvtepu8_epi32(_mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(&x[i])));
+        _mm512_storeu_ps(&y[i], _mm512_mul_ps(_mm512_cvtepi32_ps(v), scale_v));
+    }
+    avx2::ScaleBytesToFloat(&x[i], count - i, scale, &y[i]);
+}
+
+// Byte shuffles across 64 bytes need AVX-512BW, so this uses AVX2's.
+const KernelTable TABLE = {
+    Dot, MatVec, MatMat, Sum, SumSquaredGaps, Standardize, Axpy, Bf16ToFloat,
+    RoundToBf16, ScaleBytesToFloat, avx2::ByteSwap,
+};
+
+}  // namespace avx512
+
+// -----------------------------------------------------------------------------
+// Dispatch.
+
+const KernelTable* TableFor(Isa isa) {
+    switch (isa) {
+    case Isa::SCALAR:
+        return &scalar::TABLE;
+    case Isa::SSE42:
+        return &sse42::TABLE;
+    case Isa::AVX2:
+        return &avx2::TABLE;
+    case Isa::AVX512:
+        return &avx512::TABLE;
+    }
+    assert(false);
+    return nullptr;
+}
+
+// The active level and its kernels, picked on first use.
+struct Dispatch {
+    Isa isa;
+    const KernelTable* table;
+};
+
+Dispatch& GetDispatch() {
+    static Dispatch dispatch = {DetectIsa(), TableFor(DetectIsa())};
+    return dispatch;
+}
+
+inline const KernelTable& Table() {
+    return *GetDispatch().table;
+}
+
+// Bytes of matrix rows to keep in cache while sweeping them over each vector
+// in MatMat() (about half of a typical L2).
+const size_t MAT_MAT_BLOCK_BYTES = 128 * 1024;
+
+}  // namespace
+
+void SetIsa(Isa isa) {
+    assert(IsaSupported(isa));
+    auto& dispatch = GetDispatch();
+    dispatch.isa = isa;
+    dispatch.table = TableFor(isa);
+}
+
+Isa ActiveIsa() {
+    return GetDispatch().isa;
+}
+
+float Dot(const float* a, const float* b, size_t count) {
+    return Table().dot(a, b, count);
+}
+
+void MatVec(const float* mat, size_t num_rows, size_t num_cols, const float* x,
+            float* y) {
+    Table().mat_vec(mat, num_rows, num_cols, x, y);
+}
+
+void MatMat(const float* mat, size_t num_rows, size_t num_cols,
+            const float* xs, size_t num_vecs, float* ys, size_t ys_stride) {
+    auto& table = Table();
+    auto row_bytes = num_cols * sizeof(float);
+    size_t block_rows = row_bytes ? MAT_MAT_BLOCK_BYTES / row_bytes : num_rows;
+    block_rows = block_rows < 4 ? 4 : block_rows;
+    for (size_t begin = 0; begin < num_rows; begin += block_rows) {
+        auto count = num_rows - begin;
+        count = block_rows < count ? block_rows : count;
+        table.mat_mat(&mat[begin * num_cols], count, num_cols, xs, num_vecs,
+                      &ys[begin], ys_stride);
+    }
+}
+
+float Sum(const float* x, size_t count) {
+    return Table().sum(x, count);
+}
+
+float SumSquaredGaps(const float* x, size_t count, float mean) {
+    return Table().sum_squared_gaps(x, count, mean);
+}
+
+void Standardize(float mean, float std, size_t count, float* x) {
+    Table().standardize(mean, std, count, x);
+}
+
+void Axpy(float alpha, const float* x, size_t count, float* y) {
+    Table().axpy(alpha, x, count, y);
+}
+
+void Bf16ToFloat(const uint16_t* x, size_t count, float* y) {
+    Table().bf16_to_float(x, count, y);
+}
+
+void RoundToBf16(const float* x, size_t count, uint32_t seed, uint16_t* y) {
+    Table().round_to_bf16(x, count, seed, y);
+}
+
+void ScaleBytesToFloat(const uint8_t* x, size_t count, float scale,
+                       float* y) {
+    Table().scale_bytes_to_float(x, count, scale, y);
+}
+
+void ByteSwap(const void* x, size_t count, size_t width, void* y) {
+    Table().byte_swap(x, count, width, y);
+}
+
+}  // namespace simd
+}  // namespace base
+}  // namespace psyence
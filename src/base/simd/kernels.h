@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "base/simd/isa.h"
+
+namespace psyence {
+namespace base {
+namespace simd {
+
+// Dense float kernels, dispatched at runtime on the CPU's instruction set.
+//
+// Every level accumulates a given row in the same order no matter which
+// kernel it goes through, so eg MatVec() agrees bit for bit with calling Dot()
+// on each row.  Different levels do not agree bit for bit with each other.
+
+// Select the instruction set level used by the kernels.
+//
+// Defaults to DetectIsa().  The level must be supported.  Not thread-safe:
+// call it before starting any threads that use the kernels.
+void SetIsa(Isa isa);
+
+// Get the instruction set level used by the kernels.
+Isa ActiveIsa();
+
+// Dot product of two vectors.
+float Dot(const float* a, const float* b, size_t count);
+
+// Dense matrix times vector (y = mat * x).
+//
+// Shape: mat is num_rows * num_cols (row-major), x is num_cols, y is num_rows.
+void MatVec(const float* mat, size_t num_rows, size_t num_cols, const float* x,
+            float* y);
+
+// Dense matrix times several vectors (y_v = mat * x_v for each v).
+//
+// Cache-blocked by rows, so that each block of the matrix is read from memory
+// once for all the vectors, and register-blocked over vectors, so that each
+// load of a row feeds several of them.  Each row agrees bit for bit with Dot().
+//
+// Shape: mat is num_rows * num_cols (row-major), xs is num_vecs * num_cols, and
+// ys is num_vecs rows of num_rows with a stride of ys_stride (y_v[i] is
+// ys[v * ys_stride + i]).
+void MatMat(const float* mat, size_t num_rows, size_t num_cols,
+            const float* xs, size_t num_vecs, float* ys, size_t ys_stride);
+
+// Sum of the vector.
+float Sum(const float* x, size_t count);
+
+// Sum of squared differences from the given mean.
+float SumSquaredGaps(const float* x, size_t count, float mean);
+
+// Normalize in place (x = (x - mean) / std).
+void Standardize(float mean, float std, size_t count, float* x);
+
+// Scaled vector add in place (y += alpha * x).
+void Axpy(float alpha, const float* x, size_t count, float* y);
+
+// Widen bfloat16 values (the top 16 bits of floats) to floats.  Exact.
+void Bf16ToFloat(const uint16_t* x, size_t count, float* y);
+
+// Narrow floats to bfloat16 with stochastic rounding.
+//
+// Each value is rounded up or down to one of its two neighbors, with odds in
+// proportion to how close it is, so the rounding is unbiased and small
+// increments are kept on average instead of being rounded away.  The noise is
+// a hash of "seed" and the index in the call, so the result only depends on
+// those and is the same on every level.  Values must be finite.
+void RoundToBf16(const float* x, size_t count, uint32_t seed, uint16_t* y);
+
+// Widen bytes to floats times a scale (y = x * scale), eg pixels to [0, 1]
+// with a scale of 1 / 255.  Exact up to the one multiply, so it is the same on
+// every level.
+void ScaleBytesToFloat(const uint8_t* x, size_t count, float scale, float* y);
+
+// Reverse the bytes of each of "count" values of "width" bytes (1, 2, 4 or 8),
+// eg big-endian to little-endian.  "x" and "y" may be the same.
+void ByteSwap(const void* x, size_t count, size_t width, void* y);
+
+}  // namespace simd
+}  // namespace base
+}  // namespace psyence
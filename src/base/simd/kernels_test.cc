@@ -0,0 +1,209 @@
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "base/floats.h"
+#include "base/simd/isa.h"
+#include "base/simd/kernels.h"
+
+using psyence::base::floats::FloatEqual;
+using psyence::base::simd::Axpy;
+using psyence::base::simd::Bf16ToFloat;
+using psyence::base::simd::ByteSwap;
+using psyence::base::simd::Dot;
+using psyence::base::simd::Isa;
+using psyence::base::simd::IsaSupported;
+using psyence::base::simd::MatMat;
+using psyence::base::simd::MatVec;
+using psyence::base::simd::RoundToBf16;
+using psyence::base::simd::ScaleBytesToFloat;
+using psyence::base::simd::SetIsa;
+using psyence::base::simd::Standardize;
+using psyence::base::simd::Sum;
+using psyence::base::simd::SumSquaredGaps;
+using std::vector;
+
+namespace {
+
+void RandomFill(size_t count, float* x) {
+    for (size_t i = 0; i < count; ++i) {
+        auto f = static_cast<float>(rand()) / RAND_MAX;
+        x[i] = f * 2 - 1;
+    }
+}
+
+// Round to bfloat16 with the scalar reference, to compare the levels against.
+vector<uint16_t> ScalarBf16(const vector<float>& x, uint32_t seed) {
+    SetIsa(Isa::SCALAR);
+    vector<uint16_t> y(x.size());
+    RoundToBf16(x.data(), x.size(), seed, y.data());
+    return y;
+}
+
+void TestBf16(Isa isa) {
+    // Stochastic rounding picks one of the two neighbors, the same way on every
+    // level, and is unbiased on average.
+    size_t count = 1003;
+    vector<float> x(count);
+    RandomFill(count, x.data());
+    auto want = ScalarBf16(x, 7);
+    SetIsa(isa);
+    vector<uint16_t> y(count);
+    RoundToBf16(x.data(), count, 7, y.data());
+    assert(y == want);
+
+    vector<float> z(count);
+    Bf16ToFloat(y.data(), count, z.data());
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t bits;
+        memcpy(&bits, &x[i], sizeof(bits));
+        uint32_t z_bits;
+        memcpy(&z_bits, &z[i], sizeof(z_bits));
+        assert(z_bits == (bits & 0xFFFF0000u) ||
+               z_bits == (bits & 0xFFFF0000u) + 0x10000u);
+    }
+
+    // An increment far below bfloat16's resolution survives on average.
+    vector<float> ones(count, 1 + 1.0f / 1024);
+    RoundToBf16(ones.data(), count, 11, y.data());
+    Bf16ToFloat(y.data(), count, z.data());
+    double mean = 0;
+    for (auto& f : z) {
+        mean += f;
+    }
+    mean /= count;
+    assert(fabs(mean - (1 + 1.0 / 1024)) < 1.0 / 2048);
+}
+
+void TestIsa(Isa isa) {
+    SetIsa(isa);
+
+    // Odd sizes, to exercise the scalar tails.
+    vector<size_t> counts = {0, 1, 7, 16, 33, 100, 1000};
+    for (auto& count : counts) {
+        vector<float> a(count);
+        vector<float> b(count);
+        RandomFill(count, a.data());
+        RandomFill(count, b.data());
+        double dot = 0;
+        double sum = 0;
+        double gaps = 0;
+        for (size_t i = 0; i < count; ++i) {
+            dot += a[i] * b[i];
+            sum += a[i];
+            gaps += (a[i] - 0.25) * (a[i] - 0.25);
+        }
+        auto eps = 1e-3f;
+        assert(FloatEqual(Dot(a.data(), b.data(), count),
+                          static_cast<float>(dot), eps));
+        assert(FloatEqual(Sum(a.data(), count), static_cast<float>(sum), eps));
+        assert(FloatEqual(SumSquaredGaps(a.data(), count, 0.25f),
+                          static_cast<float>(gaps), eps));
+
+        auto c = b;
+        Axpy(0.5f, a.data(), count, c.data());
+        for (size_t i = 0; i < count; ++i) {
+            assert(FloatEqual(c[i], b[i] + 0.5f * a[i], 1e-6f));
+        }
+
+        c = b;
+        Standardize(0.25f, 2, count, c.data());
+        for (size_t i = 0; i < count; ++i) {
+            assert(FloatEqual(c[i], (b[i] - 0.25f) / 2, 1e-6f));
+        }
+    }
+
+    // MatVec must agree bit for bit with per-row Dot.
+    size_t num_rows = 37;
+    for (auto& num_cols : counts) {
+        vector<float> mat(num_rows * num_cols);
+        vector<float> x(num_cols);
+        vector<float> y(num_rows);
+        RandomFill(mat.size(), mat.data());
+        RandomFill(x.size(), x.data());
+        MatVec(mat.data(), num_rows, num_cols, x.data(), y.data());
+        for (size_t i = 0; i < num_rows; ++i) {
+            auto want = Dot(&mat[i * num_cols], x.data(), num_cols);
+            assert(!memcmp(&y[i], &want, sizeof(float)));
+        }
+    }
+
+    // So must MatMat, with enough rows to span several cache blocks and
+    // enough vectors for a register block and a remainder.
+    num_rows = 1003;
+    size_t num_cols = 100;
+    size_t num_vecs = 6;
+    size_t ys_stride = num_rows + 5;
+    vector<float> mat(num_rows * num_cols);
+    vector<float> xs(num_vecs * num_cols);
+    vector<float> ys(num_vecs * ys_stride);
+    RandomFill(mat.size(), mat.data());
+    RandomFill(xs.size(), xs.data());
+    MatMat(mat.data(), num_rows, num_cols, xs.data(), num_vecs, ys.data(),
+           ys_stride);
+    for (size_t v = 0; v < num_vecs; ++v) {
+        for (size_t i = 0; i < num_rows; ++i) {
+            auto want = Dot(&mat[i * num_cols], &xs[v * num_cols], num_cols);
+            assert(!memcmp(&ys[v * ys_stride + i], &want, sizeof(float)));
+        }
+    }
+}
+
+// Widening bytes is exactly one multiply per value on every level, for tails
+// of every length.
+void TestScaleBytesToFloat(Isa isa) {
+    SetIsa(isa);
+    for (size_t count : {size_t(0), size_t(5), size_t(16), size_t(8 + 7),
+                         size_t(256 + 33)}) {
+        vector<uint8_t> x(count);
+        for (size_t i = 0; i < count; ++i) {
+            x[i] = static_cast<uint8_t>(i * 37);
+        }
+        vector<float> y(count);
+        auto scale = 1 / 255.0f;
+        ScaleBytesToFloat(x.data(), count, scale, y.data());
+        for (size_t i = 0; i < count; ++i) {
+            auto want = static_cast<float>(x[i]) * scale;
+            assert(!memcmp(&y[i], &want, sizeof(want)));
+        }
+    }
+}
+
+// Byte swapping reverses each value, for all widths and for tails of every
+// length, in place or not.
+void TestByteSwap(Isa isa) {
+    SetIsa(isa);
+    for (size_t width : {size_t(1), size_t(2), size_t(4), size_t(8)}) {
+        for (size_t count : {size_t(0), size_t(1), size_t(7), size_t(33)}) {
+            vector<uint8_t> x(count * width);
+            for (auto& byte : x) {
+                byte = static_cast<uint8_t>(rand());
+            }
+            vector<uint8_t> y(x.size());
+            ByteSwap(x.data(), count, width, y.data());
+            for (size_t i = 0; i < count; ++i) {
+                for (size_t j = 0; j < width; ++j) {
+                    assert(y[i * width + j] == x[i * width + width - 1 - j]);
+                }
+            }
+            ByteSwap(y.data(), count, width, y.data());
+            assert(x == y);
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    vector<Isa> isas = {Isa::SCALAR, Isa::SSE42, Isa::AVX2, Isa::AVX512};
+    for (auto& isa : isas) {
+        if (IsaSupported(isa)) {
+            TestIsa(isa);
+            TestBf16(isa);
+            TestScaleBytesToFloat(isa);
+            TestByteSwap(isa);
+        }
+    }
+}
@@ -0,0 +1,264 @@
+#include "histogram.h"
+
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+using std::vector;
+
+namespace psyence {
+namespace base {
+namespace stats {
+
+namespace {
+
+// Serialized form: a header, then (bucket index, count) pairs of the non-empty
+// buckets.
+struct HistogramHeader {
+    uint64_t magic;
+    uint64_t sub_bucket_bits;
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t num_entries;
+};
+
+// "PSYHIST1", little-endian.
+const uint64_t HISTOGRAM_MAGIC = 0x3154534948595350ULL;
+
+}  // namespace
+
+uint64_t Histogram::min() const {
+    return count() ? Load(min_) : 0;
+}
+
+double Histogram::mean() const {
+    auto n = count();
+    if (!n) {
+        return 0;
+    }
+    return static_cast<double>(sum()) / static_cast<double>(n);
+}
+
+void Histogram::Free() {
+    if (counts_) {
+        delete [] counts_;
+        counts_ = nullptr;
+    }
+}
+
+Histogram::~Histogram() {
+    Free();
+}
+
+void Histogram::Init(size_t sub_bucket_bits) {
+    Free();
+    assert(sub_bucket_bits < 32);
+    sub_bucket_bits_ = sub_bucket_bits;
+    num_buckets_ = (65 - sub_bucket_bits) << sub_bucket_bits;
+    counts_ = new atomic<uint64_t>[num_buckets_];
+    Reset();
+}
+
+void Histogram::Reset() {
+    for (size_t i = 0; i < num_buckets_; ++i) {
+        Store(0, &counts_[i]);
+    }
+    Store(0, &count_);
+    Store(0, &sum_);
+    Store(UINT64_MAX, &min_);
+    Store(0, &max_);
+}
+
+size_t Histogram::BucketIndex(uint64_t value) const {
+    if (value >> sub_bucket_bits_ == 0) {
+        return value;
+    }
+    auto exponent = static_cast<size_t>(63 - __builtin_clzll(value));
+    auto shift = exponent - sub_bucket_bits_;
+    auto mask = (uint64_t(1) << sub_bucket_bits_) - 1;
+    auto sub_bucket = (value >> shift) & mask;
+    return ((shift + 1) << sub_bucket_bits_) + sub_bucket;
+}
+
+uint64_t Histogram::BucketLow(size_t index) const {
+    auto shift = index >> sub_bucket_bits_;
+    if (!shift) {
+        return index;
+    }
+    auto sub_bucket = index & ((size_t(1) << sub_bucket_bits_) - 1);
+    return ((uint64_t(1) << sub_bucket_bits_) + sub_bucket) << (shift - 1);
+}
+
+uint64_t Histogram::BucketWidth(size_t index) const {
+    auto shift = index >> sub_bucket_bits_;
+    if (!shift) {
+        return 1;
+    }
+    return uint64_t(1) << (shift - 1);
+}
+
+void Histogram::RecordCount(uint64_t value, uint64_t count) {
+    auto& bucket = counts_[BucketIndex(value)];
+    Store(Load(bucket) + count, &bucket);
+    Store(Load(count_) + count, &count_);
+    Store(Load(sum_) + value * count, &sum_);
+    if (value < Load(min_)) {
+        Store(value, &min_);
+    }
+    if (Load(max_) < value) {
+        Store(value, &max_);
+    }
+}
+
+void Histogram::Merge(const Histogram& other) {
+    assert(other.sub_bucket_bits_ == sub_bucket_bits_);
+
+    // Count what the buckets say, which may be ahead of the other's count_ if
+    // it is being written.
+    uint64_t count = 0;
+    for (size_t i = 0; i < num_buckets_; ++i) {
+        auto n = Load(other.counts_[i]);
+        if (n) {
+            Store(Load(counts_[i]) + n, &counts_[i]);
+            count += n;
+        }
+    }
+    if (!count) {
+        return;
+    }
+    Store(Load(count_) + count, &count_);
+    Store(Load(sum_) + other.sum(), &sum_);
+    if (Load(other.min_) < Load(min_)) {
+        Store(Load(other.min_), &min_);
+    }
+    if (Load(max_) < other.max()) {
+        Store(other.max(), &max_);
+    }
+}
+
+uint64_t Histogram::Percentile(double pct) const {
+    // Rank by the buckets' own total, as the count may lag them.
+    uint64_t total = 0;
+    for (size_t i = 0; i < num_buckets_; ++i) {
+        total += Load(counts_[i]);
+    }
+    if (!total) {
+        return 0;
+    }
+    auto lowest = min();
+    auto highest = max();
+    auto rank = static_cast<uint64_t>(pct / 100 * static_cast<double>(total));
+    if (!rank) {
+        return lowest;
+    }
+    if (total <= rank + 1) {
+        return highest;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < num_buckets_; ++i) {
+        seen += Load(counts_[i]);
+        if (rank < seen) {
+            auto middle = BucketLow(i) + BucketWidth(i) / 2;
+            if (middle < lowest) {
+                return lowest;
+            }
+            return middle < highest ? middle : highest;
+        }
+    }
+    return highest;
+}
+
+void Histogram::Serialize(string* bytes) const {
+    vector<uint64_t> entries;
+    for (size_t i = 0; i < num_buckets_; ++i) {
+        auto n = Load(counts_[i]);
+        if (n) {
+            entries.push_back(i);
+            entries.push_back(n);
+        }
+    }
+
+    HistogramHeader header;
+    header.magic = HISTOGRAM_MAGIC;
+    header.sub_bucket_bits = sub_bucket_bits_;
+    header.count = count();
+    header.sum = sum();
+    header.min = Load(min_);
+    header.max = max();
+    header.num_entries = entries.size() / 2;
+
+    auto entries_size = entries.size() * sizeof(uint64_t);
+    bytes->resize(sizeof(header) + entries_size);
+    memcpy(&(*bytes)[0], &header, sizeof(header));
+    if (entries_size) {
+        memcpy(&(*bytes)[sizeof(header)], entries.data(), entries_size);
+    }
+}
+
+bool Histogram::Deserialize(const string& bytes) {
+    HistogramHeader header;
+    if (bytes.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, bytes.data(), sizeof(header));
+    if (header.magic != HISTOGRAM_MAGIC ||
+            header.sub_bucket_bits != sub_bucket_bits_ ||
+            header.num_entries > num_buckets_ ||
+            bytes.size() != sizeof(header) +
+                            header.num_entries * 2 * sizeof(uint64_t)) {
+        return false;
+    }
+    vector<uint64_t> entries(2 * header.num_entries);
+    if (!entries.empty()) {
+        memcpy(entries.data(), &bytes[sizeof(header)],
+               entries.size() * sizeof(uint64_t));
+    }
+    for (size_t i = 0; i < header.num_entries; ++i) {
+        if (num_buckets_ <= entries[2 * i]) {
+            return false;
+        }
+    }
+
+    Reset();
+    for (size_t i = 0; i < header.num_entries; ++i) {
+        Store(entries[2 * i + 1], &counts_[entries[2 * i]]);
+    }
+    Store(header.count, &count_);
+    Store(header.sum, &sum_);
+    Store(header.min, &min_);
+    Store(header.max, &max_);
+    return true;
+}
+
+ShardedHistogram::~ShardedHistogram() {
+    Free();
+}
+
+void ShardedHistogram::Free() {
+    if (shards_) {
+        delete [] shards_;
+        shards_ = nullptr;
+    }
+}
+
+void ShardedHistogram::Init(size_t num_shards, size_t sub_bucket_bits) {
+    Free();
+    num_shards_ = num_shards;
+    shards_ = new Histogram[num_shards];
+    for (size_t i = 0; i < num_shards; ++i) {
+        shards_[i].Init(sub_bucket_bits);
+    }
+}
+
+void ShardedHistogram::MergeTo(Histogram* out) const {
+    out->Reset();
+    for (size_t i = 0; i < num_shards_; ++i) {
+        out->Merge(shards_[i]);
+    }
+}
+
+}  // namespace stats
+}  // namespace base
+}  // namespace psyence
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using std::atomic;
+using std::string;
+
+namespace psyence {
+namespace base {
+namespace stats {
+
+// Fixed-memory histogram of unsigned values in log-spaced buckets, for
+// percentiles of hot-path latencies (HDR-style).
+//
+// Values below 2^sub_bucket_bits get a bucket each, and each power of two
+// range above that is split into 2^sub_bucket_bits equal buckets, so
+// percentiles are within 2^-(sub_bucket_bits + 1) of the true value across the
+// whole 64-bit range.  Recording is O(1): a count of leading zeros, a shift
+// and an add.
+//
+// Units are up to the caller: NanoClock() or ClockCycles() deltas both work
+// (see RecordDelta()).
+//
+// One thread records (and merges into) a histogram, and any thread may read
+// it meanwhile: the fields are relaxed atomics, which the writer updates with
+// plain loads and stores, so it costs the same as unsynchronized counters.
+// Readers see each field as of some recent moment, not all of them at once.
+// For many recording threads, give each its own shard (see ShardedHistogram).
+class alignas(64) Histogram {
+  public:
+    // Precision used when none is given (values within 1/256).
+    static const size_t DEFAULT_SUB_BUCKET_BITS = 7;
+
+    // Accessors.
+    size_t sub_bucket_bits() const { return sub_bucket_bits_; }
+    size_t num_buckets() const { return num_buckets_; }
+    uint64_t count() const { return Load(count_); }
+    uint64_t sum() const { return Load(sum_); }
+    uint64_t max() const { return Load(max_); }
+
+    // Smallest value recorded (0 if none).
+    uint64_t min() const;
+
+    // Average value recorded (0 if none).
+    double mean() const;
+
+    // Free memory.
+    ~Histogram();
+
+    // Setup: allocate the buckets, all empty.
+    void Init(size_t sub_bucket_bits = DEFAULT_SUB_BUCKET_BITS);
+
+    // Empty the buckets.  Writer only.
+    void Reset();
+
+    // Count a value.  Writer only.
+    void Record(uint64_t value) { RecordCount(value, 1); }
+
+    // Count a value "count" times.  Writer only.
+    void RecordCount(uint64_t value, uint64_t count);
+
+    // Count the time between two NanoClock() or ClockCycles() readings (0 if
+    // the clock went backwards).  Writer only.
+    void RecordDelta(int64_t begin, int64_t end) {
+        Record(begin < end ? static_cast<uint64_t>(end - begin) : 0);
+    }
+    void RecordDelta(uint64_t begin, uint64_t end) {
+        Record(begin < end ? end - begin : 0);
+    }
+
+    // Add another histogram of the same precision into this one.  Writer only
+    // (the other may be being written).
+    void Merge(const Histogram& other);
+
+    // Value that "pct" percent of those recorded are at or below: the middle
+    // of its bucket, kept within [min, max], or exactly the min or max for the
+    // lowest and highest ranks.  0 if none.
+    uint64_t Percentile(double pct) const;
+
+    // Bucket of a value, and the lowest value and number of values in a
+    // bucket.
+    size_t BucketIndex(uint64_t value) const;
+    uint64_t BucketLow(size_t index) const;
+    uint64_t BucketWidth(size_t index) const;
+
+    // Serialize to bytes (only the non-empty buckets), and restore from them.
+    //
+    // Deserialize() returns false, changing nothing, if the bytes are not a
+    // histogram of this precision.
+    void Serialize(string* bytes) const;
+    bool Deserialize(const string& bytes);
+
+  private:
+    // Free memory.
+    void Free();
+
+    // Relaxed atomic access.
+    static uint64_t Load(const atomic<uint64_t>& x) {
+        return x.load(std::memory_order_relaxed);
+    }
+    static void Store(uint64_t value, atomic<uint64_t>* x) {
+        x->store(value, std::memory_order_relaxed);
+    }
+
+    // Shape.
+    size_t sub_bucket_bits_{0};
+    size_t num_buckets_{0};
+
+    // Summary of the values.
+    atomic<uint64_t> count_{0};
+    atomic<uint64_t> sum_{0};
+    atomic<uint64_t> min_{UINT64_MAX};
+    atomic<uint64_t> max_{0};
+
+    // Count per bucket.
+    atomic<uint64_t>* counts_{nullptr};
+};
+
+// A histogram per recording thread, merged when read.
+//
+// Each thread records into its own shard without any synchronization with the
+// others, and readers merge them all on demand.  Shards are cache line
+// aligned, so they don't share lines.
+class ShardedHistogram {
+  public:
+    // Accessors.
+    size_t num_shards() const { return num_shards_; }
+
+    // Free memory.
+    ~ShardedHistogram();
+
+    // Setup.
+    void Init(size_t num_shards,
+              size_t sub_bucket_bits = Histogram::DEFAULT_SUB_BUCKET_BITS);
+
+    // The shard of a thread (eg, a ThreadPool thread index).
+    Histogram* shard(size_t index) { return &shards_[index]; }
+
+    // Merge all the shards into "out" (which gets emptied first).  From any
+    // thread; "out" must have the same precision.
+    void MergeTo(Histogram* out) const;
+
+  private:
+    // Free memory.
+    void Free();
+
+    size_t num_shards_{0};
+    Histogram* shards_{nullptr};
+};
+
+}  // namespace stats
+}  // namespace base
+}  // namespace psyence
@@ -0,0 +1,142 @@
+#include <cassert>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/cxx.h"
+#include "base/stats/histogram.h"
+#include "base/time/clock.h"
+#include "base/time/cycle.h"
+
+using psyence::base::stats::Histogram;
+using psyence::base::stats::ShardedHistogram;
+using psyence::base::time::clock::NanoClock;
+using psyence::base::time::cycle::ClockCycles;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Whether "got" is within "rel" of "want".
+bool Near(double got, double want, double rel) {
+    auto slack = want * rel + 1;
+    return want - slack <= got && got <= want + slack;
+}
+
+}  // namespace
+
+int main() {
+    // Buckets tile the whole range, each value landing in its own.
+    for (size_t bits : {size_t(0), size_t(3), size_t(7)}) {
+        Histogram histogram;
+        histogram.Init(bits);
+        for (size_t i = 0; i + 1 < histogram.num_buckets(); ++i) {
+            auto next = histogram.BucketLow(i) + histogram.BucketWidth(i);
+            assert(next == histogram.BucketLow(i + 1));
+            assert(histogram.BucketIndex(histogram.BucketLow(i)) == i);
+            assert(histogram.BucketIndex(next - 1) == i);
+        }
+        assert(histogram.BucketIndex(UINT64_MAX) + 1 ==
+               histogram.num_buckets());
+    }
+
+    // Percentiles are within the precision, at every scale.
+    for (uint64_t scale : {uint64_t(1), uint64_t(1000), uint64_t(1) << 30}) {
+        Histogram histogram;
+        histogram.Init(7);
+        for (uint64_t i = 1; i <= 10000; ++i) {
+            histogram.Record(i * scale);
+        }
+        assert(histogram.count() == 10000);
+        assert(histogram.min() == scale);
+        assert(histogram.max() == 10000 * scale);
+        assert(Near(histogram.mean(), 5000.5 * static_cast<double>(scale),
+                    1e-9));
+        for (double pct : {1.0, 50.0, 90.0, 99.0, 99.9}) {
+            auto want = (pct * 100 + 1) * static_cast<double>(scale);
+            auto got = static_cast<double>(histogram.Percentile(pct));
+            assert(Near(got, want, 1.0 / 256));
+        }
+        assert(histogram.Percentile(0) == scale);
+        assert(histogram.Percentile(100) == 10000 * scale);
+    }
+
+    // Empty, and reset.
+    Histogram empty;
+    empty.Init();
+    assert(!empty.count() && !empty.min() && !empty.Percentile(50));
+    empty.RecordCount(5, 3);
+    assert(empty.count() == 3 && empty.sum() == 15 && empty.min() == 5);
+    empty.Reset();
+    assert(!empty.count() && !empty.max());
+
+    // Clock deltas, which count 0 if the clock goes backwards.
+    Histogram clock;
+    clock.Init();
+    auto t0 = NanoClock();
+    auto c0 = ClockCycles();
+    clock.RecordDelta(t0, NanoClock());
+    clock.RecordDelta(c0, ClockCycles());
+    clock.RecordDelta(int64_t(10), int64_t(5));
+    clock.RecordDelta(uint64_t(10), uint64_t(5));
+    assert(clock.count() == 4 && !clock.min());
+
+    // Serialization brings back the same histogram, and only one of the same
+    // precision.
+    Histogram a;
+    a.Init(5);
+    for (uint64_t i = 0; i < 1000; ++i) {
+        a.Record(i * i);
+    }
+    string bytes;
+    a.Serialize(&bytes);
+    Histogram b;
+    b.Init(5);
+    auto ok = b.Deserialize(bytes);
+    assert(ok);
+    UNUSED(ok);
+    assert(b.count() == a.count() && b.sum() == a.sum());
+    assert(b.min() == a.min() && b.max() == a.max());
+    for (double pct : {10.0, 50.0, 99.0}) {
+        assert(b.Percentile(pct) == a.Percentile(pct));
+    }
+    Histogram other_precision;
+    other_precision.Init(6);
+    ok = other_precision.Deserialize(bytes);
+    assert(!ok);
+    ok = b.Deserialize(bytes.substr(0, bytes.size() - 1));
+    assert(!ok);
+
+    // Shards recorded on their own threads merge into the same histogram as
+    // recording everything in one, including while they are being written.
+    size_t num_threads = 4;
+    ShardedHistogram sharded;
+    sharded.Init(num_threads);
+    vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&sharded, t]() {
+            auto shard = sharded.shard(t);
+            for (uint64_t i = 0; i < 100000; ++i) {
+                shard->Record(t * 100000 + i);
+            }
+        });
+    }
+    Histogram merged;
+    merged.Init();
+    sharded.MergeTo(&merged);
+    assert(merged.count() <= num_threads * 100000);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    sharded.MergeTo(&merged);
+    Histogram single;
+    single.Init();
+    for (uint64_t i = 0; i < num_threads * 100000; ++i) {
+        single.Record(i);
+    }
+    assert(merged.count() == single.count() && merged.sum() == single.sum());
+    assert(merged.min() == 0 && merged.max() == single.max());
+    for (double pct : {1.0, 50.0, 99.0, 99.99}) {
+        assert(merged.Percentile(pct) == single.Percentile(pct));
+    }
+}
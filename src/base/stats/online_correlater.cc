@@ -2,17 +2,48 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
 
+#include "base/simd/kernels.h"
 #include "base/stats/summary.h"
 #include "base/momentum.h"
 
 using psyence::base::momentum::MomUpdate;
+using psyence::base::simd::Axpy;
 using std::isfinite;
+using std::string;
+using std::vector;
 
 namespace psyence {
 namespace base {
 namespace stats {
 
+namespace {
+
+// When scaled, the scale is folded into the storage once it drops below this.
+//
+// The stored values grow as one over the scale, so this keeps them well within
+// float range.
+const float MIN_SCALE = 1e-12f;
+
+// What a checkpoint records of a correlater besides its arrays.
+struct CorrelaterMeta {
+    uint64_t num_variables;
+    uint32_t packed;
+    uint32_t scaled;
+    float scale;
+    uint32_t reserved;
+};
+
+// Tiles of UpdateRows(): rows per tile, and columns per tile (whose gaps and
+// inverse stds take 16 KB, half of a typical L1).
+const size_t ROW_TILE = 16;
+const size_t COL_TILE = 2048;
+
+}  // namespace
+
 void OnlineCorrelater::Free() {
     if (means_) {
         delete [] means_;
@@ -26,23 +57,142 @@ void OnlineCorrelater::Free() {
     if (cor_) {
         delete [] cor_;
     }
+    if (gaps_) {
+        delete [] gaps_;
+        gaps_ = nullptr;
+    }
+    if (inv_stds_) {
+        delete [] inv_stds_;
+        inv_stds_ = nullptr;
+    }
+    if (batch_gaps_) {
+        delete [] batch_gaps_;
+        batch_gaps_ = nullptr;
+    }
+    batch_capacity_ = 0;
 }
 
 OnlineCorrelater::~OnlineCorrelater() {
     Free();
 }
 
-void OnlineCorrelater::Init(size_t num_variables, float momentum) {
+size_t OnlineCorrelater::num_pairs() const {
+    auto n = num_variables_;
+    return packed_ ? n * (n + 1) / 2 : n * n;
+}
+
+size_t OnlineCorrelater::RowOffset(size_t i) const {
+    auto n = num_variables_;
+    return packed_ ? i * (2 * n - i + 1) / 2 : i * n + i;
+}
+
+float OnlineCorrelater::CovAt(size_t i, size_t j) const {
+    if (packed_ && j < i) {
+        return scale_ * cov_[RowOffset(j) + i - j];
+    }
+    return scale_ * cov_[RowOffset(i) + j - i];
+}
+
+float OnlineCorrelater::CorAt(size_t i, size_t j) const {
+    if (packed_ && j < i) {
+        return scale_ * cor_[RowOffset(j) + i - j];
+    }
+    return scale_ * cor_[RowOffset(i) + j - i];
+}
+
+void OnlineCorrelater::AddCorRow(size_t i, float alpha, float* y) const {
+    AddCorRows(i, i + 1, alpha, y, num_variables_);
+}
+
+void OnlineCorrelater::AddCorRows(size_t begin, size_t end, float alpha,
+                                  float* ys, size_t ys_stride) const {
+    auto n = num_variables_;
+    alpha *= scale_;
+    if (!packed_) {
+        for (auto i = begin; i < end; ++i) {
+            Axpy(alpha, &cor_[i * n], n, &ys[(i - begin) * ys_stride]);
+        }
+        return;
+    }
+
+    // Unpack the rows first, then add them with the same Axpy() over the same
+    // columns as above, so every value rounds the same as unpacked.  The left
+    // of row i is column i of the rows j < i.  Row j holds the columns of all
+    // the rows from j + 1 on side by side, so scatter them.
+    vector<float> rows((end - begin) * n);
+    for (size_t j = 0; j + 1 < end; ++j) {
+        auto first = j < begin ? begin : j + 1;
+        auto span = &cor_[RowOffset(j) - j];
+        for (auto i = first; i < end; ++i) {
+            rows[(i - begin) * n + j] = span[i];
+        }
+    }
+    for (auto i = begin; i < end; ++i) {
+        auto row = &rows[(i - begin) * n];
+        memcpy(&row[i], &cor_[RowOffset(i)], (n - i) * sizeof(float));
+        Axpy(alpha, row, n, &ys[(i - begin) * ys_stride]);
+    }
+}
+
+void OnlineCorrelater::UnpackCor(float* out) const {
+    auto n = num_variables_;
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+            out[i * n + j] = CorAt(i, j);
+        }
+    }
+}
+
+size_t OnlineCorrelater::PartBegin(size_t part_index, size_t num_parts) const {
+    auto n = num_variables_;
+    if (!packed_ || part_index == 0 || part_index >= num_parts) {
+        return n * part_index / num_parts;
+    }
+
+    // Rows 0..i cover (2n - i + 1) * i / 2 pairs.  Find the first row where
+    // that reaches the fraction part_index / num_parts of all of them.
+    auto want = num_pairs() * part_index / num_parts;
+    size_t i = 0;
+    while (i < n && RowOffset(i) < want) {
+        ++i;
+    }
+    return i;
+}
+
+void OnlineCorrelater::Init(size_t num_variables, float momentum, bool packed,
+                            bool scaled) {
     Free();
     num_variables_ = num_variables;
     momentum_ = momentum;
+    packed_ = packed;
+    scaled_ = scaled;
+    scale_ = 1;
     means_ = new float[num_variables]();
     stds_ = new float[num_variables]();
     for (size_t i = 0; i < num_variables; ++i) {
         stds_[i] = 1;
     }
-    cov_ = new float[num_variables * num_variables]();
-    cor_ = new float[num_variables * num_variables]();
+    cov_ = new float[num_pairs()]();
+    cor_ = new float[num_pairs()]();
+    gaps_ = new float[num_variables];
+    inv_stds_ = new float[num_variables];
+    variables_ = nullptr;
+}
+
+void OnlineCorrelater::Materialize() {
+    assert(!variables_);
+    // The scale only ever decays from 1, so not below it means exactly 1.
+    if (!(scale_ < 1)) {
+        return;
+    }
+    auto count = num_pairs();
+    for (size_t i = 0; i < count; ++i) {
+        cov_[i] *= scale_;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        cor_[i] *= scale_;
+    }
+    scale_ = 1;
 }
 
 void OnlineCorrelater::Report(FILE* out) const {
@@ -65,38 +215,213 @@ void OnlineCorrelater::Report(FILE* out) const {
     x.InitFromData(num_variables_, stds_, 10);
     x.Report("stds", max_bar_len, out);
 
-    x.InitFromData(num_variables_ * num_variables_, cov_, 10);
+    auto count = num_pairs();
+    auto values = new float[count];
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = scale_ * cov_[i];
+    }
+    x.InitFromData(count, values, 10);
     x.Report("cov", max_bar_len, out);
 
-    x.InitFromData(num_variables_ * num_variables_, cor_, 10);
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = scale_ * cor_[i];
+    }
+    x.InitFromData(count, values, 10);
     x.Report("cor", max_bar_len, out);
+    delete [] values;
 
     printf("\n");
 }
 
-void OnlineCorrelater::Update(const float* variables) {
-    for (size_t i = 0; i < num_variables_; ++i) {
-        auto x_gap = variables[i] - means_[i];
-        for (size_t j = 0; j < num_variables_; ++j) {
-            auto y_gap = variables[j] - means_[j];
-            auto& cov = cov_[i * num_variables_ + j];
-            cov = MomUpdate(momentum_, cov, x_gap * y_gap / num_variables_);
-            auto& cor = cor_[i * num_variables_ + j];
-            auto std_i = stds_[i] + 1e-3f;
-            auto std_j = stds_[j] + 1e-3f;
-            auto sample_correl = cov / (std_i * std_j);
-            cor = MomUpdate(momentum_, cor, sample_correl);
+void OnlineCorrelater::AddToCheckpoint(const char* prefix,
+                                       CheckpointWriter* writer) const {
+    assert(!variables_);
+    CorrelaterMeta meta;
+    memset(&meta, 0, sizeof(meta));
+    meta.num_variables = num_variables_;
+    meta.packed = packed_;
+    meta.scaled = scaled_;
+    meta.scale = scale_;
+    string name = prefix;
+    writer->AddCopy((name + ".meta").c_str(), &meta, sizeof(meta));
+    auto n = num_variables_;
+    writer->Add((name + ".means").c_str(), means_, n * sizeof(float));
+    writer->Add((name + ".stds").c_str(), stds_, n * sizeof(float));
+    writer->Add((name + ".cov").c_str(), cov_, num_pairs() * sizeof(float));
+    writer->Add((name + ".cor").c_str(), cor_, num_pairs() * sizeof(float));
+}
+
+bool OnlineCorrelater::RestoreFromCheckpoint(const char* prefix,
+                                             const CheckpointReader& reader) {
+    assert(!variables_);
+    string name = prefix;
+    CorrelaterMeta meta;
+    if (!reader.CopyTo((name + ".meta").c_str(), sizeof(meta), &meta) ||
+            meta.num_variables != num_variables_ ||
+            meta.packed != packed_ || meta.scaled != scaled_) {
+        return false;
+    }
+
+    // Check every section before touching anything.
+    auto n = num_variables_;
+    const char* whats[] = {".means", ".stds", ".cov", ".cor"};
+    size_t sizes[] = {n, n, num_pairs(), num_pairs()};
+    float* outs[] = {means_, stds_, cov_, cor_};
+    for (size_t i = 0; i < 4; ++i) {
+        const void* data;
+        size_t size;
+        if (!reader.Get((name + whats[i]).c_str(), &data, &size) ||
+                size != sizes[i] * sizeof(float)) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        if (!reader.CopyTo((name + whats[i]).c_str(),
+                           sizes[i] * sizeof(float), outs[i])) {
+            return false;
+        }
+    }
+    scale_ = meta.scale;
+    return true;
+}
+
+void OnlineCorrelater::Update(const float* variables, size_t num_samples) {
+    BeginUpdate(variables, num_samples);
+    UpdateRows(0, num_variables_);
+    EndUpdate();
+}
+
+void OnlineCorrelater::BeginUpdate(const float* variables,
+                                   size_t num_samples) {
+    assert(!variables_);
+    assert(num_samples);
+    auto n = num_variables_;
+    if (1 < num_samples) {
+        if (batch_capacity_ < num_samples) {
+            if (batch_gaps_) {
+                delete [] batch_gaps_;
+            }
+            batch_gaps_ = new float[n * num_samples];
+            batch_capacity_ = num_samples;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t b = 0; b < num_samples; ++b) {
+                batch_gaps_[i * num_samples + b] =
+                    variables[b * n + i] - means_[i];
+            }
+        }
+    }
+    // The per-variable terms of every pair, once for the whole update.
+    for (size_t i = 0; i < n; ++i) {
+        inv_stds_[i] = 1 / (stds_[i] + 1e-3f);
+    }
+    if (num_samples == 1) {
+        for (size_t i = 0; i < n; ++i) {
+            gaps_[i] = variables[i] - means_[i];
+        }
+    }
+
+    decay_ = momentum_;
+    pair_increment_ = (1 - momentum_) / n / num_samples;
+    cor_increment_ = 1 - momentum_;
+    if (scaled_) {
+        if (scale_ < MIN_SCALE) {
+            Materialize();
+        }
+        scale_ *= momentum_;
+        decay_ = 1;
+        pair_increment_ /= scale_;
+    }
+    variables_ = variables;
+    num_samples_ = num_samples;
+}
+
+void OnlineCorrelater::UpdateRows(size_t begin, size_t end) {
+    assert(variables_);
+    assert(begin <= end && end <= num_variables_);
+
+    // Sweep the rows in tiles, so that each tile of the per-variable vectors
+    // stays in L1 across the rows of the tile while cov and cor stream by.
+    auto n = num_variables_;
+    for (size_t row_begin = begin; row_begin < end; row_begin += ROW_TILE) {
+        auto row_end = row_begin + ROW_TILE < end ? row_begin + ROW_TILE : end;
+        auto col_begin = packed_ ? row_begin : 0;
+        for (auto j0 = col_begin; j0 < n; j0 += COL_TILE) {
+            auto j1 = j0 + COL_TILE < n ? j0 + COL_TILE : n;
+            for (auto i = row_begin; i < row_end; ++i) {
+                auto first = packed_ && j0 < i ? i : j0;
+                if (first < j1) {
+                    UpdateRowSpan(i, first, j1);
+                }
+            }
+        }
+    }
+}
+
+void OnlineCorrelater::UpdateRowSpan(size_t i, size_t begin, size_t end) {
+    // cov = decay * cov + pair_increment * (pair term)
+    // cor = decay * cor + cor_increment * cov / (std_i * std_j)
+    //
+    // With the stds' inverses and the gaps computed once per update.  When
+    // scaled, the decay is in the scale instead, and it cancels out of the
+    // correlation term as cov and cor share it.
+    auto row = RowOffset(i) - i;
+    auto cov = &cov_[row];
+    auto cor = &cor_[row];
+    // The products of the per-variable terms go first, so that (i, j) and
+    // (j, i) get the same bits whether packed or not.
+    auto decay = decay_;
+    auto pair_increment = pair_increment_;
+    auto cor_increment = cor_increment_;
+    auto inv_stds = inv_stds_;
+    auto inv_i = inv_stds[i];
+    if (1 < num_samples_) {
+        auto num_samples = num_samples_;
+        auto x_gaps = &batch_gaps_[i * num_samples];
+        for (auto j = begin; j < end; ++j) {
+            auto y_gaps = &batch_gaps_[j * num_samples];
+            float sum = 0;
+            for (size_t b = 0; b < num_samples; ++b) {
+                sum += x_gaps[b] * y_gaps[b];
+            }
+            auto new_cov = decay * cov[j] + pair_increment * sum;
+            cov[j] = new_cov;
+            cor[j] = decay * cor[j] +
+                cor_increment * (inv_i * inv_stds[j]) * new_cov;
         }
+        return;
     }
-    for (size_t i = 0; i < num_variables_; ++i) {
-        auto& x = variables[i];
-        assert(isfinite(x));
+    auto gaps = gaps_;
+    auto gap_i = gaps[i];
+    for (auto j = begin; j < end; ++j) {
+        auto new_cov = decay * cov[j] + pair_increment * (gap_i * gaps[j]);
+        cov[j] = new_cov;
+        cor[j] = decay * cor[j] +
+            cor_increment * (inv_i * inv_stds[j]) * new_cov;
+    }
+}
+
+void OnlineCorrelater::EndUpdate() {
+    assert(variables_);
+    auto n = num_variables_;
+    for (size_t i = 0; i < n; ++i) {
         auto& mean = means_[i];
         auto& std = stds_[i];
-        auto sample_std = static_cast<float>(sqrt((mean - x) * (mean - x)));
+        float sum_x = 0;
+        float sum_std = 0;
+        for (size_t b = 0; b < num_samples_; ++b) {
+            auto& x = variables_[b * n + i];
+            assert(isfinite(x));
+            sum_x += x;
+            sum_std += static_cast<float>(sqrt((mean - x) * (mean - x)));
+        }
+        auto x = sum_x / num_samples_;
+        auto sample_std = sum_std / num_samples_;
         mean = MomUpdate(momentum_, mean, x);
         std = MomUpdate(momentum_, std, sample_std);
     }
+    variables_ = nullptr;
+    num_samples_ = 0;
 }
 
 }  // namespace stats
@@ -3,43 +3,165 @@
 #include <cstddef>
 #include <cstdio>
 
+#include "base/checkpoint.h"
+
+using psyence::base::checkpoint::CheckpointReader;
+using psyence::base::checkpoint::CheckpointWriter;
+
 namespace psyence {
 namespace base {
 namespace stats {
 
 // Online algorithm to correlate a list of variables.
+//
+// The covariance and correlation matrices are symmetric, so they can be kept
+// "packed": only the upper triangle (including the diagonal) is stored and
+// computed, row by row.  Row i then holds columns i..num_variables - 1.  This
+// halves their memory and FLOPs.  The values, and the rows AddCorRows() adds
+// from them, are bit-identical to the full matrices', scaled or not.
+//
+// They can also be kept "scaled": stored relative to a running scale factor,
+// so the momentum decay of every pair is one multiply of the scale, and each
+// update only adds its increments into memory.  The scale is folded back into
+// the storage whenever it gets small, to keep the stored floats in range.  This
+// rounds differently, so the values are only close to the unscaled ones.
+//
+// Several samples can be folded in at once as one update, with the mean of
+// their terms taking the place of a single sample's.  The pairwise terms are
+// gaps from the means before the update, as with one sample.
 class OnlineCorrelater {
   public:
     // Accessors.
+    //
+    // cov() and cor() are the raw storage: num_variables_ * num_variables_
+    // floats, or num_pairs() floats when packed (see RowOffset()).  The true
+    // values are the storage times scale(), which is always 1 when not scaled
+    // and right after Materialize().
     size_t num_variables() const { return num_variables_; }
     float momentum() const { return momentum_; }
+    bool packed() const { return packed_; }
+    bool scaled() const { return scaled_; }
+    float scale() const { return scale_; }
     const float* means() const { return means_; }
     const float* stds() const { return stds_; }
     const float* cov() const { return cov_; }
     const float* cor() const { return cor_; }
 
+    // Number of floats in each of cov() and cor().
+    size_t num_pairs() const;
+
+    // Offset into cov() and cor() of the element (i, i), where row i starts.
+    //
+    // The element (i, j) for j >= i is then at RowOffset(i) + j - i when
+    // packed, or i * num_variables_ + j when not.
+    size_t RowOffset(size_t i) const;
+
+    // Get the true element (i, j) of either matrix, whichever triangle it's in.
+    float CovAt(size_t i, size_t j) const;
+    float CorAt(size_t i, size_t j) const;
+
+    // Add alpha times row i of the full, true correlation matrix to "y" (shape:
+    // num_variables_), as Axpy() would.
+    void AddCorRow(size_t i, float alpha, float* y) const;
+
+    // Add alpha times rows [begin, end) of the full, true correlation matrix to
+    // the rows of "ys" (row i - begin at ys + (i - begin) * ys_stride).
+    //
+    // When packed, the left of each row is down a column of the rows above
+    // it, so the rows are done together: each row above is read once, its
+    // contiguous span over the columns [begin, end) scattered across them.
+    // Do a block of rows at a time (eg, a cache line's worth) to read the
+    // rows above in whole lines.  The rows are unpacked before they are
+    // added, so the sums are bit-identical to unpacked storage's.
+    void AddCorRows(size_t begin, size_t end, float alpha, float* ys,
+                    size_t ys_stride) const;
+
+    // Write the full, true correlation matrix to "out" (shape: num_variables_ *
+    // num_variables_).
+    void UnpackCor(float* out) const;
+
+    // The first row of part "part_index" when splitting the rows into
+    // "num_parts" contiguous parts of about equal work for UpdateRows().
+    //
+    // Rows get shorter as they go when packed, so the parts are not equal in
+    // number of rows.  Part num_parts ends at row num_variables_.
+    size_t PartBegin(size_t part_index, size_t num_parts) const;
+
     // Free memory.
     ~OnlineCorrelater();
 
     // Allocate space.
-    void Init(size_t num_variables, float momentum);
+    void Init(size_t num_variables, float momentum, bool packed = false,
+              bool scaled = false);
+
+    // Fold the scale into the storage, so that cov() and cor() hold the true
+    // values.  Not during an update.
+    void Materialize();
 
     // Dump statistics to file.
     void Report(FILE* out) const;
 
-    // Update statistics given one sample.
-    void Update(const float* variables);
+    // Add the statistics to a checkpoint, as sections named "<prefix>.<what>".
+    //
+    // The big sections point into the storage, which must not change until the
+    // checkpoint is saved.  Not during an update.
+    void AddToCheckpoint(const char* prefix, CheckpointWriter* writer) const;
+
+    // Restore statistics added to a checkpoint by AddToCheckpoint().
+    //
+    // They must come from a correlater with the same number of variables and
+    // storage (packed and scaled) as this one.  Returns false, changing
+    // nothing, if they don't or if any section is missing.  The momentum stays
+    // this one's.
+    bool RestoreFromCheckpoint(const char* prefix,
+                               const CheckpointReader& reader);
+
+    // Update statistics given one sample, or a batch of samples.
+    //
+    // Same as BeginUpdate(), UpdateRows() over every row, then EndUpdate().
+    void Update(const float* variables, size_t num_samples = 1);
+
+    // Update statistics given one sample (or a batch), in steps.
+    //
+    // The pairwise statistics are updated by ranges of rows so that callers can
+    // split the rows across threads.  Rows are independent of each other, so
+    // the results do not depend on how they are split.  The per-variable
+    // statistics are updated at the end, as they are read by every row.
+    //
+    // "variables" (shape: num_samples * num_variables_) must stay valid until
+    // EndUpdate().
+    void BeginUpdate(const float* variables, size_t num_samples = 1);
+    void UpdateRows(size_t begin, size_t end);
+    void EndUpdate();
 
   private:
     // Free memory.
     void Free();
 
+    // Update the pairs of row i from column "begin" to "end".
+    void UpdateRowSpan(size_t i, size_t begin, size_t end);
+
     // Number of variables.
     size_t num_variables_;
 
     // Momentum for updates.
     float momentum_;
 
+    // Whether only the upper triangle of cov_ and cor_ is stored.
+    bool packed_{false};
+
+    // Whether cov_ and cor_ are stored relative to scale_.
+    bool scaled_{false};
+
+    // What cov_ and cor_ are multiplied by to get their true values.
+    float scale_{1};
+
+    // Factors of the current update (see UpdateRowSpan()), with the momentum,
+    // scale and batch size folded in.
+    float decay_{0};
+    float pair_increment_{0};
+    float cor_increment_{0};
+
     // Moving statistics for each variable:
     // * Mean.
     // * Standard deviation.
@@ -52,9 +174,27 @@ class OnlineCorrelater {
     // * Covariance matrix.
     // * Pearson correlation coefficient.
     //
-    // Shape: num_variables_ * num_variables_.
+    // Shape: num_variables_ * num_variables_, or num_pairs() when packed.
     float* cov_{nullptr};
     float* cor_{nullptr};
+
+    // The sample being folded in, between BeginUpdate() and EndUpdate().
+    const float* variables_{nullptr};
+    size_t num_samples_{0};
+
+    // Each variable's gap from its mean, and the inverse of its std, in the
+    // current update.
+    //
+    // Shape: num_variables_.
+    float* gaps_{nullptr};
+    float* inv_stds_{nullptr};
+
+    // Each variable's gaps from its mean in each sample of a batch, so that a
+    // row reads its pairs' gaps contiguously.
+    //
+    // Shape: num_variables_ * num_samples_ (of batch_capacity_ samples).
+    float* batch_gaps_{nullptr};
+    size_t batch_capacity_{0};
 };
 
 }  // namespace stats
@@ -0,0 +1,109 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "base/simd/kernels.h"
+#include "base/stats/online_correlater.h"
+#include "base/thread/thread_pool.h"
+#include "base/time/clock.h"
+
+using psyence::base::simd::Axpy;
+using psyence::base::stats::OnlineCorrelater;
+using psyence::base::thread::ThreadPool;
+using psyence::base::time::clock::NanoClock;
+using std::vector;
+
+// Measures the memory bandwidth of OnlineCorrelater updates.
+//
+// Usage: online_correlater_bench [max_num_variables] [num_threads] [packed]
+//
+// For num_variables from 256 doubling up to max_num_variables, reports the
+// GB/s that updates stream through cov and cor (each read and written once per
+// update), against the peak of reading and writing that many bytes once each
+// (an in-place Axpy over a buffer the size of cov and cor together), so both
+// run from the same level of the memory hierarchy.
+
+namespace {
+
+// Seconds to spend timing each configuration, at the least.
+const double MIN_SECONDS = 0.5;
+
+// Runs "fn" repeatedly for MIN_SECONDS, and returns the mean seconds per run.
+template <typename Fn>
+double TimeIt(Fn fn) {
+    fn();
+    size_t num_runs = 0;
+    auto t0 = NanoClock();
+    auto t1 = t0;
+    do {
+        fn();
+        ++num_runs;
+        t1 = NanoClock();
+    } while (static_cast<double>(t1 - t0) / 1e9 < MIN_SECONDS);
+    return static_cast<double>(t1 - t0) / 1e9 / num_runs;
+}
+
+// GB/s of reading and writing "count" floats once each (y += 0 * y), split
+// across "pool".
+double PeakGBPerSec(ThreadPool* pool, size_t count) {
+    vector<float> y(count, 1);
+    auto seconds = TimeIt([&]() {
+        pool->ParallelFor(count, [&](size_t begin, size_t end) {
+            Axpy(0, &y[begin], end - begin, &y[begin]);
+        });
+    });
+    return 2.0 * sizeof(float) * count / seconds / 1e9;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    assert(argc <= 4);
+    size_t max_num_variables = 16384;
+    size_t num_threads = 1;
+    bool packed = false;
+    if (1 < argc) {
+        max_num_variables = strtoul(argv[1], nullptr, 10);
+    }
+    if (2 < argc) {
+        num_threads = strtoul(argv[2], nullptr, 10);
+    }
+    if (3 < argc) {
+        packed = atoi(argv[3]);
+    }
+
+    ThreadPool pool;
+    pool.Init(num_threads);
+
+    printf("num_threads %zu, packed %d\n\n", num_threads, packed);
+    printf("%8s %12s %10s %10s %8s\n", "n", "sec/update", "GB/s", "peak GB/s",
+           "of peak");
+    for (size_t n = 256; n <= max_num_variables; n *= 2) {
+        OnlineCorrelater stats;
+        stats.Init(n, 0.99f, packed);
+        vector<float> variables(n);
+        for (size_t i = 0; i < n; ++i) {
+            variables[i] = static_cast<float>(i % 7) - 3;
+        }
+        auto seconds = TimeIt([&]() {
+            stats.BeginUpdate(variables.data());
+            // Split by work, as packed rows shrink.
+            pool.Run([&](size_t thread_index) {
+                auto begin = stats.PartBegin(thread_index, num_threads);
+                auto end = stats.PartBegin(thread_index + 1, num_threads);
+                stats.UpdateRows(begin, end);
+            });
+            stats.EndUpdate();
+        });
+
+        // cov and cor are each read and written once.
+        auto bytes = 4.0 * sizeof(float) * stats.num_pairs();
+        auto gb_per_sec = bytes / seconds / 1e9;
+
+        // Over as many floats as cov and cor, read and written once each.
+        auto peak = PeakGBPerSec(&pool, 2 * stats.num_pairs());
+        printf("%8zu %12.3e %10.2f %10.2f %7.1f%%\n", n, seconds, gb_per_sec,
+               peak, 100 * gb_per_sec / peak);
+    }
+}
@@ -1,12 +1,25 @@
 #include <cassert>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <vector>
 
 #include "base/stats/online_correlater.h"
 #include "base/stats/summary.h"
 
 using psyence::base::stats::OnlineCorrelater;
 using psyence::base::stats::Summary;
+using std::vector;
+
+namespace {
+
+// Whether two floats have the same bits.
+bool SameFloat(float a, float b) {
+    return !memcmp(&a, &b, sizeof(float));
+}
+
+}  // namespace
 
 int main() {
     // Test parameters.
@@ -18,6 +31,12 @@ int main() {
     // Setup.
     OnlineCorrelater stats;
     stats.Init(num_variables, momentum);
+    OnlineCorrelater packed;
+    packed.Init(num_variables, momentum, true);
+    OnlineCorrelater scaled;
+    scaled.Init(num_variables, momentum, false, true);
+    OnlineCorrelater packed_scaled;
+    packed_scaled.Init(num_variables, momentum, true, true);
 
     // Do a bunch of rounds of updating the online correlater with samples from
     // a random uniform distribution from -1 to +1.  This way we'll know what
@@ -29,6 +48,60 @@ int main() {
             ff[j] = f * 2 - 1;
         }
         stats.Update(ff);
+        packed.Update(ff);
+        scaled.Update(ff);
+        packed_scaled.Update(ff);
+    }
+
+    // Packing only drops the lower triangle, which mirrors the upper one.
+    for (size_t i = 0; i < num_variables; ++i) {
+        for (size_t j = 0; j < num_variables; ++j) {
+            assert(SameFloat(packed.CovAt(i, j),
+                             stats.cov()[i * num_variables + j]));
+            assert(SameFloat(packed.CorAt(i, j),
+                             stats.cor()[i * num_variables + j]));
+        }
+    }
+
+    // Adding blocks of rows of the packed correlations adds the full rows.
+    {
+        auto n = num_variables;
+        vector<float> want(n * n, 0);
+        vector<float> got(n * n, 0);
+        stats.AddCorRows(0, n, 0.5f, want.data(), n);
+        for (size_t begin = 0; begin < n; begin += 16) {
+            auto end = begin + 16 < n ? begin + 16 : n;
+            packed.AddCorRows(begin, end, 0.5f, &got[begin * n], n);
+        }
+        assert(!memcmp(got.data(), want.data(), n * n * sizeof(float)));
+        vector<float> row(n, 0);
+        packed.AddCorRow(37, 0.5f, row.data());
+        assert(!memcmp(row.data(), &want[37 * n], n * sizeof(float)));
+    }
+
+    // The same goes for scaled storage, where alpha times the scale isn't 1,
+    // and into rows that already hold values.
+    {
+        auto n = num_variables;
+        vector<float> want(n * n);
+        for (auto& x : want) {
+            x = static_cast<float>(rand()) / RAND_MAX * 2 - 1;
+        }
+        auto got = want;
+        scaled.AddCorRows(0, n, 0.3f, want.data(), n);
+        for (size_t begin = 0; begin < n; begin += 16) {
+            auto end = begin + 16 < n ? begin + 16 : n;
+            packed_scaled.AddCorRows(begin, end, 0.3f, &got[begin * n], n);
+        }
+        assert(!memcmp(got.data(), want.data(), n * n * sizeof(float)));
+    }
+
+    // Scaling only changes the rounding, even across many renormalizations.
+    scaled.Materialize();
+    assert(SameFloat(scaled.scale(), 1));
+    for (size_t i = 0; i < num_variables * num_variables; ++i) {
+        assert(fabs(scaled.cov()[i] - stats.cov()[i]) < 1e-4f);
+        assert(fabs(scaled.cor()[i] - stats.cor()[i]) < 1e-3f);
     }
 
     // Means of the variables should cluster tightly around zero.
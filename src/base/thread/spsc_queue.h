@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+using std::atomic;
+using std::vector;
+
+namespace psyence {
+namespace base {
+namespace thread {
+
+// Bounded lock-free queue between one producer thread and one consumer thread.
+//
+// A ring of slots with a head index (next to pop, only written by the consumer)
+// and a tail index (next to push, only written by the producer), each on its
+// own cache line.  Each side does a relaxed load of its own index and an
+// acquire load of the other's, and publishes with a release store, so the
+// items themselves need no synchronization.  Several producers can share a
+// queue by serializing their pushes among themselves.
+template <typename T>
+class SpscQueue {
+  public:
+    // Accessors.
+    size_t capacity() const { return items_.size(); }
+
+    // Allocate space for "capacity" items (a power of two).  Not while in use.
+    void Init(size_t capacity) {
+        assert(capacity && !(capacity & (capacity - 1)));
+        items_.clear();
+        items_.resize(capacity);
+        mask_ = capacity - 1;
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
+    // Producer: add an item.  Returns false (leaving "item" alone) if full.
+    bool Push(T&& item) {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == items_.size()) {
+            return false;
+        }
+        items_[tail & mask_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: whether there is nothing to pop (one acquire load).
+    bool Empty() const {
+        return head_.load(std::memory_order_relaxed) ==
+               tail_.load(std::memory_order_acquire);
+    }
+
+    // Consumer: take the oldest item.  Returns false if empty.
+    bool Pop(T* item) {
+        auto head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        *item = std::move(items_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+  private:
+    // The ring, and capacity minus one for wrapping indices into it.
+    vector<T> items_;
+    size_t mask_{0};
+
+    // Number of items ever popped, and ever pushed.
+    alignas(64) atomic<size_t> head_{0};
+    alignas(64) atomic<size_t> tail_{0};
+};
+
+}  // namespace thread
+}  // namespace base
+}  // namespace psyence
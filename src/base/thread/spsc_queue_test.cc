@@ -0,0 +1,75 @@
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "base/cxx.h"
+#include "base/thread/spsc_queue.h"
+
+using psyence::base::thread::SpscQueue;
+using std::unique_ptr;
+
+int main() {
+    // Fills up, empties, and wraps around.
+    {
+        SpscQueue<int> queue;
+        queue.Init(4);
+        assert(queue.capacity() == 4);
+        assert(queue.Empty());
+        int x;
+        auto ok = queue.Pop(&x);
+        assert(!ok);
+        UNUSED(ok);
+        for (int round = 0; round < 3; ++round) {
+            for (int i = 0; i < 4; ++i) {
+                ok = queue.Push(round * 10 + i);
+                assert(ok);
+            }
+            ok = queue.Push(99);
+            assert(!ok);
+            for (int i = 0; i < 4; ++i) {
+                assert(!queue.Empty());
+                ok = queue.Pop(&x);
+                assert(ok);
+                assert(x == round * 10 + i);
+            }
+            assert(queue.Empty());
+        }
+    }
+
+    // Takes move-only items.
+    {
+        SpscQueue<unique_ptr<int>> queue;
+        queue.Init(2);
+        auto ok = queue.Push(unique_ptr<int>(new int(7)));
+        assert(ok);
+        UNUSED(ok);
+        unique_ptr<int> x;
+        ok = queue.Pop(&x);
+        assert(ok);
+        assert(*x == 7);
+    }
+
+    // Everything gets across between two threads, in order.
+    {
+        SpscQueue<uint64_t> queue;
+        queue.Init(64);
+        uint64_t count = 1000000;
+        std::thread producer([&queue, count]() {
+            for (uint64_t i = 0; i < count; ++i) {
+                while (!queue.Push(uint64_t(i))) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        uint64_t x;
+        for (uint64_t i = 0; i < count; ++i) {
+            while (!queue.Pop(&x)) {
+                std::this_thread::yield();
+            }
+            assert(x == i);
+        }
+        producer.join();
+        assert(queue.Empty());
+    }
+}
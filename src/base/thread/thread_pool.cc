@@ -0,0 +1,103 @@
+#include "thread_pool.h"
+
+#include <cassert>
+
+using std::unique_lock;
+
+namespace psyence {
+namespace base {
+namespace thread {
+
+void ThreadPool::Free() {
+    {
+        unique_lock<mutex> lock(lock_);
+        stopping_ = true;
+    }
+    work_posted_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+    workers_.clear();
+    stopping_ = false;
+}
+
+ThreadPool::~ThreadPool() {
+    Free();
+}
+
+void ThreadPool::Init(size_t num_threads) {
+    assert(1 <= num_threads);
+    Free();
+    num_threads_ = num_threads;
+    workers_.reserve(num_threads - 1);
+    for (size_t i = 1; i < num_threads; ++i) {
+        workers_.emplace_back(&ThreadPool::WorkerThread, this, i);
+    }
+}
+
+void ThreadPool::WorkerThread(size_t thread_index) {
+    uint64_t last_job_id = 0;
+    while (true) {
+        const function<void(size_t)>* job;
+        {
+            unique_lock<mutex> lock(lock_);
+            work_posted_.wait(lock, [this, last_job_id]() {
+                return stopping_ || job_id_ != last_job_id;
+            });
+            if (stopping_) {
+                return;
+            }
+            last_job_id = job_id_;
+            job = job_;
+        }
+
+        (*job)(thread_index);
+
+        {
+            unique_lock<mutex> lock(lock_);
+            --num_pending_;
+            if (!num_pending_) {
+                work_done_.notify_one();
+            }
+        }
+    }
+}
+
+void ThreadPool::Run(const function<void(size_t)>& fn) {
+    if (num_threads_ == 1) {
+        fn(0);
+        return;
+    }
+
+    {
+        unique_lock<mutex> lock(lock_);
+        job_ = &fn;
+        ++job_id_;
+        num_pending_ = num_threads_ - 1;
+    }
+    work_posted_.notify_all();
+
+    fn(0);
+
+    unique_lock<mutex> lock(lock_);
+    work_done_.wait(lock, [this]() {
+        return !num_pending_;
+    });
+    job_ = nullptr;
+}
+
+void ThreadPool::ParallelFor(size_t count,
+                             const function<void(size_t, size_t)>& fn) {
+    auto num_threads = num_threads_;
+    Run([count, num_threads, &fn](size_t thread_index) {
+        auto begin = count * thread_index / num_threads;
+        auto end = count * (thread_index + 1) / num_threads;
+        if (begin < end) {
+            fn(begin, end);
+        }
+    });
+}
+
+}  // namespace thread
+}  // namespace base
+}  // namespace psyence
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::condition_variable;
+using std::function;
+using std::mutex;
+using std::vector;
+
+namespace psyence {
+namespace base {
+namespace thread {
+
+// Fixed set of worker threads that are reused across jobs.
+//
+// The calling thread takes part in every job as thread zero, so a pool of one
+// thread has no workers and runs everything inline.  Work is split the same
+// way on every call, so a job gives the same results on every run for a given
+// number of threads.
+class ThreadPool {
+  public:
+    // Accessors.
+    size_t num_threads() const { return num_threads_; }
+
+    // Stop and join the workers.
+    ~ThreadPool();
+
+    // Start num_threads - 1 workers.
+    void Init(size_t num_threads);
+
+    // Run fn(thread_index) once on each thread and wait for all of them.
+    void Run(const function<void(size_t)>& fn);
+
+    // Split [0, count) into num_threads contiguous chunks and run
+    // fn(begin, end) on each chunk in parallel, waiting for all of them.
+    void ParallelFor(size_t count, const function<void(size_t, size_t)>& fn);
+
+  private:
+    // Stop and join the workers.
+    void Free();
+
+    // Loop that each worker runs, waiting for jobs.
+    void WorkerThread(size_t thread_index);
+
+    // Total number of threads, including the caller.
+    size_t num_threads_{1};
+
+    // The worker threads (num_threads_ - 1 of them).
+    vector<std::thread> workers_;
+
+    // Guards the job fields below.
+    mutex lock_;
+
+    // Signals workers that a job was posted (or that we are stopping), and the
+    // caller that the workers finished.
+    condition_variable work_posted_;
+    condition_variable work_done_;
+
+    // The current job, and its sequence number so workers can tell it's new.
+    const function<void(size_t)>* job_{nullptr};
+    uint64_t job_id_{0};
+
+    // Number of workers that have not finished the current job.
+    size_t num_pending_{0};
+
+    // Whether the workers should exit.
+    bool stopping_{false};
+};
+
+}  // namespace thread
+}  // namespace base
+}  // namespace psyence
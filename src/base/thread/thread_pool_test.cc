@@ -0,0 +1,42 @@
+#include <atomic>
+#include <cassert>
+#include <vector>
+
+#include "base/cxx.h"
+#include "base/thread/thread_pool.h"
+
+using psyence::base::thread::ThreadPool;
+using std::atomic;
+using std::vector;
+
+int main() {
+    for (size_t num_threads = 1; num_threads <= 5; ++num_threads) {
+        ThreadPool pool;
+        pool.Init(num_threads);
+        assert(pool.num_threads() == num_threads);
+
+        // Every thread runs each job exactly once.
+        atomic<size_t> num_calls{0};
+        for (size_t i = 0; i < 100; ++i) {
+            pool.Run([&num_calls](size_t thread_index) {
+                UNUSED(thread_index);
+                ++num_calls;
+            });
+        }
+        assert(num_calls == 100 * num_threads);
+
+        // The chunks cover the range exactly once, including when there are
+        // fewer items than threads.
+        for (size_t count = 0; count < 20; ++count) {
+            vector<size_t> hits(count);
+            pool.ParallelFor(count, [&hits](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    ++hits[i];
+                }
+            });
+            for (auto& hit : hits) {
+                assert(hit == 1);
+            }
+        }
+    }
+}
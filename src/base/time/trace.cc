@@ -13,6 +13,12 @@ namespace psyence {
 namespace base {
 namespace time {
 
+TimedSection::~TimedSection() {
+    for (auto& child : children_) {
+        delete child;
+    }
+}
+
 void TimedSection::Init(TimedSection* parent, const string& name) {
     name_ = name;
     parent_ = parent;
@@ -49,7 +55,9 @@ void TimedSection::Report(const DurationPrettyPrinter& pp, size_t num_indents,
 void Trace::Free() {
     if (root_) {
         delete root_;
+        root_ = nullptr;
     }
+    paths_.clear();
 }
 
 Trace::~Trace() {
@@ -60,25 +68,63 @@ void Trace::Init() {
     Free();
     root_ = new TimedSection;
     root_->Init(nullptr, "");
-    head_ = root_;
 }
 
 void Trace::Enter(const string& name) {
     auto sub = new TimedSection;
-    sub->Init(head_, name);
-    head_->ReturnedFrom(sub);
-    head_ = sub;
-    head_->Enter(NanoClock());
+    {
+        std::lock_guard<mutex> lock(lock_);
+        auto it = paths_.find(std::this_thread::get_id());
+        if (it == paths_.end()) {
+            it = paths_.emplace(std::this_thread::get_id(),
+                                Path{root_, root_}).first;
+        }
+        auto& path = it->second;
+        sub->Init(path.head, name);
+        path.head->ReturnedFrom(sub);
+        path.head = sub;
+    }
+    sub->Enter(NanoClock());
 }
 
 void Trace::Exit() {
-    head_->Exit(NanoClock());
-    assert(head_->parent());
-    head_ = head_->parent();
+    auto exit_ns = NanoClock();
+    std::lock_guard<mutex> lock(lock_);
+    auto it = paths_.find(std::this_thread::get_id());
+    assert(it != paths_.end());
+    auto& path = it->second;
+    assert(path.head != path.base);
+    path.head->Exit(exit_ns);
+    path.head = path.head->parent();
+    if (path.head == root_ && path.base == root_) {
+        paths_.erase(it);
+    }
+}
+
+TimedSection* Trace::head() const {
+    std::lock_guard<mutex> lock(lock_);
+    auto it = paths_.find(std::this_thread::get_id());
+    return it == paths_.end() ? root_ : it->second.head;
+}
+
+void Trace::Attach(TimedSection* parent) {
+    std::lock_guard<mutex> lock(lock_);
+    assert(!paths_.count(std::this_thread::get_id()));
+    paths_[std::this_thread::get_id()] = {parent, parent};
+}
+
+void Trace::Detach() {
+    std::lock_guard<mutex> lock(lock_);
+    auto it = paths_.find(std::this_thread::get_id());
+    if (it != paths_.end()) {
+        assert(it->second.head == it->second.base);
+        paths_.erase(it);
+    }
 }
 
 void Trace::Report(const DurationPrettyPrinter& pp, string* text) const {
-    assert(head_ == root_);
+    std::lock_guard<mutex> lock(lock_);
+    assert(paths_.empty());
     for (auto& child : root_->children()) {
         child->Report(pp, 0, 2, text);
     }
@@ -93,6 +139,18 @@ ScopeTracer::~ScopeTracer() {
     trace_->Exit();
 }
 
+TaskTracer::TaskTracer(const string& name, TimedSection* parent,
+                       Trace* trace) {
+    trace_ = trace;
+    trace_->Attach(parent);
+    trace_->Enter(name);
+}
+
+TaskTracer::~TaskTracer() {
+    trace_->Exit();
+    trace_->Detach();
+}
+
 }  // namespace time
 }  // namespace base
 }  // namespace psyence
@@ -1,13 +1,18 @@
 #pragma once
 
 #include <cstdint>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "base/time/duration_pretty_printer.h"
 
 using psyence::base::time::DurationPrettyPrinter;
+using std::mutex;
 using std::string;
+using std::unordered_map;
 using std::vector;
 
 namespace psyence {
@@ -26,6 +31,9 @@ class TimedSection {
     int64_t enter_ns() const { return enter_ns_; }
     int64_t exit_ns() const { return exit_ns_; }
 
+    // Free the subsections.
+    ~TimedSection();
+
     // Sequence of steps:
     // * Initialize.
     // * Start timing.
@@ -56,6 +64,11 @@ class TimedSection {
 // A tree of timed sections that the code execution passed through.
 //
 // Used to collect timing information of important things.
+//
+// Threads enter and exit sections concurrently, each on its own path down the
+// tree.  A thread starts at the root, or wherever it was attached: a task run
+// on another thread attaches under the section it was started from, so its
+// time is attributed there (sections of concurrent tasks overlap in time).
 class Trace {
   public:
     // Free memory.
@@ -63,24 +76,45 @@ class Trace {
 
     // Sequence of steps:
     // * Initialize.
-    // * Push a new subsection onto the call tree.
-    // * Pop the current subsection off the call tree.
+    // * Push a new subsection onto the calling thread's path.
+    // * Pop the current subsection off the calling thread's path.
     void Init();
     void Enter(const string& name);
     void Exit();
 
-    // Dump recursive timings to string, line by line.
+    // The section the calling thread is currently in.
+    TimedSection* head() const;
+
+    // Make the calling thread's sections go under "parent" (eg, the head() of
+    // the thread that started its task), until it detaches, having exited all
+    // of them.
+    void Attach(TimedSection* parent);
+    void Detach();
+
+    // Dump recursive timings to string, line by line.  All threads must have
+    // exited their sections.
     void Report(const DurationPrettyPrinter& pp, string* text) const;
 
   private:
+    // Where a thread is in the tree: where it was attached, and the lowest-
+    // level section that it is currently in.
+    struct Path {
+        TimedSection* base;
+        TimedSection* head;
+    };
+
     // Free memory.
     void Free();
 
     // The root timed code section.  Its enter_ns_ and exit_ns_ are ignored.
     TimedSection* root_{nullptr};
 
-    // Pointer to the lowest-level section that we are currently in.
-    TimedSection* head_{nullptr};
+    // Guards the paths, and the child lists of the sections.
+    mutable mutex lock_;
+
+    // Paths of the threads that are attached or inside a section (the others
+    // are at the root).
+    unordered_map<std::thread::id, Path> paths_;
 };
 
 // A scoped-based timer that updates a Trace.
@@ -99,6 +133,23 @@ class ScopeTracer {
     Trace* trace_;
 };
 
+// A scope-based timer for a task run on another thread.
+//
+// Attaches the thread under the section the task was started from, then times
+// the task as a section of its own.
+class TaskTracer {
+  public:
+    // Attach and enter the timed section.
+    TaskTracer(const string& name, TimedSection* parent, Trace* trace);
+
+    // Exit the timed section and detach.
+    ~TaskTracer();
+
+  private:
+    // Where we note timed section enter/exit.
+    Trace* trace_;
+};
+
 }  // namespace time
 }  // namespace base
 }  // namespace psyence
@@ -1,13 +1,20 @@
 #include <cassert>
 #include <chrono>
+#include <cstring>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include "base/time/duration_pretty_printer.h"
 #include "base/time/trace.h"
 
 using psyence::base::time::AsTightestSubseconds;
+using psyence::base::time::AsMilliseconds;
 using psyence::base::time::ScopeTracer;
+using psyence::base::time::TaskTracer;
 using psyence::base::time::Trace;
+using std::string;
+using std::vector;
 using namespace std::chrono_literals;
 
 int main() {
@@ -34,4 +41,50 @@ int main() {
     trace.Report(*dpp, &text);
     assert(!text.empty());
     delete dpp;
+
+    // Tasks on other threads go under the section they were started from,
+    // each with its own subsections, while that thread goes on with its own.
+    Trace tasks;
+    tasks.Init();
+    {
+        ScopeTracer st("load", &tasks);
+        auto parent = tasks.head();
+        vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([&tasks, parent]() {
+                TaskTracer tt("task", parent, &tasks);
+                for (int j = 0; j < 100; ++j) {
+                    ScopeTracer inner_st("inner", &tasks);
+                }
+            });
+        }
+        for (int j = 0; j < 100; ++j) {
+            ScopeTracer own_st("own", &tasks);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    std::thread([&tasks]() {
+        ScopeTracer st("other", &tasks);
+    }).join();
+
+    auto ms_pp = AsMilliseconds::New();
+    text.clear();
+    tasks.Report(*ms_pp, &text);
+    delete ms_pp;
+    size_t num_lines[5] = {0, 0, 0, 0, 0};
+    const char* prefixes[5] = {"load: ", "  task: ", "    inner: ", "  own: ",
+                               "other: "};
+    size_t begin = 0;
+    while (begin < text.size()) {
+        auto end = text.find('\n', begin);
+        auto line = text.substr(begin, end - begin);
+        for (size_t i = 0; i < 5; ++i) {
+            num_lines[i] += !line.compare(0, strlen(prefixes[i]), prefixes[i]);
+        }
+        begin = end + 1;
+    }
+    assert(num_lines[0] == 1 && num_lines[1] == 4 && num_lines[2] == 400);
+    assert(num_lines[3] == 100 && num_lines[4] == 1);
 }
@@ -33,6 +33,13 @@ void DatasetSplit::InitDatasetSplit(
     y_shape_ = y_shape;
 }
 
+void DatasetSplit::GetBatch(const size_t* indices, size_t count, float* x,
+                            float* y) const {
+    for (size_t i = 0; i < count; ++i) {
+        Get(indices[i], &x[i * x_size_], &y[i * y_size_]);
+    }
+}
+
 bool DatasetSplit::Matches(const DatasetSplit& other) const {
     if (x_size_ != other.x_size_) {
         return false;
@@ -94,6 +101,11 @@ void Dataset::Get(size_t split, size_t index_in_split, float* x,
     splits_[split]->Get(index_in_split, x, y);
 }
 
+void Dataset::GetBatch(size_t split, const size_t* indices, size_t count,
+                       float* x, float* y) const {
+    splits_[split]->GetBatch(indices, count, x, y);
+}
+
 void Dataset::ShuffleSamples(
         const vector<size_t>& selected_splits, mt19937* rng,
         vector<pair<size_t, size_t>>* splits_indices) const {
@@ -179,5 +191,23 @@ void Dataset::ShuffleIntoBatches(
     }
 }
 
+void Dataset::ShuffleSampleRuns(
+        const vector<size_t>& selected_splits, size_t batch_size, mt19937* rng,
+        vector<pair<size_t, size_t>>* splits_indices) const {
+    if (batch_size == 1) {
+        ShuffleSamples(selected_splits, rng, splits_indices);
+        return;
+    }
+    vector<size_t> shuf_splits;
+    vector<size_t> shuf_indices;
+    ShuffleIntoBatches(selected_splits, batch_size, rng, &shuf_splits,
+                       &shuf_indices);
+    splits_indices->resize(shuf_indices.size());
+    for (size_t i = 0; i < shuf_indices.size(); ++i) {
+        (*splits_indices)[i].first = shuf_splits[i / batch_size];
+        (*splits_indices)[i].second = shuf_indices[i];
+    }
+}
+
 }  // namespace dataset
 }  // namespace psyence
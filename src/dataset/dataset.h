@@ -32,6 +32,13 @@ class DatasetSplit {
     // Get the sample at the given index.
     virtual void Get(size_t index, float* x, float* y) const = 0;
 
+    // Get the samples at the given indices, into "count" consecutive rows of
+    // x_size and y_size.
+    //
+    // Calls Get() on each unless overridden with something faster.
+    virtual void GetBatch(const size_t* indices, size_t count, float* x,
+                          float* y) const;
+
     // Verify shapes match between splits.
     virtual bool Matches(const DatasetSplit& other) const;
 
@@ -71,6 +78,14 @@ class Dataset {
     virtual void Get(size_t split, size_t index_in_split, float* x,
                      float* y) const;
 
+    // Get the samples from the given split at the given indices, into "count"
+    // consecutive rows of x_size and y_size (see DatasetSplit::GetBatch()).
+    //
+    // Not virtual: it only makes the split's one virtual call for the whole
+    // batch, so prefer it over Get() in loops.
+    void GetBatch(size_t split, const size_t* indices, size_t count, float* x,
+                  float* y) const;
+
     // Get a shuffle of the samples of the selected splits.
     //
     // Samples are listed one at a time, with the splits mixed together.
@@ -95,6 +110,15 @@ class Dataset {
         const vector<size_t>& selected_splits, size_t batch_size, mt19937* rng,
         vector<size_t>* shuf_splits, vector<size_t>* shuf_indices) const;
 
+    // Get a shuffle of the samples of the selected splits in runs of
+    // batch_size samples of one split, listed one at a time.
+    //
+    // The same as ShuffleSamples() for a batch_size of 1, else the batches of
+    // ShuffleIntoBatches() flattened into pairs of (split, index in split).
+    void ShuffleSampleRuns(
+        const vector<size_t>& selected_splits, size_t batch_size, mt19937* rng,
+        vector<pair<size_t, size_t>>* splits_indices) const;
+
   protected:
     // Free memory.
     virtual void Free();
@@ -0,0 +1,228 @@
+#include "idx.h"
+
+#include <cassert>
+#include <cstring>
+#include <thread>
+
+#include "base/simd/kernels.h"
+
+using psyence::base::simd::ByteSwap;
+using psyence::base::time::TaskTracer;
+
+namespace psyence {
+namespace dataset {
+
+namespace {
+
+// Read a big-endian uint32 in place.
+uint32_t ReadBigEndian32(const uint8_t* bytes) {
+    return static_cast<uint32_t>(bytes[0]) << 24 |
+           static_cast<uint32_t>(bytes[1]) << 16 |
+           static_cast<uint32_t>(bytes[2]) << 8 |
+           static_cast<uint32_t>(bytes[3]);
+}
+
+// Values converted at a time by CopyIntsTo().
+const size_t INT_CHUNK = 1024;
+
+// Copy "count" values of type T to int64s.
+template <typename T>
+void WidenTo(const void* in, size_t count, int64_t* out) {
+    auto values = static_cast<const T*>(in);
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = values[i];
+    }
+}
+
+}  // namespace
+
+size_t IdxTypeSize(uint8_t type) {
+    switch (type) {
+    case static_cast<uint8_t>(IdxType::UINT8):
+    case static_cast<uint8_t>(IdxType::INT8):
+        return 1;
+    case static_cast<uint8_t>(IdxType::INT16):
+        return 2;
+    case static_cast<uint8_t>(IdxType::INT32):
+    case static_cast<uint8_t>(IdxType::FLOAT32):
+        return 4;
+    case static_cast<uint8_t>(IdxType::FLOAT64):
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+IdxFile::~IdxFile() {
+    Free();
+}
+
+void IdxFile::Free() {
+    if (file_) {
+        delete file_;
+        file_ = nullptr;
+    }
+}
+
+bool IdxFile::Open(const string& filename, AccessPattern pattern) {
+    Free();
+    file_ = new MappedFile;
+    if (!file_->Open(filename.c_str(), pattern)) {
+        Free();
+        return false;
+    }
+
+    // Magic: two zero bytes, the type and the rank.
+    auto bytes = file_->data();
+    auto size = file_->size();
+    if (size < 4 || bytes[0] || bytes[1] || !IdxTypeSize(bytes[2])) {
+        Free();
+        return false;
+    }
+    type_ = static_cast<IdxType>(bytes[2]);
+    value_size_ = IdxTypeSize(bytes[2]);
+    size_t rank = bytes[3];
+    data_offset_ = 4 + 4 * rank;
+    if (size < data_offset_) {
+        Free();
+        return false;
+    }
+
+    // Dimensions, checking that their product can't overflow.
+    shape_.resize(rank);
+    num_values_ = 1;
+    for (size_t i = 0; i < rank; ++i) {
+        shape_[i] = ReadBigEndian32(&bytes[4 + 4 * i]);
+        if (shape_[i] && (size - data_offset_) / value_size_ / shape_[i] <
+                num_values_) {
+            Free();
+            return false;
+        }
+        num_values_ *= shape_[i];
+    }
+    if (size - data_offset_ != num_values_ * value_size_) {
+        Free();
+        return false;
+    }
+    return true;
+}
+
+void IdxFile::CopyTo(size_t begin, size_t count, void* out) const {
+    assert(begin <= num_values_ && count <= num_values_ - begin);
+    ByteSwap(&data()[begin * value_size_], count, value_size_, out);
+}
+
+void IdxFile::CopyIntsTo(size_t begin, size_t count, int64_t* out) const {
+    // In chunks, through a buffer of host byte order values.
+    uint8_t buffer[INT_CHUNK * sizeof(int32_t)];
+    for (size_t i = 0; i < count; i += INT_CHUNK) {
+        auto chunk = count - i < INT_CHUNK ? count - i : INT_CHUNK;
+        CopyTo(begin + i, chunk, buffer);
+        switch (type_) {
+        case IdxType::UINT8:
+            WidenTo<uint8_t>(buffer, chunk, &out[i]);
+            break;
+        case IdxType::INT8:
+            WidenTo<int8_t>(buffer, chunk, &out[i]);
+            break;
+        case IdxType::INT16:
+            WidenTo<int16_t>(buffer, chunk, &out[i]);
+            break;
+        case IdxType::INT32:
+            WidenTo<int32_t>(buffer, chunk, &out[i]);
+            break;
+        case IdxType::FLOAT32:
+        case IdxType::FLOAT64:
+            assert(false);
+        }
+    }
+}
+
+MappedFile* IdxFile::Release() {
+    auto file = file_;
+    file_ = nullptr;
+    return file;
+}
+
+bool LoadIdxClasses(const string& filename, size_t* num_samples,
+                    Class** classes, Class* num_classes) {
+    IdxFile file;
+    if (!file.Open(filename, AccessPattern::SEQUENTIAL) ||
+            file.shape().size() != 1 || file.type() == IdxType::FLOAT32 ||
+            file.type() == IdxType::FLOAT64) {
+        return false;
+    }
+    auto count = file.shape()[0];
+    vector<int64_t> values(count);
+    file.CopyIntsTo(0, count, values.data());
+    auto out = new Class[count];
+    Class max_class = 0;
+    for (size_t i = 0; i < count; ++i) {
+        auto value = values[i];
+        if (value < 0 || 0xFFFF <= value) {
+            delete [] out;
+            return false;
+        }
+        out[i] = static_cast<Class>(value);
+        if (max_class < out[i] + 1) {
+            max_class = static_cast<Class>(out[i] + 1);
+        }
+    }
+    *num_samples = count;
+    *classes = out;
+    *num_classes = max_class;
+    return true;
+}
+
+bool LoadIdxImgClfSplit(const string& images_filename,
+                        const string& classes_filename, AccessPattern pattern,
+                        ImgClfDatasetSplit* split, Trace* trace) {
+    // The classes are read on another thread while the images are mapped.
+    size_t num_classes_samples = 0;
+    Class* classes = nullptr;
+    Class num_classes = 0;
+    bool classes_ok = false;
+    auto parent = trace->head();
+    std::thread classes_thread([&]() {
+        TaskTracer tracer("classes", parent, trace);
+        classes_ok = LoadIdxClasses(classes_filename, &num_classes_samples,
+                                    &classes, &num_classes);
+    });
+
+    trace->Enter("images");
+    IdxFile images;
+    auto ok = images.Open(images_filename, pattern) &&
+              images.type() == IdxType::UINT8;
+    trace->Exit();
+    classes_thread.join();
+
+    vector<size_t> x_shape;
+    size_t num_samples = 0;
+    if (ok) {
+        auto& shape = images.shape();
+        num_samples = shape.empty() ? 0 : shape[0];
+        if (shape.size() == 2) {
+            x_shape = {1, 1, shape[1]};
+        } else if (shape.size() == 3) {
+            x_shape = {1, shape[1], shape[2]};
+        } else if (shape.size() == 4) {
+            x_shape = {shape[1], shape[2], shape[3]};
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || !classes_ok || num_classes_samples != num_samples) {
+        if (classes) {
+            delete [] classes;
+        }
+        return false;
+    }
+
+    auto offset = images.data_offset();
+    split->InitImgClfDatasetSplitMapped(num_samples, x_shape, images.Release(),
+                                        offset, num_classes, classes);
+    return true;
+}
+
+}  // namespace dataset
+}  // namespace psyence
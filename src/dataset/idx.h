@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "base/file.h"
+#include "base/time/trace.h"
+#include "dataset/img_clf_dataset.h"
+
+using psyence::base::file::AccessPattern;
+using psyence::base::file::MappedFile;
+using psyence::base::time::Trace;
+using std::string;
+using std::vector;
+
+namespace psyence {
+namespace dataset {
+
+// Types of the values in an IDX file (the third byte of its magic number).
+enum class IdxType {
+    UINT8 = 0x08,
+    INT8 = 0x09,
+    INT16 = 0x0B,
+    INT32 = 0x0C,
+    FLOAT32 = 0x0D,
+    FLOAT64 = 0x0E,
+};
+
+// Size in bytes of the values of a type byte, or 0 if it isn't an IDX type.
+size_t IdxTypeSize(uint8_t type);
+
+// An IDX file, mapped, with its header parsed in place.
+//
+// Layout: two zero bytes, the type byte, the rank byte, one big-endian uint32
+// per dimension, then the values in row-major order, big-endian.  Any type and
+// rank is read; the values stay in the mapping until copied out.
+class IdxFile {
+  public:
+    // Accessors.
+    IdxType type() const { return type_; }
+    size_t value_size() const { return value_size_; }
+    const vector<size_t>& shape() const { return shape_; }
+    size_t num_values() const { return num_values_; }
+
+    // Where the values start in the mapping, and the raw (big-endian) values.
+    size_t data_offset() const { return data_offset_; }
+    const uint8_t* data() const { return file_->data() + data_offset_; }
+
+    // Unmap the file, unless released.
+    ~IdxFile();
+
+    // Map the file and parse its header.
+    //
+    // Returns false if the file can't be mapped or isn't a well-formed IDX
+    // file whose size matches its shape.
+    bool Open(const string& filename,
+              AccessPattern pattern = AccessPattern::SEQUENTIAL);
+
+    // Copy values [begin, begin + count) to "out", in host byte order
+    // (vectorized byte swapping, for values wider than a byte).
+    void CopyTo(size_t begin, size_t count, void* out) const;
+
+    // Copy integer values [begin, begin + count), of any integer type, to
+    // "out" as int64s.
+    void CopyIntsTo(size_t begin, size_t count, int64_t* out) const;
+
+    // Give up the mapping to the caller, who then owns it.
+    MappedFile* Release();
+
+  private:
+    // Unmap the file.
+    void Free();
+
+    MappedFile* file_{nullptr};
+    IdxType type_{IdxType::UINT8};
+    size_t value_size_{0};
+    vector<size_t> shape_;
+    size_t num_values_{0};
+    size_t data_offset_{0};
+};
+
+// Load an IDX file of N integer classes into a new[] array.
+//
+// Returns false if the file can't be read or isn't N non-negative integers
+// that fit a Class.
+bool LoadIdxClasses(const string& filename, size_t* num_samples,
+                    Class** classes, Class* num_classes);
+
+// Load an image classification split from an IDX file of uint8 images and one
+// of integer classes.
+//
+// Images are N x H x W, N x C x H x W, or N x D (taken as 1 x 1 x D), and
+// classes are N non-negative integers.  The images are read in place from the
+// mapping, which the split owns; the classes are copied out, concurrently, as
+// a task of their own in the trace.  Returns false, leaving the split alone,
+// if the files don't fit that.
+bool LoadIdxImgClfSplit(const string& images_filename,
+                        const string& classes_filename, AccessPattern pattern,
+                        ImgClfDatasetSplit* split, Trace* trace);
+
+}  // namespace dataset
+}  // namespace psyence
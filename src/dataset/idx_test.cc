@@ -0,0 +1,161 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "base/cxx.h"
+#include "base/time/trace.h"
+#include "dataset/idx.h"
+#include "dataset/img_clf_dataset.h"
+
+using psyence::base::time::Trace;
+using psyence::dataset::IdxFile;
+using psyence::dataset::IdxType;
+using psyence::dataset::ImgClfDatasetSplit;
+using psyence::dataset::LoadIdxImgClfSplit;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Write an IDX file of the given type byte and shape, with "data" already
+// big-endian.
+void WriteIdx(const char* filename, uint8_t type, const vector<uint32_t>& shape,
+              const string& data) {
+    string bytes = {0, 0, static_cast<char>(type),
+                    static_cast<char>(shape.size())};
+    for (auto dim : shape) {
+        for (int shift = 24; 0 <= shift; shift -= 8) {
+            bytes += static_cast<char>((dim >> shift) & 0xFF);
+        }
+    }
+    bytes += data;
+    FILE* f = fopen(filename, "wb");
+    fwrite(bytes.data(), 1, bytes.size(), f);
+    fclose(f);
+}
+
+}  // namespace
+
+int main() {
+    auto images_filename = "idx_test_images";
+    auto classes_filename = "idx_test_classes";
+
+    // Any rank and type: big-endian int16s of shape 2 x 3 x 5 come out in host
+    // order, and as ints.
+    string data;
+    for (int i = 0; i < 30; ++i) {
+        auto value = static_cast<uint16_t>(i * 1000 - 7);
+        data += static_cast<char>(value >> 8);
+        data += static_cast<char>(value & 0xFF);
+    }
+    WriteIdx(images_filename, 0x0B, {2, 3, 5}, data);
+    IdxFile file;
+    auto ok = file.Open(images_filename);
+    assert(ok);
+    UNUSED(ok);
+    assert(file.type() == IdxType::INT16);
+    assert(file.value_size() == 2);
+    assert(file.shape() == vector<size_t>({2, 3, 5}));
+    assert(file.num_values() == 30);
+    vector<int16_t> values(30);
+    file.CopyTo(0, 30, values.data());
+    vector<int64_t> ints(29);
+    file.CopyIntsTo(1, 29, ints.data());
+    for (int i = 0; i < 30; ++i) {
+        assert(values[static_cast<size_t>(i)] ==
+               static_cast<int16_t>(i * 1000 - 7));
+    }
+    for (size_t i = 0; i < 29; ++i) {
+        assert(ints[i] == values[i + 1]);
+    }
+
+    // Float64s, rank 1.
+    double doubles[3] = {1.5, -2.25, 1e300};
+    string double_data;
+    for (auto value : doubles) {
+        uint8_t bytes[8];
+        memcpy(bytes, &value, 8);
+        for (int i = 7; 0 <= i; --i) {
+            double_data += static_cast<char>(bytes[i]);
+        }
+    }
+    WriteIdx(images_filename, 0x0E, {3}, double_data);
+    ok = file.Open(images_filename);
+    assert(ok);
+    double got[3];
+    file.CopyTo(0, 3, got);
+    assert(!memcmp(got, doubles, sizeof(got)));
+
+    // Malformed: unknown type, size not matching the shape, or truncated
+    // header.
+    WriteIdx(images_filename, 0x0A, {1}, "x");
+    ok = file.Open(images_filename);
+    assert(!ok);
+    WriteIdx(images_filename, 0x08, {2, 2}, "abc");
+    ok = file.Open(images_filename);
+    assert(!ok);
+    WriteIdx(images_filename, 0x08, {0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF}, "");
+    ok = file.Open(images_filename);
+    assert(!ok);
+    WriteIdx(images_filename, 0x08, {}, "x");
+    ok = file.Open(images_filename);
+    assert(ok && file.num_values() == 1);
+    ok = file.Open("idx_test_missing");
+    assert(!ok);
+
+    // A split of 4 images of 2 x 3, with uint8 or int32 classes.
+    string pixels;
+    for (int i = 0; i < 24; ++i) {
+        pixels += static_cast<char>(i * 10);
+    }
+    WriteIdx(images_filename, 0x08, {4, 2, 3}, pixels);
+    WriteIdx(classes_filename, 0x08, {4}, string("\x02\x00\x07\x01", 4));
+    Trace trace;
+    trace.Init();
+    {
+        ImgClfDatasetSplit split;
+        ok = LoadIdxImgClfSplit(images_filename, classes_filename,
+                                psyence::base::file::AccessPattern::RANDOM,
+                                &split, &trace);
+        assert(ok);
+        assert(split.num_samples() == 4);
+        assert(split.x_shape() == vector<size_t>({1, 2, 3}));
+        assert(split.num_classes() == 8);
+        assert(split.classes()[2] == 7);
+        assert(!memcmp(split.pixels(), pixels.data(), 24));
+        float x[6];
+        float y[8];
+        split.Get(3, x, y);
+        assert(static_cast<int>(x[5] * 255 + 0.5f) == 230);
+        assert(static_cast<int>(y[1]) == 1);
+    }
+    WriteIdx(classes_filename, 0x0C, {4},
+             string("\0\0\0\x03\0\0\0\x01\0\0\0\x02\0\0\0\x00", 16));
+    {
+        ImgClfDatasetSplit split;
+        ok = LoadIdxImgClfSplit(images_filename, classes_filename,
+                                psyence::base::file::AccessPattern::NORMAL,
+                                &split, &trace);
+        assert(ok);
+        assert(split.num_classes() == 4);
+        assert(split.classes()[0] == 3);
+    }
+
+    // Classes that don't fit: wrong count, or negative.
+    ImgClfDatasetSplit split;
+    WriteIdx(classes_filename, 0x08, {3}, "\x01\x02\x03");
+    ok = LoadIdxImgClfSplit(images_filename, classes_filename,
+                            psyence::base::file::AccessPattern::NORMAL, &split,
+                            &trace);
+    assert(!ok);
+    WriteIdx(classes_filename, 0x09, {4}, "\x01\x02\x03\xFF");
+    ok = LoadIdxImgClfSplit(images_filename, classes_filename,
+                            psyence::base::file::AccessPattern::NORMAL, &split,
+                            &trace);
+    assert(!ok);
+
+    remove(images_filename);
+    remove(classes_filename);
+}
@@ -4,14 +4,30 @@
 #include <cstring>
 
 #include "base/dlearn.h"
+#include "base/simd/kernels.h"
 
 using psyence::base::dlearn::AvgPool;
+using psyence::base::simd::ScaleBytesToFloat;
 
 namespace psyence {
 namespace dataset {
 
+namespace {
+
+// Pixels are scaled to [0, 1] by multiplying by this.
+const float PIXEL_SCALE = 1 / 255.0f;
+
+// How many samples ahead of the one being converted to prefetch the pixels
+// of, and the stride to touch each cache line of a row.
+const size_t PREFETCH_AHEAD = 4;
+const size_t CACHE_LINE = 64;
+
+}  // namespace
+
 ImgClfDatasetSplit::~ImgClfDatasetSplit() {
-    if (pixels_) {
+    if (pixels_file_) {
+        delete pixels_file_;
+    } else if (pixels_) {
         delete [] pixels_;
     }
     if (classes_) {
@@ -29,17 +45,47 @@ void ImgClfDatasetSplit::InitImgClfDatasetSplit(
     classes_ = classes;
 }
 
-void ImgClfDatasetSplit::Get(size_t index, float* x, float* y) const {
+void ImgClfDatasetSplit::InitImgClfDatasetSplitMapped(
+        size_t num_samples, const vector<size_t>& x_shape,
+        MappedFile* pixels_file, size_t pixels_offset, Class num_classes,
+        const Class* classes) {
+    InitImgClfDatasetSplit(num_samples, x_shape,
+                           pixels_file->data() + pixels_offset, num_classes,
+                           classes);
+    assert(pixels_offset + num_samples * x_size_ <= pixels_file->size());
+    pixels_file_ = pixels_file;
+}
+
+void ImgClfDatasetSplit::GetOne(size_t index, float* x, float* y) const {
     assert(index < num_samples_);
-    size_t offset = index * x_size_;
-    for (size_t i = 0; i < x_size_; ++i) {
-        x[i] = pixels_[offset + i] / 255.0f;
+    ScaleBytesToFloat(&pixels_[index * x_size_], x_size_, PIXEL_SCALE, x);
+    memset(y, 0, num_classes_ * sizeof(float));
+    y[classes_[index]] = 1;
+}
+
+void ImgClfDatasetSplit::Get(size_t index, float* x, float* y) const {
+    GetOne(index, x, y);
+}
+
+void ImgClfDatasetSplit::GetBatch(const size_t* indices, size_t count,
+                                  float* x, float* y) const {
+    // Start loading the first rows together, then each row a few samples
+    // before it is converted.
+    auto prefetch = [this, indices](size_t i) {
+        auto row = &pixels_[indices[i] * x_size_];
+        for (size_t j = 0; j < x_size_; j += CACHE_LINE) {
+            __builtin_prefetch(&row[j]);
+        }
+    };
+    for (size_t i = 0; i < count && i < PREFETCH_AHEAD; ++i) {
+        prefetch(i);
     }
-    for (size_t i = 0; i < num_classes_; ++i) {
-        y[i] = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (i + PREFETCH_AHEAD < count) {
+            prefetch(i + PREFETCH_AHEAD);
+        }
+        GetOne(indices[i], &x[i * x_size_], &y[i * y_size_]);
     }
-    auto klass = classes_[index];
-    y[klass] = 1;
 }
 
 void ImgClfDatasetSplit::AvgPool(
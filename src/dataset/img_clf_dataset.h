@@ -1,8 +1,11 @@
 #pragma once
 
+#include "base/file.h"
 #include "dataset/class.h"
 #include "dataset/dataset.h"
 
+using psyence::base::file::MappedFile;
+
 namespace psyence {
 namespace dataset {
 
@@ -19,13 +22,31 @@ class ImgClfDatasetSplit : public DatasetSplit {
         size_t num_samples, const vector<size_t>& x_shape,
         const uint8_t* pixels, Class num_classes, const Class* classes);
 
+    // Initialize with the pixels read in place from a mapped file, starting
+    // "pixels_offset" bytes in.  Takes ownership of the file, which is
+    // unmapped instead of the pixels being freed.
+    virtual void InitImgClfDatasetSplitMapped(
+        size_t num_samples, const vector<size_t>& x_shape,
+        MappedFile* pixels_file, size_t pixels_offset, Class num_classes,
+        const Class* classes);
+
     virtual void Get(size_t index, float* x, float* y) const;
 
+    // Gathers the rows in one go, converting the pixels with vector kernels
+    // and prefetching rows a few samples ahead (they are scattered by the
+    // shuffle).
+    virtual void GetBatch(const size_t* indices, size_t count, float* x,
+                          float* y) const;
+
     virtual void AvgPool(const vector<size_t>& pool_shape,
                          ImgClfDatasetSplit* out);
 
   protected:
+    // Convert one sample, non-virtually.
+    void GetOne(size_t index, float* x, float* y) const;
+
     const uint8_t* pixels_{nullptr};
+    MappedFile* pixels_file_{nullptr};
     Class num_classes_{0};
     const Class* classes_{nullptr};
 };
@@ -0,0 +1,175 @@
+#include "img_clf_dataset_cache.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <sys/stat.h>
+
+#include "base/checkpoint.h"
+#include "base/cxx.h"
+#include "base/str/sprintf.h"
+
+using psyence::base::checkpoint::CheckpointReader;
+using psyence::base::checkpoint::CheckpointWriter;
+using psyence::base::checkpoint::Checksum;
+using psyence::base::file::MappedFile;
+using psyence::base::str::sprintf::StringAppendF;
+using psyence::base::str::sprintf::StringPrintf;
+
+namespace psyence {
+namespace dataset {
+
+namespace {
+
+// Rank of the image shapes.
+const size_t X_RANK = 3;
+
+// Meta values per split: number of samples, number of classes, image shape.
+const size_t META_PER_SPLIT = 2 + X_RANK;
+
+string SectionName(size_t split_index, const char* what) {
+    return StringPrintf("split.%zu.%s", split_index, what);
+}
+
+}  // namespace
+
+void ImgClfDatasetCache::Init(const string& dirname) {
+    dirname_ = dirname;
+}
+
+bool ImgClfDatasetCache::Key(const vector<string>& source_filenames,
+                             const string& transforms, string* key) const {
+    // Hash each source, then the list of their hashes and the transforms.
+    auto text = StringPrintf("version %u\n", IMG_CLF_DATASET_CACHE_VERSION);
+    for (auto& filename : source_filenames) {
+        MappedFile file;
+        if (!file.Open(filename.c_str(), AccessPattern::SEQUENTIAL, true)) {
+            return false;
+        }
+        auto checksum = Checksum(file.data(), file.size());
+        StringAppendF(&text, "source %016llx %zu\n",
+                      static_cast<unsigned long long>(checksum), file.size());
+    }
+    StringAppendF(&text, "transforms %s\n", transforms.c_str());
+    auto checksum = Checksum(text.data(), text.size());
+    *key = StringPrintf("%016llx", static_cast<unsigned long long>(checksum));
+    return true;
+}
+
+string ImgClfDatasetCache::Filename(const string& key) const {
+    return dirname_ + key + ".imgclf";
+}
+
+bool ImgClfDatasetCache::Load(const string& key, AccessPattern pattern,
+                              ImgClfDataset* dataset) const {
+    auto filename = Filename(key);
+    CheckpointReader reader;
+    if (!reader.Open(filename.c_str())) {
+        return false;
+    }
+
+    // Shapes.
+    const void* data;
+    size_t size;
+    if (!reader.Get("meta", &data, &size) || size < sizeof(uint64_t)) {
+        return false;
+    }
+    vector<uint64_t> meta(size / sizeof(uint64_t));
+    memcpy(meta.data(), data, meta.size() * sizeof(uint64_t));
+    auto num_splits = meta[0];
+    if (!num_splits || (meta.size() - 1) / META_PER_SPLIT != num_splits ||
+            (meta.size() - 1) % META_PER_SPLIT) {
+        return false;
+    }
+
+    // Check every split before making any, so a miss leaves nothing behind.
+    vector<size_t> pixels_offsets(num_splits);
+    vector<size_t> pixels_sizes(num_splits);
+    for (size_t i = 0; i < num_splits; ++i) {
+        auto split_meta = &meta[1 + i * META_PER_SPLIT];
+        auto num_samples = split_meta[0];
+        auto num_classes = split_meta[1];
+        uint64_t x_size = 1;
+        for (size_t j = 0; j < X_RANK; ++j) {
+            x_size *= split_meta[2 + j];
+        }
+        auto& pixels_size = pixels_sizes[i];
+        size_t classes_size;
+        if (!num_classes || 0xFFFF < num_classes ||
+                !reader.GetOffset(SectionName(i, "pixels").c_str(),
+                                  &pixels_offsets[i], &pixels_size) ||
+                pixels_size != num_samples * x_size ||
+                !reader.Get(SectionName(i, "classes").c_str(), &data,
+                            &classes_size) ||
+                classes_size != num_samples * sizeof(Class)) {
+            return false;
+        }
+        auto classes = static_cast<const uint8_t*>(data);
+        for (size_t j = 0; j < num_samples; ++j) {
+            Class klass;
+            memcpy(&klass, &classes[j * sizeof(Class)], sizeof(Class));
+            if (num_classes <= klass) {
+                return false;
+            }
+        }
+    }
+
+    // Map the file once per split for the pixels, which each split owns.
+    vector<MappedFile*> files(num_splits);
+    for (size_t i = 0; i < num_splits; ++i) {
+        files[i] = new MappedFile;
+        if (!files[i]->Open(filename.c_str(), pattern) ||
+                files[i]->size() < pixels_offsets[i] + pixels_sizes[i]) {
+            for (size_t j = 0; j <= i; ++j) {
+                delete files[j];
+            }
+            return false;
+        }
+    }
+
+    vector<ImgClfDatasetSplit*> splits;
+    for (size_t i = 0; i < num_splits; ++i) {
+        auto split_meta = &meta[1 + i * META_PER_SPLIT];
+        auto num_samples = split_meta[0];
+        vector<size_t> x_shape(&split_meta[2], &split_meta[2 + X_RANK]);
+        auto classes = new Class[num_samples];
+        // Sized and checked above, so this can't miss.
+        auto ok = reader.CopyTo(SectionName(i, "classes").c_str(),
+                                num_samples * sizeof(Class), classes);
+        assert(ok);
+        UNUSED(ok);
+        auto split = new ImgClfDatasetSplit;
+        split->InitImgClfDatasetSplitMapped(
+            num_samples, x_shape, files[i], pixels_offsets[i],
+            static_cast<Class>(split_meta[1]), classes);
+        splits.emplace_back(split);
+    }
+    dataset->InitImgClfDataset(splits);
+    return true;
+}
+
+bool ImgClfDatasetCache::Save(const string& key,
+                              const ImgClfDataset& dataset) const {
+    auto& splits = dataset.splits();
+    vector<uint64_t> meta = {splits.size()};
+    CheckpointWriter writer;
+    for (size_t i = 0; i < splits.size(); ++i) {
+        auto split = reinterpret_cast<const ImgClfDatasetSplit*>(splits[i]);
+        assert(split->x_shape().size() == X_RANK);
+        meta.emplace_back(split->num_samples());
+        meta.emplace_back(split->num_classes());
+        for (auto dim : split->x_shape()) {
+            meta.emplace_back(dim);
+        }
+        writer.Add(SectionName(i, "pixels").c_str(), split->pixels(),
+                   split->num_samples() * split->x_size());
+        writer.Add(SectionName(i, "classes").c_str(), split->classes(),
+                   split->num_samples() * sizeof(Class));
+    }
+    writer.Add("meta", meta.data(), meta.size() * sizeof(uint64_t));
+    mkdir(dirname_.c_str(), 0775);
+    return writer.Save(Filename(key).c_str());
+}
+
+}  // namespace dataset
+}  // namespace psyence
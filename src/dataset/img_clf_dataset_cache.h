@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "base/file.h"
+#include "dataset/img_clf_dataset.h"
+
+using psyence::base::file::AccessPattern;
+using std::string;
+using std::vector;
+
+namespace psyence {
+namespace dataset {
+
+// Version of the cached dataset layout, part of every key, so bumping it
+// leaves old entries unused.
+const uint32_t IMG_CLF_DATASET_CACHE_VERSION = 1;
+
+// On-disk cache of preprocessed image classification datasets (eg, pooled
+// MNIST), so they are made once rather than on every launch.
+//
+// Content-addressed: an entry is named for a checksum of the bytes of the
+// source files it was made from and of a description of the transforms made
+// to them, so a changed source or transform simply misses.  Entries are
+// checkpoint files (see base/checkpoint.h): section "meta" with the shapes,
+// then "split.<i>.pixels" and "split.<i>.classes" for each split.  Loading
+// verifies the checksums, then reads the pixels in place from the mapped file.
+class ImgClfDatasetCache {
+  public:
+    // Accessors.
+    const string& dirname() const { return dirname_; }
+
+    // Setup: cache in the given directory (made when first saved to).
+    void Init(const string& dirname);
+
+    // Compute the key of the dataset made by "transforms" (eg,
+    // "avg_pool:1x2x2") from the source files, in order.
+    //
+    // Returns false if a source file can't be read.
+    bool Key(const vector<string>& source_filenames, const string& transforms,
+             string* key) const;
+
+    // File of an entry.
+    string Filename(const string& key) const;
+
+    // Load the entry of a key, mapped and advised of how the pixels are going
+    // to be read.
+    //
+    // Returns false, leaving the dataset alone, on a miss: if there is no such
+    // entry, or it fails any check.
+    bool Load(const string& key, AccessPattern pattern,
+              ImgClfDataset* dataset) const;
+
+    // Save a dataset as the entry of a key, replacing any there.
+    //
+    // Written to a temporary file and renamed into place, so concurrent
+    // launches never see half an entry.  Returns false on any I/O error.
+    bool Save(const string& key, const ImgClfDataset& dataset) const;
+
+  private:
+    string dirname_;
+};
+
+}  // namespace dataset
+}  // namespace psyence
@@ -0,0 +1,113 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "base/cxx.h"
+#include "base/file.h"
+#include "dataset/img_clf_dataset.h"
+#include "dataset/img_clf_dataset_cache.h"
+
+using psyence::base::file::AccessPattern;
+using psyence::dataset::Class;
+using psyence::dataset::ImgClfDataset;
+using psyence::dataset::ImgClfDatasetCache;
+using psyence::dataset::ImgClfDatasetSplit;
+using std::string;
+using std::vector;
+
+namespace {
+
+void WriteFile(const char* filename, const string& data) {
+    FILE* f = fopen(filename, "wb");
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+}
+
+// A split of "num_samples" 1 x 2 x 3 images.
+ImgClfDatasetSplit* MakeSplit(size_t num_samples, uint8_t seed) {
+    auto pixels = new uint8_t[num_samples * 6];
+    auto classes = new Class[num_samples];
+    for (size_t i = 0; i < num_samples * 6; ++i) {
+        pixels[i] = static_cast<uint8_t>(seed + i * 7);
+    }
+    for (size_t i = 0; i < num_samples; ++i) {
+        classes[i] = static_cast<Class>((seed + i) % 3);
+    }
+    auto split = new ImgClfDatasetSplit;
+    split->InitImgClfDatasetSplit(num_samples, {1, 2, 3}, pixels, 3, classes);
+    return split;
+}
+
+}  // namespace
+
+int main() {
+    auto source_a = "img_clf_dataset_cache_test_a";
+    auto source_b = "img_clf_dataset_cache_test_b";
+    WriteFile(source_a, "source a");
+    WriteFile(source_b, "source b");
+    ImgClfDatasetCache cache;
+    cache.Init("img_clf_dataset_cache_test_dir/");
+
+    // Keys depend on the sources' contents and order, and the transforms.
+    string key;
+    string other_key;
+    auto ok = cache.Key({source_a, source_b}, "avg_pool:1x2x2", &key);
+    assert(ok);
+    UNUSED(ok);
+    assert(key.size() == 16);
+    ok = cache.Key({source_a, source_b}, "avg_pool:1x2x2", &other_key);
+    assert(ok && key == other_key);
+    ok = cache.Key({source_b, source_a}, "avg_pool:1x2x2", &other_key);
+    assert(ok && key != other_key);
+    ok = cache.Key({source_a, source_b}, "avg_pool:1x4x4", &other_key);
+    assert(ok && key != other_key);
+    WriteFile(source_b, "source B");
+    ok = cache.Key({source_a, source_b}, "avg_pool:1x2x2", &other_key);
+    assert(ok && key != other_key);
+    ok = cache.Key({source_a, "img_clf_dataset_cache_test_missing"}, "",
+                   &other_key);
+    assert(!ok);
+
+    // A miss, then a save, then a hit with the same samples.
+    ImgClfDataset dataset;
+    dataset.InitImgClfDataset({MakeSplit(5, 1), MakeSplit(2, 100)});
+    remove(cache.Filename(key).c_str());
+    ImgClfDataset loaded;
+    ok = cache.Load(key, AccessPattern::RANDOM, &loaded);
+    assert(!ok);
+    ok = cache.Save(key, dataset);
+    assert(ok);
+    ok = cache.Load(key, AccessPattern::RANDOM, &loaded);
+    assert(ok);
+    assert(loaded.splits().size() == 2);
+    assert(loaded.num_classes() == 3);
+    assert(loaded.x_shape() == vector<size_t>({1, 2, 3}));
+    for (size_t s = 0; s < 2; ++s) {
+        auto want = reinterpret_cast<ImgClfDatasetSplit*>(dataset.splits()[s]);
+        auto got = reinterpret_cast<ImgClfDatasetSplit*>(loaded.splits()[s]);
+        assert(got->num_samples() == want->num_samples());
+        assert(!memcmp(got->pixels(), want->pixels(),
+                       want->num_samples() * 6));
+        assert(!memcmp(got->classes(), want->classes(),
+                       want->num_samples() * sizeof(Class)));
+    }
+
+    // A corrupted entry is a miss (the first pixels come after the 64-byte
+    // header and the table of five sections).
+    auto filename = cache.Filename(key);
+    FILE* f = fopen(filename.c_str(), "r+b");
+    fseek(f, 64 + 5 * 64, SEEK_SET);
+    fputc(0x55, f);
+    fclose(f);
+    ImgClfDataset corrupted;
+    ok = cache.Load(key, AccessPattern::RANDOM, &corrupted);
+    assert(!ok);
+
+    remove(filename.c_str());
+    rmdir(cache.dirname().c_str());
+    remove(source_a);
+    remove(source_b);
+}
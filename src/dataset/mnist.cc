@@ -1,135 +1,26 @@
 #include "mnist.h"
 
-#include <algorithm>
 #include <cassert>
-#include <cstring>
+#include <thread>
 
-#include "base/file.h"
+#include "base/cxx.h"
+#include "dataset/idx.h"
 
-using psyence::base::file::LoadFile;
-using std::reverse;
+using psyence::base::time::TaskTracer;
 
 namespace psyence {
 namespace dataset {
 
-void MNISTSplit::ParseMNISTImages(
-        size_t num_bytes, const uint8_t* bytes, uint32_t magic,
-        size_t num_samples, uint8_t** images) {
-    assert(num_bytes == 16 + num_samples * 28 * 28);
-
-    uint8_t head[16];
-    memcpy(head, bytes, 16);
-
-    reverse(head, head + 4);
-    reverse(head + 4, head + 8);
-    reverse(head + 8, head + 12);
-    reverse(head + 12, head + 16);
-
-    auto ints = reinterpret_cast<uint32_t*>(head);
-    assert(ints[0] == magic);
-    assert(ints[1] == num_samples);
-    assert(ints[2] == 28);
-    assert(ints[3] == 28);
-
-    *images = new uint8_t[num_samples * 28 * 28];
-    memcpy(*images, bytes + 4 * sizeof(uint32_t), num_samples * 28 * 28);
-}
-
-void MNISTSplit::LoadMNISTImages(
-        const string& filename, uint32_t magic, size_t num_samples,
-        uint8_t** images, Trace* trace) {
-    trace->Enter("images");
-
-    trace->Enter("read");
-    size_t num_bytes;
-    uint8_t* bytes;
-    LoadFile(filename.c_str(), &num_bytes, &bytes);
-    trace->Exit();
-
-    trace->Enter("parse");
-    ParseMNISTImages(num_bytes, bytes, magic, num_samples, images);
-    trace->Exit();
-
-    trace->Enter("free");
-    delete [] bytes;
-    trace->Exit();
-
-    trace->Exit();
-}
-
-void MNISTSplit::ParseMNISTClasses(
-        size_t num_bytes, const uint8_t* bytes, uint32_t magic,
-        size_t num_samples, Class* num_classes, Class** classes) {
-    assert(num_bytes == 8 + num_samples);
-
-    uint8_t head[8];
-    memcpy(head, bytes, 8);
-
-    reverse(head, head + 4);
-    reverse(head + 4, head + 8);
-
-    auto ints = reinterpret_cast<uint32_t*>(head);
-    assert(ints[0] == magic);
-    assert(ints[1] == num_samples);
-
-    *classes = new Class[num_samples];
-    *num_classes = 0;
-    for (size_t i = 0; i < num_samples; ++i) {
-        auto& klass = bytes[8 + i];
-        (*classes)[i] = klass;
-        if (*num_classes < klass + 1) {
-            *num_classes = klass + 1;
-        }
-    }
-}
-
-void MNISTSplit::LoadMNISTClasses(
-        const string& filename, uint32_t magic, size_t num_samples,
-        Class* num_classes, Class** classes, Trace* trace) {
-    trace->Enter("classes");
-
-    trace->Enter("read");
-    size_t num_bytes;
-    uint8_t* bytes;
-    LoadFile(filename.c_str(), &num_bytes, &bytes);
-    trace->Exit();
-
-    trace->Enter("parse_bytes");
-    ParseMNISTClasses(num_bytes, bytes, magic, num_samples, num_classes,
-                      classes);
-    trace->Exit();
-
-    trace->Enter("free");
-    delete [] bytes;
-    trace->Exit();
-
-    trace->Exit();
-}
-
 MNISTSplit::~MNISTSplit() {
 }
 
-void MNISTSplit::Init(size_t num_samples, const vector<size_t>& image_shape,
-                      uint8_t* pixels, Class num_classes, Class* classes) {
-    InitImgClfDatasetSplit(num_samples, image_shape, pixels, num_classes,
-                           classes);
-}
-
 void MNISTSplit::Load(const string& images_filename,
-                      const string& classes_filename, size_t num_samples,
+                      const string& classes_filename, AccessPattern pattern,
                       Trace* trace) {
-    uint8_t* pixels;
-    LoadMNISTImages(images_filename, 0x803, num_samples, &pixels, trace);
-
-    Class num_classes;
-    Class* classes;
-    LoadMNISTClasses(classes_filename, 0x801, num_samples, &num_classes,
-                     &classes, trace);
-
-    trace->Enter("init");
-    vector<size_t> image_shape = {1, 28, 28};
-    Init(num_samples, image_shape, pixels, num_classes, classes);
-    trace->Exit();
+    auto ok = LoadIdxImgClfSplit(images_filename, classes_filename, pattern,
+                                 this, trace);
+    assert(ok);
+    UNUSED(ok);
 }
 
 MNIST::~MNIST() {
@@ -140,25 +31,36 @@ void MNIST::Init(const vector<MNISTSplit*>& splits) {
     InitImgClfDataset(cast);
 }
 
-void MNIST::Load(const string& dirname, Trace* trace) {
-    trace->Enter("load_mnist");
+string MNIST::ImagesFilename(const string& dirname, const string& prefix) {
+    return dirname + prefix + "-images-idx3-ubyte";
+}
 
-    trace->Enter("train_split");
-    auto train_split = new MNISTSplit();
-    auto images_filename = dirname + "train-images-idx3-ubyte";
-    auto classes_filename = dirname + "train-labels-idx1-ubyte";
-    train_split->Load(images_filename, classes_filename, 60000, trace);
-    trace->Exit();
+string MNIST::ClassesFilename(const string& dirname, const string& prefix) {
+    return dirname + prefix + "-labels-idx1-ubyte";
+}
 
-    trace->Enter("test_split");
-    auto test_split = new MNISTSplit();
-    images_filename = dirname + "t10k-images-idx3-ubyte";
-    classes_filename = dirname + "t10k-labels-idx1-ubyte";
-    test_split->Load(images_filename, classes_filename, 10000, trace);
-    trace->Exit();
+void MNIST::Load(const string& dirname, Trace* trace, AccessPattern pattern,
+                 const vector<string>& split_prefixes) {
+    trace->Enter("load_mnist");
+
+    // Each split is loaded by a task of its own.
+    vector<MNISTSplit*> splits;
+    vector<std::thread> threads;
+    auto parent = trace->head();
+    for (auto& prefix : split_prefixes) {
+        auto split = new MNISTSplit();
+        splits.emplace_back(split);
+        threads.emplace_back([=]() {
+            TaskTracer tracer(prefix, parent, trace);
+            split->Load(ImagesFilename(dirname, prefix),
+                        ClassesFilename(dirname, prefix), pattern, trace);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
 
     trace->Enter("init");
-    auto splits = {train_split, test_split};
     Init(splits);
     trace->Exit();
 
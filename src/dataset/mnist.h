@@ -1,49 +1,37 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
+#include "base/file.h"
 #include "base/time/trace.h"
-#include "dataset/class.h"
 #include "dataset/img_clf_dataset.h"
 
+using psyence::base::file::AccessPattern;
 using psyence::base::time::Trace;
 using std::string;
+using std::vector;
 
 namespace psyence {
 namespace dataset {
 
-// One split of MNIST.
+// One split of MNIST, or of any dataset in its IDX format.
 class MNISTSplit : public ImgClfDatasetSplit {
   public:
-    // Load MNIST images.
-    static void ParseMNISTImages(
-        size_t num_bytes, const uint8_t* bytes, uint32_t magic,
-        size_t num_samples, uint8_t** images);
-    static void LoadMNISTImages(
-        const string& filename, uint32_t magic, size_t num_samples,
-        uint8_t** images, Trace* trace);
-
-    // Load MNIST classes.
-    static void ParseMNISTClasses(
-        size_t num_bytes, const uint8_t* bytes, uint32_t magic,
-        size_t num_samples, Class* num_classes, Class** classes);
-    static void LoadMNISTClasses(
-        const string& filename, uint32_t magic, size_t num_samples,
-        Class* num_classes, Class** classes, Trace* trace);
-
     // Free memory.
     ~MNISTSplit();
 
-    // Initialize.
-    void Init(size_t num_samples, const vector<size_t>& image_shape,
-              uint8_t* pixels, Class num_classes, Class* classes);
-
-    // Load a split of MNIST from the files.
+    // Load a split from an IDX images file and an IDX classes file, of any
+    // shape (see LoadIdxImgClfSplit()).
+    //
+    // The images stay in the mapped file, which is advised of how they are
+    // going to be read.
     void Load(const string& images_filename, const string& classes_filename,
-              size_t num_samples, Trace* trace);
+              AccessPattern pattern, Trace* trace);
 };
 
-// MNIST handwritten digits dataset.
+// MNIST handwritten digits dataset, and others in its format (Fashion-MNIST,
+// EMNIST, etc).
 class MNIST : public ImgClfDataset {
   public:
     // Free memory.
@@ -52,8 +40,25 @@ class MNIST : public ImgClfDataset {
     // Initialize.
     void Init(const vector<MNISTSplit*>& splits);
 
+    // Files of the split of a prefix (see Load()).
+    static string ImagesFilename(const string& dirname, const string& prefix);
+    static string ClassesFilename(const string& dirname, const string& prefix);
+
     // Load the dataset from a data directory.
-    void Load(const string& dirname, Trace* trace);
+    //
+    // Each split is the files "<prefix>-images-idx3-ubyte" and
+    // "<prefix>-labels-idx1-ubyte": "train" and "t10k" for MNIST and
+    // Fashion-MNIST, eg "emnist-digits-train" and "emnist-digits-test" for
+    // EMNIST.
+    //
+    // The splits, and the images and classes files of each, are loaded
+    // concurrently, each as a task of its own in the trace.
+    //
+    // Images are read straight from the mapped files: pass SEQUENTIAL to make
+    // a pass over them all (eg, pooling), or RANDOM to train on them.
+    void Load(const string& dirname, Trace* trace,
+              AccessPattern pattern = AccessPattern::SEQUENTIAL,
+              const vector<string>& split_prefixes = {"train", "t10k"});
 };
 
 }  // namespace dataset
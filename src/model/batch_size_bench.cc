@@ -0,0 +1,104 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "base/time/clock.h"
+#include "model/adapter.h"
+#include "model/model.h"
+
+using psyence::base::time::clock::NanoClock;
+using psyence::model::Adapter;
+using psyence::model::Model;
+using psyence::model::ModelConfig;
+using std::vector;
+
+// Compares batch sizes on the same synthetic train/predict stream.
+//
+// Usage: batch_size_bench [num_neurons] [num_samples] [num_threads]
+//
+// Each batch size trains and predicts num_samples samples, a batch at a time,
+// and reports samples/sec and its speedup over one sample at a time.
+
+namespace {
+
+// Shape of the synthetic samples (like 14x14 MNIST with ten classes).
+const size_t X_DIM = 196;
+const size_t Y_DIM = 10;
+const size_t TICKS = 4;
+
+// Batch sizes compared.
+const size_t BATCH_SIZES[] = {1, 2, 4, 8, 16, 32};
+
+// Seconds taken to train and predict num_samples samples at a batch size.
+double Run(size_t batch_size, size_t num_neurons, size_t num_samples,
+           size_t num_threads) {
+    auto io = new Adapter;
+    io->Init(0.5f, 1, X_DIM, 1, Y_DIM);
+    ModelConfig config;
+    config.num_neurons = num_neurons;
+    config.num_threads = num_threads;
+    config.batch_size = batch_size;
+    Model model;
+    model.Init(io, config);
+
+    vector<float> x(batch_size * X_DIM);
+    vector<float> y(batch_size * Y_DIM);
+    vector<float> pred_means(batch_size * TICKS * Y_DIM);
+    vector<float> pred_stds(batch_size * TICKS * Y_DIM);
+    auto t0 = NanoClock();
+    for (size_t i = 0; i < num_samples; i += batch_size) {
+        for (size_t b = 0; b < batch_size; ++b) {
+            auto sample = i + b;
+            for (size_t j = 0; j < X_DIM; ++j) {
+                x[b * X_DIM + j] =
+                    static_cast<float>((sample * 7 + j) % 11) / 10;
+            }
+            for (size_t j = 0; j < Y_DIM; ++j) {
+                y[b * Y_DIM + j] = (sample % Y_DIM == j) ? 1 : 0;
+            }
+        }
+        model.Train(TICKS, x.data(), y.data());
+        model.Predict(TICKS, x.data(), pred_means.data(), pred_stds.data());
+    }
+    auto t1 = NanoClock();
+    return static_cast<double>(t1 - t0) / 1e9;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    assert(argc <= 4);
+    size_t num_neurons = 2048;
+    size_t num_samples = 256;
+    size_t num_threads = 1;
+    if (1 < argc) {
+        num_neurons = strtoul(argv[1], nullptr, 10);
+    }
+    if (2 < argc) {
+        num_samples = strtoul(argv[2], nullptr, 10);
+    }
+    if (3 < argc) {
+        num_threads = strtoul(argv[3], nullptr, 10);
+    }
+    assert(X_DIM + Y_DIM <= num_neurons);
+
+    printf("num_neurons %zu, num_samples %zu, num_threads %zu\n\n",
+           num_neurons, num_samples, num_threads);
+
+    double base_rate = 0;
+    for (auto batch_size : BATCH_SIZES) {
+        // Whole batches only.
+        auto count = num_samples / batch_size * batch_size;
+        if (!count) {
+            break;
+        }
+        auto seconds = Run(batch_size, num_neurons, count, num_threads);
+        auto rate = count / seconds;
+        if (batch_size == 1) {
+            base_rate = rate;
+        }
+        printf("batch_size %2zu: %.3f sec, %8.2f samples/sec, %.2fx\n",
+               batch_size, seconds, rate, rate / base_rate);
+    }
+}
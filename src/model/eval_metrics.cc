@@ -0,0 +1,168 @@
+#include "eval_metrics.h"
+
+#include <cassert>
+
+namespace psyence {
+namespace model {
+
+namespace {
+
+// Index of the highest of "count" floats (the first, on ties).
+size_t ArgMax(const float* x, size_t count) {
+    size_t best = 0;
+    for (size_t i = 1; i < count; ++i) {
+        if (x[best] < x[i]) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// What a checkpoint records of the metrics besides their arrays.
+struct EvalMetricsMeta {
+    uint64_t num_ticks;
+    uint64_t num_classes;
+    uint64_t window;
+    uint64_t num_samples;
+    uint64_t window_num_correct;
+};
+
+}  // namespace
+
+void EvalMetrics::Init(size_t num_ticks, size_t num_classes, size_t window) {
+    assert(num_ticks && num_classes && window);
+    num_ticks_ = num_ticks;
+    num_classes_ = num_classes;
+    window_ = window;
+    num_samples_ = 0;
+    num_correct_.assign(num_ticks, 0);
+    sum_pred_std_.assign(num_ticks, 0);
+    confusion_.assign(num_ticks * num_classes * num_classes, 0);
+    window_correct_.assign(window, 0);
+    window_num_correct_ = 0;
+}
+
+void EvalMetrics::Add(const float* y_true, const float* pred_means_per_tick,
+                      const float* pred_stds_per_tick) {
+    auto true_class = ArgMax(y_true, num_classes_);
+    bool correct = false;
+    for (size_t t = 0; t < num_ticks_; ++t) {
+        auto means = &pred_means_per_tick[t * num_classes_];
+        auto pred_class = ArgMax(means, num_classes_);
+        correct = pred_class == true_class;
+        num_correct_[t] += correct;
+        sum_pred_std_[t] += pred_stds_per_tick[t * num_classes_ + pred_class];
+        auto confusion = &confusion_[t * num_classes_ * num_classes_];
+        ++confusion[true_class * num_classes_ + pred_class];
+    }
+
+    // The window keeps the last tick's.
+    auto& slot = window_correct_[num_samples_ % window_];
+    window_num_correct_ -= slot;
+    slot = correct;
+    window_num_correct_ += slot;
+    ++num_samples_;
+}
+
+double EvalMetrics::Accuracy(size_t tick) const {
+    if (!num_samples_) {
+        return 0;
+    }
+    return static_cast<double>(num_correct_[tick]) / num_samples_;
+}
+
+const uint64_t* EvalMetrics::Confusion(size_t tick) const {
+    return &confusion_[tick * num_classes_ * num_classes_];
+}
+
+double EvalMetrics::MeanPredStd(size_t tick) const {
+    if (!num_samples_) {
+        return 0;
+    }
+    return sum_pred_std_[tick] / num_samples_;
+}
+
+double EvalMetrics::WindowAccuracy() const {
+    auto count = num_samples_ < window_ ? num_samples_ : window_;
+    if (!count) {
+        return 0;
+    }
+    return static_cast<double>(window_num_correct_) / count;
+}
+
+json EvalMetrics::ToJson() const {
+    json accuracy = json::array();
+    json mean_pred_std = json::array();
+    json confusion = json::array();
+    for (size_t t = 0; t < num_ticks_; ++t) {
+        accuracy.push_back(Accuracy(t));
+        mean_pred_std.push_back(MeanPredStd(t));
+        auto matrix = Confusion(t);
+        json rows = json::array();
+        for (size_t i = 0; i < num_classes_; ++i) {
+            rows.push_back(vector<uint64_t>(&matrix[i * num_classes_],
+                                            &matrix[(i + 1) * num_classes_]));
+        }
+        confusion.push_back(rows);
+    }
+    return {
+        {"num_samples", num_samples_},
+        {"accuracy_per_tick", accuracy},
+        {"mean_pred_std_per_tick", mean_pred_std},
+        {"window", window_},
+        {"window_accuracy", WindowAccuracy()},
+        {"confusion_per_tick", confusion},
+    };
+}
+
+void EvalMetrics::AddToCheckpoint(CheckpointWriter* writer) const {
+    EvalMetricsMeta meta;
+    meta.num_ticks = num_ticks_;
+    meta.num_classes = num_classes_;
+    meta.window = window_;
+    meta.num_samples = num_samples_;
+    meta.window_num_correct = window_num_correct_;
+    writer->AddCopy("eval.meta", &meta, sizeof(meta));
+    writer->Add("eval.correct", num_correct_.data(),
+                num_correct_.size() * sizeof(uint64_t));
+    writer->Add("eval.pred_std", sum_pred_std_.data(),
+                sum_pred_std_.size() * sizeof(double));
+    writer->Add("eval.confusion", confusion_.data(),
+                confusion_.size() * sizeof(uint64_t));
+    writer->Add("eval.window", window_correct_.data(), window_correct_.size());
+}
+
+bool EvalMetrics::RestoreFromCheckpoint(const CheckpointReader& reader) {
+    EvalMetricsMeta meta;
+    if (!reader.CopyTo("eval.meta", sizeof(meta), &meta) ||
+            meta.num_ticks != num_ticks_ || meta.num_classes != num_classes_ ||
+            meta.window != window_) {
+        return false;
+    }
+    auto num_correct = num_correct_;
+    auto sum_pred_std = sum_pred_std_;
+    auto confusion = confusion_;
+    auto window_correct = window_correct_;
+    if (!reader.CopyTo("eval.correct", num_correct.size() * sizeof(uint64_t),
+                       num_correct.data()) ||
+            !reader.CopyTo("eval.pred_std",
+                           sum_pred_std.size() * sizeof(double),
+                           sum_pred_std.data()) ||
+            !reader.CopyTo("eval.confusion",
+                           confusion.size() * sizeof(uint64_t),
+                           confusion.data()) ||
+            !reader.CopyTo("eval.window", window_correct.size(),
+                           window_correct.data())) {
+        return false;
+    }
+    num_samples_ = meta.num_samples;
+    window_num_correct_ = meta.window_num_correct;
+    num_correct_.swap(num_correct);
+    sum_pred_std_.swap(sum_pred_std);
+    confusion_.swap(confusion);
+    window_correct_.swap(window_correct);
+    return true;
+}
+
+}  // namespace model
+}  // namespace psyence
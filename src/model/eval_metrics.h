@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "base/checkpoint.h"
+#include "base/collection/json.h"
+
+using psyence::base::checkpoint::CheckpointReader;
+using psyence::base::checkpoint::CheckpointWriter;
+using psyence::base::collection::json;
+using std::vector;
+
+namespace psyence {
+namespace model {
+
+// Streaming summary of evaluation results, in place of keeping them all.
+//
+// For each tick of prediction:
+// * Top-1 accuracy (the class with the highest predicted mean against the
+//   class with the highest true value).
+// * Confusion matrix (true class by predicted class).
+// * Mean std (across Y repeats) of the predicted class.
+//
+// Plus the top-1 accuracy of the last tick over the last "window" samples.
+class EvalMetrics {
+  public:
+    // Accessors.
+    size_t num_ticks() const { return num_ticks_; }
+    size_t num_classes() const { return num_classes_; }
+    uint64_t num_samples() const { return num_samples_; }
+
+    // Setup.
+    void Init(size_t num_ticks, size_t num_classes, size_t window);
+
+    // Add one sample's results.
+    //
+    // Shape: y_true is num_classes, and the predictions are num_ticks *
+    // num_classes.
+    void Add(const float* y_true, const float* pred_means_per_tick,
+             const float* pred_stds_per_tick);
+
+    // Top-1 accuracy at a tick.
+    double Accuracy(size_t tick) const;
+
+    // Confusion matrix at a tick (shape: num_classes * num_classes, indexed by
+    // true class then predicted class).
+    const uint64_t* Confusion(size_t tick) const;
+
+    // Mean std of the predicted class at a tick.
+    double MeanPredStd(size_t tick) const;
+
+    // Top-1 accuracy of the last tick over the last "window" samples (or all of
+    // them, if fewer).
+    double WindowAccuracy() const;
+
+    // Everything above, as JSON.
+    json ToJson() const;
+
+    // Add the counts to a checkpoint (they must not change until it's saved),
+    // and restore them from one written with the same shape.
+    void AddToCheckpoint(CheckpointWriter* writer) const;
+    bool RestoreFromCheckpoint(const CheckpointReader& reader);
+
+  private:
+    // Shape.
+    size_t num_ticks_{0};
+    size_t num_classes_{0};
+    size_t window_{0};
+
+    // Number of samples added.
+    uint64_t num_samples_{0};
+
+    // Per tick: number of correct top-1 predictions, and sum of the predicted
+    // classes' stds.
+    vector<uint64_t> num_correct_;
+    vector<double> sum_pred_std_;
+
+    // Per tick confusion matrices (shape: num_ticks * num_classes *
+    // num_classes).
+    vector<uint64_t> confusion_;
+
+    // Whether the last tick was right, for the last "window" samples (a ring
+    // indexed by sample number), and how many of those were.
+    vector<uint8_t> window_correct_;
+    uint64_t window_num_correct_{0};
+};
+
+}  // namespace model
+}  // namespace psyence
@@ -0,0 +1,84 @@
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+#include "base/cxx.h"
+#include "model/eval_metrics.h"
+
+using psyence::model::EvalMetrics;
+
+namespace {
+
+bool Close(double a, double b) {
+    return fabs(a - b) < 1e-9;
+}
+
+}  // namespace
+
+int main() {
+    // Two ticks, three classes, a window of two.
+    EvalMetrics metrics;
+    metrics.Init(2, 3, 2);
+    assert(!metrics.num_samples());
+    assert(Close(metrics.Accuracy(0), 0));
+    assert(Close(metrics.WindowAccuracy(), 0));
+
+    // True class 0: tick 0 says 1, tick 1 says 0.
+    float y0[3] = {1, 0, 0};
+    float means0[6] = {0.1f, 0.9f, 0.0f, 0.8f, 0.1f, 0.1f};
+    float stds0[6] = {0.0f, 0.5f, 0.0f, 0.25f, 0.0f, 0.0f};
+    metrics.Add(y0, means0, stds0);
+
+    // True class 2: both ticks say 2.
+    float y1[3] = {0, 0, 1};
+    float means1[6] = {0.0f, 0.0f, 1.0f, 0.0f, 0.2f, 0.8f};
+    float stds1[6] = {0.0f, 0.0f, 0.5f, 0.0f, 0.0f, 0.75f};
+    metrics.Add(y1, means1, stds1);
+
+    assert(metrics.num_samples() == 2);
+    assert(Close(metrics.Accuracy(0), 0.5));
+    assert(Close(metrics.Accuracy(1), 1));
+    assert(Close(metrics.MeanPredStd(0), 0.5));
+    assert(Close(metrics.MeanPredStd(1), 0.5));
+    assert(metrics.Confusion(0)[0 * 3 + 1] == 1);
+    assert(metrics.Confusion(0)[2 * 3 + 2] == 1);
+    assert(metrics.Confusion(1)[0 * 3 + 0] == 1);
+    assert(metrics.Confusion(1)[2 * 3 + 2] == 1);
+    assert(Close(metrics.WindowAccuracy(), 1));
+
+    // The window forgets the oldest samples.
+    float means_wrong[6] = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+    metrics.Add(y1, means_wrong, stds1);
+    assert(Close(metrics.WindowAccuracy(), 0.5));
+    metrics.Add(y1, means_wrong, stds1);
+    assert(Close(metrics.WindowAccuracy(), 0));
+    assert(Close(metrics.Accuracy(1), 0.5));
+
+    auto x = metrics.ToJson();
+    assert(x["num_samples"] == 4);
+    assert(x["confusion_per_tick"][1][2][0] == 2);
+
+    // Checkpoints bring back the same counts.
+    auto filename = "eval_metrics_test.bin";
+    {
+        CheckpointWriter writer;
+        metrics.AddToCheckpoint(&writer);
+        auto ok = writer.Save(filename);
+        assert(ok);
+        UNUSED(ok);
+    }
+    CheckpointReader reader;
+    auto ok = reader.Open(filename);
+    assert(ok);
+    UNUSED(ok);
+    EvalMetrics restored;
+    restored.Init(2, 3, 2);
+    ok = restored.RestoreFromCheckpoint(reader);
+    assert(ok);
+    assert(restored.ToJson() == x);
+    EvalMetrics other_shape;
+    other_shape.Init(2, 4, 2);
+    ok = other_shape.RestoreFromCheckpoint(reader);
+    assert(!ok);
+    remove(filename);
+}
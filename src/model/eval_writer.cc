@@ -0,0 +1,158 @@
+#include "eval_writer.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "base/time/clock.h"
+
+using psyence::base::time::clock::NanoClock;
+using std::unique_lock;
+
+namespace psyence {
+namespace model {
+
+EvalWriter::~EvalWriter() {
+    Close();
+}
+
+bool EvalWriter::Open(const char* filename, uint64_t offset,
+                      size_t block_size, double flush_interval_sec) {
+    Close();
+    assert(block_size);
+
+    fd_ = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0) {
+        return false;
+    }
+    if (ftruncate(fd_, static_cast<off_t>(offset))) {
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    size_ = offset;
+    num_written_ = offset;
+
+    block_size_ = block_size;
+    blocks_[0] = new uint8_t[block_size];
+    blocks_[1] = new uint8_t[block_size];
+    active_ = 0;
+    active_size_ = 0;
+    flush_interval_ns_ = static_cast<int64_t>(flush_interval_sec * 1e9);
+    last_hand_off_ = NanoClock();
+
+    pending_ = false;
+    stopping_ = false;
+    ok_ = true;
+    thread_ = std::thread(&EvalWriter::WriterThread, this);
+    return true;
+}
+
+void EvalWriter::Append(const void* data, size_t size) {
+    assert(is_open());
+    size_ += size;
+    auto bytes = static_cast<const uint8_t*>(data);
+    while (size) {
+        auto count = block_size_ - active_size_;
+        if (size < count) {
+            count = size;
+        }
+        memcpy(&blocks_[active_][active_size_], bytes, count);
+        active_size_ += count;
+        bytes += count;
+        size -= count;
+        if (active_size_ == block_size_) {
+            HandOff();
+        }
+    }
+
+    if (active_size_ && flush_interval_ns_ <= NanoClock() - last_hand_off_) {
+        HandOff();
+    }
+}
+
+void EvalWriter::HandOff() {
+    unique_lock<mutex> lock(lock_);
+    written_.wait(lock, [this]() { return !pending_; });
+    pending_ = true;
+    pending_block_ = active_;
+    pending_size_ = active_size_;
+    lock.unlock();
+    handed_off_.notify_one();
+
+    active_ = 1 - active_;
+    active_size_ = 0;
+    last_hand_off_ = NanoClock();
+}
+
+void EvalWriter::Flush() {
+    if (!is_open()) {
+        return;
+    }
+    if (active_size_) {
+        HandOff();
+    }
+    unique_lock<mutex> lock(lock_);
+    written_.wait(lock, [this]() { return !pending_; });
+}
+
+bool EvalWriter::Close() {
+    if (!is_open()) {
+        return true;
+    }
+    Flush();
+    lock_.lock();
+    stopping_ = true;
+    lock_.unlock();
+    handed_off_.notify_one();
+    thread_.join();
+
+    auto ok = ok_ && !fsync(fd_);
+    ok = !close(fd_) && ok;
+    fd_ = -1;
+    delete [] blocks_[0];
+    delete [] blocks_[1];
+    blocks_[0] = nullptr;
+    blocks_[1] = nullptr;
+    return ok;
+}
+
+void EvalWriter::WriterThread() {
+    unique_lock<mutex> lock(lock_);
+    while (true) {
+        handed_off_.wait(lock, [this]() { return pending_ || stopping_; });
+        if (!pending_) {
+            return;
+        }
+
+        // Write the block without holding the lock, so the caller can keep
+        // appending to the other one.
+        auto data = blocks_[pending_block_];
+        auto size = pending_size_;
+        lock.unlock();
+        auto ok = true;
+        while (size) {
+            auto count = write(fd_, data, size);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                ok = false;
+                break;
+            }
+            data += count;
+            size -= static_cast<size_t>(count);
+            num_written_.fetch_add(static_cast<uint64_t>(count),
+                                   std::memory_order_relaxed);
+        }
+        lock.lock();
+        ok_ = ok_ && ok;
+        pending_ = false;
+        written_.notify_one();
+    }
+}
+
+}  // namespace model
+}  // namespace psyence
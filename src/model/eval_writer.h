@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+using std::atomic;
+using std::condition_variable;
+using std::mutex;
+
+namespace psyence {
+namespace model {
+
+// Appends evaluation results to a file from a writer thread of its own.
+//
+// The caller appends into one of two large blocks in memory.  When that block
+// fills up, or the flush interval has passed since the last hand-off, it goes
+// to the writer thread and the caller moves on to the other one.  The caller
+// only syncs with the writer at hand-offs, and only waits when the writer is
+// still busy with the previous block.
+class EvalWriter {
+  public:
+    // Accessors.
+    bool is_open() const { return fd_ >= 0; }
+
+    // Bytes appended since Open(), plus the offset it opened at.  Everything
+    // below this is in the file after Flush().
+    uint64_t size() const { return size_; }
+
+    // Bytes appended but not written to the file yet.
+    uint64_t backlog() const {
+        return size_ - num_written_.load(std::memory_order_relaxed);
+    }
+
+    // Close the file (see Close()).
+    ~EvalWriter();
+
+    // Open the file for appending at "offset", cutting off anything after it.
+    //
+    // Blocks are "block_size" bytes each, and partial blocks are handed to the
+    // writer every "flush_interval_sec" seconds (if anything is appended to
+    // notice).  Returns false if the file can't be opened or cut.
+    bool Open(const char* filename, uint64_t offset, size_t block_size,
+              double flush_interval_sec);
+
+    // Append bytes.
+    void Append(const void* data, size_t size);
+
+    // Hand off whatever is buffered and wait until it is all written.
+    void Flush();
+
+    // Flush, fsync and close the file.
+    //
+    // Returns false if any write failed along the way.
+    bool Close();
+
+  private:
+    // Give the current block to the writer thread, waiting for it to finish the
+    // previous one if need be, and switch to the other block.
+    void HandOff();
+
+    // Loop of the writer thread.
+    void WriterThread();
+
+    // The file.
+    int fd_{-1};
+
+    // Bytes appended in all (see size()), and the part of them written (by the
+    // writer thread).
+    uint64_t size_{0};
+    atomic<uint64_t> num_written_{0};
+
+    // The two blocks, and which one is being appended to and how full it is.
+    size_t block_size_{0};
+    uint8_t* blocks_[2]{nullptr, nullptr};
+    size_t active_{0};
+    size_t active_size_{0};
+
+    // Hand off partial blocks this often (in ns), and when that last happened.
+    int64_t flush_interval_ns_{0};
+    int64_t last_hand_off_{0};
+
+    // Guards the hand-off fields below.
+    mutex lock_;
+
+    // Signals the writer that a block was handed off (or that it should exit),
+    // and the caller that the writer is done with it.
+    condition_variable handed_off_;
+    condition_variable written_;
+
+    // The block handed to the writer, if any, and how many bytes of it to
+    // write.
+    bool pending_{false};
+    size_t pending_block_{0};
+    size_t pending_size_{0};
+
+    // Whether the writer should exit, and whether all writes went through.
+    bool stopping_{false};
+    bool ok_{true};
+
+    // The writer thread.
+    std::thread thread_;
+};
+
+}  // namespace model
+}  // namespace psyence
@@ -0,0 +1,76 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "base/cxx.h"
+#include "base/file.h"
+#include "model/eval_writer.h"
+
+using psyence::base::file::FileToString;
+using psyence::model::EvalWriter;
+using std::string;
+
+int main() {
+    auto filename = "eval_writer_test.bin";
+
+    // Chunks of all sizes end up in the file in order, through blocks smaller
+    // and bigger than the chunks.
+    for (size_t block_size : {size_t(1), size_t(7), size_t(4096)}) {
+        string want;
+        EvalWriter writer;
+        auto ok = writer.Open(filename, 0, block_size, 1e9);
+        assert(ok);
+        UNUSED(ok);
+        for (size_t i = 0; i < 200; ++i) {
+            string chunk;
+            for (size_t j = 0; j < i % 13; ++j) {
+                chunk += static_cast<char>(rand() % 256);
+            }
+            writer.Append(chunk.data(), chunk.size());
+            want += chunk;
+            assert(writer.size() == want.size());
+        }
+        ok = writer.Close();
+        assert(ok);
+        assert(FileToString(filename) == want);
+    }
+
+    // Flush() puts everything so far in the file, and reopening at an offset
+    // cuts off the rest.
+    {
+        EvalWriter writer;
+        auto ok = writer.Open(filename, 0, 1024, 1e9);
+        assert(ok);
+        UNUSED(ok);
+        writer.Append("hello, ", 7);
+        writer.Flush();
+        assert(FileToString(filename) == "hello, ");
+        writer.Append("world", 5);
+        ok = writer.Close();
+        assert(ok);
+        assert(FileToString(filename) == "hello, world");
+
+        ok = writer.Open(filename, 5, 1024, 1e9);
+        assert(ok);
+        assert(writer.size() == 5);
+        writer.Append("!", 1);
+        ok = writer.Close();
+        assert(ok);
+        assert(FileToString(filename) == "hello!");
+    }
+
+    // A zero flush interval hands off every append right away.
+    {
+        EvalWriter writer;
+        auto ok = writer.Open(filename, 0, 1024, 0);
+        assert(ok);
+        UNUSED(ok);
+        writer.Append("abc", 3);
+        writer.Append("def", 3);
+        writer.Flush();
+        assert(FileToString(filename) == "abcdef");
+    }
+
+    remove(filename);
+}
@@ -0,0 +1,10 @@
+#include "learner.h"
+
+namespace psyence {
+namespace model {
+
+Learner::~Learner() {
+}
+
+}  // namespace model
+}  // namespace psyence
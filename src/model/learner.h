@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+
+#include "base/checkpoint.h"
+
+using psyence::base::checkpoint::CheckpointReader;
+using psyence::base::checkpoint::CheckpointWriter;
+
+namespace psyence {
+namespace model {
+
+// What a Trainer trains: a model that learns X -> Y a batch of samples at a
+// time, and keeps its learned state in checkpoints.
+//
+// Implemented by the dense Model and the SparseModel.  Calls are per batch, so
+// their dispatch is noise next to the ticks they run.
+class Learner {
+  public:
+    // Dummy destructor.
+    virtual ~Learner();
+
+    // Number of samples that each Train() and Predict() takes.
+    virtual size_t batch_size() const = 0;
+
+    // Given X and Y, learn X -> Y.
+    //
+    // Shape: x is batch_size() * x_dim, y_true is batch_size() * y_dim.
+    virtual void Train(size_t num_ticks, const float* x,
+                       const float* y_true) = 0;
+
+    // Given X, predict X -> Y.
+    //
+    // Shape: x is batch_size() * x_dim, and the predictions are batch_size() *
+    // num_ticks * y_dim.
+    virtual void Predict(size_t num_ticks, const float* x,
+                         float* pred_means_per_tick,
+                         float* pred_stds_per_tick) = 0;
+
+    // Add the learned state to a checkpoint.
+    //
+    // Sections may point into the model, which must not change until the
+    // checkpoint is saved.
+    virtual void AddToCheckpoint(CheckpointWriter* writer) const = 0;
+
+    // Restore state added to a checkpoint by AddToCheckpoint() of a model of
+    // the same kind and shape.
+    //
+    // Returns false, changing nothing, if it doesn't match or anything is
+    // missing.
+    virtual bool RestoreFromCheckpoint(const CheckpointReader& reader) = 0;
+};
+
+}  // namespace model
+}  // namespace psyence
@@ -1,16 +1,95 @@
 #include "model.h"
 
+#include <cassert>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <vector>
 
 #include "base/cxx.h"
+#include "base/simd/kernels.h"
 #include "base/stats/summary.h"
 
+using psyence::base::simd::Axpy;
+using psyence::base::simd::Bf16ToFloat;
+using psyence::base::simd::MatMat;
+using psyence::base::simd::RoundToBf16;
+using psyence::base::simd::Standardize;
+using psyence::base::simd::Sum;
+using psyence::base::simd::SumSquaredGaps;
 using psyence::base::stats::Summary;
+using std::vector;
 
 namespace psyence {
 namespace model {
 
+namespace {
+
+// Normalize each of the "num_vecs" vectors of "x" (shape: num_vecs * count) to
+// zero mean and unit standard deviation.
+void StandardizeEach(size_t num_vecs, size_t count, float* x) {
+    for (size_t v = 0; v < num_vecs; ++v) {
+        auto vec = &x[v * count];
+        auto mean = Sum(vec, count) / count;
+        auto sum = SumSquaredGaps(vec, count, mean);
+        auto std = static_cast<float>(sqrt(sum / count));
+        Standardize(mean, std, count, vec);
+    }
+}
+
+// Mix a counter into a well-spread 32-bit seed (the SplitMix64 finalizer).
+uint32_t MixSeed(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return static_cast<uint32_t>(x ^ (x >> 31));
+}
+
+// Golden ratio increment of SplitMix64's state.
+const uint64_t GOLDEN_GAMMA = 0x9E3779B97F4A7C15ull;
+
+// Uniform in [-1, 1), from the 32-bit mix of a counter.
+float SymmetricUniform(uint32_t x) {
+    return static_cast<float>(x >> 8) / 8388608.0f - 1;
+}
+
+// Rows of the weights nudged by packed correlations at a time (a cache line of
+// floats of each row above them).
+const size_t PACKED_ROW_BLOCK = 16;
+
+// What a checkpoint records of a model besides its arrays.
+struct ModelMeta {
+    uint64_t num_neurons;
+    uint64_t batch_size;
+    uint32_t weight_precision;
+    uint32_t reserved;
+    uint64_t num_weight_rounds;
+};
+
+}  // namespace
+
+const char* WeightPrecisionName(WeightPrecision precision) {
+    switch (precision) {
+    case WeightPrecision::FP32:
+        return "fp32";
+    case WeightPrecision::BF16:
+        return "bf16";
+    }
+    assert(false);
+    return nullptr;
+}
+
+bool ParseWeightPrecision(const char* name, WeightPrecision* precision) {
+    WeightPrecision precisions[] = {WeightPrecision::FP32,
+                                    WeightPrecision::BF16};
+    for (auto& it : precisions) {
+        if (!strcmp(name, WeightPrecisionName(it))) {
+            *precision = it;
+            return true;
+        }
+    }
+    return false;
+}
+
 void Model::Free() {
     if (io_) {
         delete io_;
@@ -21,8 +100,21 @@ void Model::Free() {
     if (new_act_) {
         delete [] new_act_;
     }
+    if (infer_act_) {
+        delete [] infer_act_;
+        infer_act_ = nullptr;
+    }
+    if (infer_new_act_) {
+        delete [] infer_new_act_;
+        infer_new_act_ = nullptr;
+    }
     if (weight_) {
         delete [] weight_;
+        weight_ = nullptr;
+    }
+    if (weight_bf16_) {
+        delete [] weight_bf16_;
+        weight_bf16_ = nullptr;
     }
 }
 
@@ -30,72 +122,161 @@ Model::~Model() {
     Free();
 }
 
-void Model::Init(Adapter* io, size_t num_neurons, float correlation_momentum) {
+void Model::Init(Adapter* io, const ModelConfig& config) {
     Free();
 
+    pool_.Init(config.num_threads);
+
     io_ = io;
+    auto num_neurons = config.num_neurons;
     num_neurons_ = num_neurons;
+    batch_size_ = config.batch_size;
+    assert(batch_size_);
+    fused_tick_ = config.fused_tick;
+    frozen_predict_ = config.frozen_predict;
+
+    cur_act_ = new float[batch_size_ * num_neurons]();
+    new_act_ = new float[batch_size_ * num_neurons]();
+    new_act_ready_ = false;
 
-    cur_act_ = new float[num_neurons]();
-    new_act_ = new float[num_neurons]();
+    if (frozen_predict_) {
+        infer_act_ = new float[batch_size_ * num_neurons];
+        infer_new_act_ = new float[batch_size_ * num_neurons];
+    }
 
-    weight_ = new float[num_neurons * num_neurons];
-    for (size_t i = 0; i < num_neurons * num_neurons; ++i) {
-        auto x = static_cast<float>(rand()) / RAND_MAX;
-        x = x * 2 - 1;
-        weight_[i] = x / num_neurons;
+    // Random weights, in rows split across the threads (rounded to bf16 if
+    // need be).  Weight k is the k-th draw of SplitMix64 seeded with the seed,
+    // which any thread can jump straight to, so the bits do not depend on the
+    // split.
+    weight_precision_ = config.weight_precision;
+    num_weight_rounds_ = 0;
+    if (weight_precision_ == WeightPrecision::FP32) {
+        weight_ = new float[num_neurons * num_neurons];
+    } else {
+        weight_bf16_ = new uint16_t[num_neurons * num_neurons];
     }
+    auto seed = config.seed;
+    pool_.ParallelFor(num_neurons, [this, seed](size_t begin, size_t end) {
+        auto n = num_neurons_;
+        vector<float> scratch(n);
+        for (size_t i = begin; i < end; ++i) {
+            auto row = weight_ ? &weight_[i * n] : scratch.data();
+            auto state = seed + i * n * GOLDEN_GAMMA;
+            for (size_t j = 0; j < n; ++j) {
+                state += GOLDEN_GAMMA;
+                row[j] = SymmetricUniform(MixSeed(state)) / n;
+            }
+            if (weight_bf16_) {
+                RoundToBf16(row, n, RoundingSeed(i), &weight_bf16_[i * n]);
+            }
+        }
+    });
 
-    correlater_.Init(num_neurons, correlation_momentum);
+    correlater_.Init(num_neurons, config.correlation_momentum,
+                     config.packed_correlations, config.scaled_correlations);
 }
 
 void Model::Train(size_t num_ticks, const float* x, const float* y_true) {
-    io_->SetX(x, cur_act_);
-    io_->SetY(y_true, cur_act_);
+    auto n = num_neurons_;
+    for (size_t b = 0; b < batch_size_; ++b) {
+        io_->SetX(&x[b * io_->x_dim()], &cur_act_[b * n]);
+        io_->SetY(&y_true[b * io_->y_dim()], &cur_act_[b * n]);
+    }
+    new_act_ready_ = false;
     for (size_t i = 0; i < num_ticks; ++i) {
-        Tick();
+        Tick(i + 1 == num_ticks);
     }
 }
 
 void Model::Predict(size_t num_ticks, const float* x,
                     float* pred_means_per_tick, float* pred_stds_per_tick) {
-    io_->SetX(x, cur_act_);
+    auto n = num_neurons_;
+    auto y_dim = io_->y_dim();
+
+    // Frozen predictions start from a copy of the activations and leave the
+    // originals (and any precomputed matvec of them) alone.
+    if (frozen_predict_) {
+        memcpy(infer_act_, cur_act_, batch_size_ * n * sizeof(float));
+    } else {
+        new_act_ready_ = false;
+    }
+    auto act = frozen_predict_ ? infer_act_ : cur_act_;
+    for (size_t b = 0; b < batch_size_; ++b) {
+        io_->SetX(&x[b * io_->x_dim()], &act[b * n]);
+    }
     for (size_t i = 0; i < num_ticks; ++i) {
-        Tick();
-        io_->GetY(cur_act_, &pred_means_per_tick[i * io_->x_dim()],
-                 &pred_stds_per_tick[i * io_->x_dim()]);
+        if (frozen_predict_) {
+            FrozenTick();
+        } else {
+            Tick(i + 1 == num_ticks);
+        }
+        act = frozen_predict_ ? infer_act_ : cur_act_;
+        for (size_t b = 0; b < batch_size_; ++b) {
+            auto offset = (b * num_ticks + i) * y_dim;
+            io_->GetY(&act[b * n], &pred_means_per_tick[offset],
+                      &pred_stds_per_tick[offset]);
+        }
     }
 }
 
-void Model::Tick() {
-    for (size_t i = 0; i < num_neurons_; ++i) {
-        new_act_[i] = 0;
+void Model::GetWeight(float* out) const {
+    auto n = num_neurons_;
+    if (weight_) {
+        memcpy(out, weight_, n * n * sizeof(float));
+    } else {
+        Bf16ToFloat(weight_bf16_, n * n, out);
     }
+}
 
-    float sum_of_sums = 0;
-    for (size_t i = 0; i < num_neurons_; ++i) {
-        float sum = 0;
-        for (size_t j = 0; j < num_neurons_; ++j) {
-            auto& act = cur_act_[j];
-            auto& weight = weight_[i * num_neurons_ + j];
-            sum += weight * act;
-        }
-        new_act_[i] = sum;
-        sum_of_sums += sum;
-    }
-    auto mean = sum_of_sums / num_neurons_;
-    float x = 0;
-    for (size_t i = 0; i < num_neurons_; ++i) {
-        auto& act = new_act_[i];
-        x += (mean - act) * (mean - act);
-        act -= mean;
+void Model::Infer(size_t num_ticks, const float* x, float* act, float* new_act,
+                  float* pred_means_per_tick, float* pred_stds_per_tick) const {
+    auto n = num_neurons_;
+    auto y_dim = io_->y_dim();
+    vector<float> scratch(RowScratchSize());
+    io_->SetX(x, act);
+    for (size_t i = 0; i < num_ticks; ++i) {
+        MatMatRows(0, n, act, 1, new_act, scratch.data());
+        StandardizeEach(1, n, new_act);
+        memcpy(act, new_act, n * sizeof(float));
+        io_->GetY(act, &pred_means_per_tick[i * y_dim],
+                  &pred_stds_per_tick[i * y_dim]);
     }
-    auto std = static_cast<float>(sqrt(x / num_neurons_));
-    for (size_t i = 0; i < num_neurons_; ++i) {
-        auto& act = new_act_[i];
-        act /= std;
+}
+
+void Model::FrozenTick() {
+    auto n = num_neurons_;
+    pool_.ParallelFor(n, [this](size_t begin, size_t end) {
+        vector<float> scratch(RowScratchSize());
+        MatMatRows(begin, end, infer_act_, batch_size_, infer_new_act_,
+                   scratch.data());
+    });
+    StandardizeEach(batch_size_, n, infer_new_act_);
+
+    auto tmp = infer_act_;
+    infer_act_ = infer_new_act_;
+    infer_new_act_ = tmp;
+}
+
+void Model::Tick(bool last_tick) {
+    auto n = num_neurons_;
+    auto next_matvec = fused_tick_ && !last_tick;
+
+    // New activations are the weights times the current activations (unless
+    // the previous fused tick already did it).
+    if (!new_act_ready_) {
+        pool_.ParallelFor(n, [this](size_t begin, size_t end) {
+            vector<float> scratch(RowScratchSize());
+            MatMatRows(begin, end, cur_act_, batch_size_, new_act_,
+                       scratch.data());
+        });
     }
 
+    // Then normalize each sample's to zero mean and unit standard deviation.
+    //
+    // These reductions are cheap, and doing them on one thread keeps the
+    // results independent of the number of threads.
+    StandardizeEach(batch_size_, n, new_act_);
+
 #if 0
     printf("\n\n\n\n");
     printf("    TICK\n\n");
@@ -107,26 +288,215 @@ void Model::Tick() {
     stats.InitFromData(num_neurons_ * num_neurons_, weight_, 20);
     stats.Report("weight", 80, stdout);
 
-    correlater_.Update(new_act_);
+    correlater_.Update(new_act_, batch_size_);
     correlater_.Report(stdout);
 
     printf("\n\n");
 #endif
 
-    correlater_.Update(new_act_);
-
-    for (size_t i = 0; i < num_neurons_; ++i) {
-        for (size_t j = 0; j < num_neurons_; ++j) {
-            auto& weight = weight_[i * num_neurons_ + j];
-            auto& cor = correlater_.cor()[i * num_neurons_ + j];
-            weight += cor;
-        }
+    // Fold the new activations into the correlations, and nudge the weights by
+    // the correlations.
+    ++num_weight_rounds_;
+    correlater_.BeginUpdate(new_act_, batch_size_);
+    if (correlater_.packed()) {
+        // Each weight row reads down a column of the packed correlations, which
+        // spans the rows above it, so they all have to be done first.
+        auto num_threads = pool_.num_threads();
+        pool_.Run([this, num_threads](size_t thread_index) {
+            auto begin = correlater_.PartBegin(thread_index, num_threads);
+            auto end = correlater_.PartBegin(thread_index + 1, num_threads);
+            correlater_.UpdateRows(begin, end);
+        });
+        pool_.ParallelFor(n, [this, next_matvec](size_t begin, size_t end) {
+            UpdateWeightRows(begin, end, next_matvec);
+        });
+    } else {
+        pool_.ParallelFor(n, [this, next_matvec](size_t begin, size_t end) {
+            if (fused_tick_) {
+                FusedUpdateRows(begin, end, next_matvec);
+            } else {
+                UpdateRows(begin, end);
+            }
+        });
     }
+    correlater_.EndUpdate();
+    new_act_ready_ = next_matvec;
 
     auto tmp = cur_act_;
     cur_act_ = new_act_;
     new_act_ = tmp;
 }
 
+void Model::UpdateRows(size_t begin, size_t end) {
+    auto n = num_neurons_;
+    correlater_.UpdateRows(begin, end);
+    if (weight_) {
+        Axpy(correlater_.scale(), &correlater_.cor()[begin * n],
+             (end - begin) * n, &weight_[begin * n]);
+        return;
+    }
+    vector<float> scratch(RowScratchSize());
+    for (size_t i = begin; i < end; ++i) {
+        NudgeWeightRow(i, scratch.data());
+    }
+}
+
+void Model::FusedUpdateRows(size_t begin, size_t end, bool next_matvec) {
+    // One row at a time, so the row of cov, cor and weights are still in cache
+    // for each step.  The old activations are dead by now, so the next tick's
+    // matvec goes into their buffer (which becomes new_act_ after the swap).
+    vector<float> scratch(RowScratchSize());
+    for (size_t i = begin; i < end; ++i) {
+        correlater_.UpdateRows(i, i + 1);
+        NudgeWeightRow(i, scratch.data());
+        if (next_matvec) {
+            NextMatVecRow(i, scratch.data());
+        }
+    }
+}
+
+void Model::NextMatVecRow(size_t i, float* scratch) {
+    // Reduced-precision rows are widened again after rounding, so this agrees
+    // with the unfused matvec.
+    auto n = num_neurons_;
+    MatMat(WeightRow(i, scratch), 1, n, new_act_, batch_size_, &cur_act_[i],
+           n);
+}
+
+void Model::UpdateWeightRows(size_t begin, size_t end, bool next_matvec) {
+    // A block of rows at a time, so the packed rows above are read in whole
+    // cache lines (see AddCorRows()).
+    auto n = num_neurons_;
+    vector<float> block(weight_ ? 0 : PACKED_ROW_BLOCK * n);
+    vector<float> scratch(RowScratchSize());
+    for (auto block_begin = begin; block_begin < end;
+            block_begin += PACKED_ROW_BLOCK) {
+        auto block_end = block_begin + PACKED_ROW_BLOCK < end ?
+                         block_begin + PACKED_ROW_BLOCK : end;
+        if (weight_) {
+            correlater_.AddCorRows(block_begin, block_end, 1,
+                                   &weight_[block_begin * n], n);
+        } else {
+            Bf16ToFloat(&weight_bf16_[block_begin * n],
+                        (block_end - block_begin) * n, block.data());
+            correlater_.AddCorRows(block_begin, block_end, 1, block.data(), n);
+            for (auto i = block_begin; i < block_end; ++i) {
+                RoundToBf16(&block[(i - block_begin) * n], n, RoundingSeed(i),
+                            &weight_bf16_[i * n]);
+            }
+        }
+        if (next_matvec) {
+            for (auto i = block_begin; i < block_end; ++i) {
+                NextMatVecRow(i, scratch.data());
+            }
+        }
+    }
+}
+
+size_t Model::RowScratchSize() const {
+    return weight_ ? 0 : num_neurons_;
+}
+
+const float* Model::WeightRow(size_t i, float* scratch) const {
+    auto n = num_neurons_;
+    if (weight_) {
+        return &weight_[i * n];
+    }
+    Bf16ToFloat(&weight_bf16_[i * n], n, scratch);
+    return scratch;
+}
+
+void Model::NudgeWeightRow(size_t i, float* scratch) {
+    auto n = num_neurons_;
+    if (weight_) {
+        correlater_.AddCorRow(i, 1, &weight_[i * n]);
+        return;
+    }
+    Bf16ToFloat(&weight_bf16_[i * n], n, scratch);
+    correlater_.AddCorRow(i, 1, scratch);
+    RoundToBf16(scratch, n, RoundingSeed(i), &weight_bf16_[i * n]);
+}
+
+void Model::MatMatRows(size_t begin, size_t end, const float* xs,
+                       size_t num_vecs, float* ys, float* scratch) const {
+    auto n = num_neurons_;
+    if (weight_) {
+        MatMat(&weight_[begin * n], end - begin, n, xs, num_vecs, &ys[begin],
+               n);
+        return;
+    }
+
+    // Widen each row once for all the vectors, while it is in cache.
+    for (size_t i = begin; i < end; ++i) {
+        MatMat(WeightRow(i, scratch), 1, n, xs, num_vecs, &ys[i], n);
+    }
+}
+
+uint32_t Model::RoundingSeed(size_t i) const {
+    return MixSeed(num_weight_rounds_ * num_neurons_ + i);
+}
+
+void Model::AddToCheckpoint(CheckpointWriter* writer) const {
+    auto n = num_neurons_;
+    ModelMeta meta;
+    memset(&meta, 0, sizeof(meta));
+    meta.num_neurons = n;
+    meta.batch_size = batch_size_;
+    meta.weight_precision = static_cast<uint32_t>(weight_precision_);
+    meta.num_weight_rounds = num_weight_rounds_;
+    writer->AddCopy("model.meta", &meta, sizeof(meta));
+    writer->Add("model.act", cur_act_, batch_size_ * n * sizeof(float));
+    if (weight_) {
+        writer->Add("model.weight", weight_, n * n * sizeof(float));
+    } else {
+        writer->Add("model.weight", weight_bf16_, n * n * sizeof(uint16_t));
+    }
+    correlater_.AddToCheckpoint("cor", writer);
+}
+
+bool Model::RestoreFromCheckpoint(const CheckpointReader& reader) {
+    auto n = num_neurons_;
+    ModelMeta meta;
+    if (!reader.CopyTo("model.meta", sizeof(meta), &meta) ||
+            meta.num_neurons != n || meta.batch_size != batch_size_ ||
+            meta.weight_precision !=
+                static_cast<uint32_t>(weight_precision_)) {
+        return false;
+    }
+    auto act_size = batch_size_ * n * sizeof(float);
+    auto weight_size = n * n * (weight_ ? sizeof(float) : sizeof(uint16_t));
+    const void* data;
+    size_t size;
+    if (!reader.Get("model.act", &data, &size) || size != act_size ||
+            !reader.Get("model.weight", &data, &size) || size != weight_size) {
+        return false;
+    }
+
+    // The correlater checks its own sections before changing anything.
+    if (!correlater_.RestoreFromCheckpoint("cor", reader)) {
+        return false;
+    }
+    void* weight = weight_ ? static_cast<void*>(weight_) :
+                             static_cast<void*>(weight_bf16_);
+    if (!reader.CopyTo("model.act", act_size, cur_act_) ||
+            !reader.CopyTo("model.weight", weight_size, weight)) {
+        return false;
+    }
+    num_weight_rounds_ = meta.num_weight_rounds;
+    new_act_ready_ = false;
+    return true;
+}
+
+bool Model::SaveCheckpoint(const char* filename) const {
+    CheckpointWriter writer;
+    AddToCheckpoint(&writer);
+    return writer.Save(filename);
+}
+
+bool Model::RestoreCheckpoint(const char* filename) {
+    CheckpointReader reader;
+    return reader.Open(filename) && RestoreFromCheckpoint(reader);
+}
+
 }  // namespace model
 }  // namespace psyence
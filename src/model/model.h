@@ -1,37 +1,220 @@
 #pragma once
 
+#include <cstdint>
+
+#include "base/checkpoint.h"
 #include "base/stats/online_correlater.h"
+#include "base/thread/thread_pool.h"
 #include "model/adapter.h"
+#include "model/learner.h"
 
+using psyence::base::checkpoint::CheckpointReader;
+using psyence::base::checkpoint::CheckpointWriter;
 using psyence::base::stats::OnlineCorrelater;
+using psyence::base::thread::ThreadPool;
 using psyence::model::Adapter;
+using psyence::model::Learner;
 
 namespace psyence {
 namespace model {
 
-class Model {
+// How a Model stores its weights.
+//
+// All math is done in fp32.  BF16 halves the weights' memory and the bandwidth
+// of sweeping them, and rounds each weight update stochastically so that
+// updates below bfloat16's resolution are kept on average (see RoundToBf16()).
+enum class WeightPrecision {
+    FP32,
+    BF16,
+};
+
+// Human-readable name of the weight precision.
+const char* WeightPrecisionName(WeightPrecision precision);
+
+// Parse a weight precision from its name (see WeightPrecisionName()).
+//
+// Returns true on success, false if the name is unknown.
+bool ParseWeightPrecision(const char* name, WeightPrecision* precision);
+
+// Knobs for a Model.
+struct ModelConfig {
+    // The total number of neurons.
+    size_t num_neurons{0};
+
+    // Momentum of the inter-neuron correlation statistics.
+    float correlation_momentum{0.99f};
+
+    // Number of threads that each tick is split across by rows (including the
+    // caller).  The results are bit-identical to running on one thread.
+    size_t num_threads{1};
+
+    // Number of samples that are run side by side against the shared weights.
+    //
+    // Each sample has its own activations, and the matvec of each tick becomes
+    // one matrix-matrix product, so the weights are read once per tick for
+    // the whole batch.  Their correlation updates are combined by taking the
+    // mean of their terms (see OnlineCorrelater).
+    size_t batch_size{1};
+
+    // Whether to fuse each tick into a single sweep over the weights.
+    //
+    // Rows of the correlations and weights are updated while they are in
+    // cache, and the next tick's matvec row is computed from the fresh weight
+    // row at the same time.  The results are bit-identical to the unfused path.
+    bool fused_tick{true};
+
+    // Whether to keep only the upper triangle of the symmetric correlation
+    // statistics, halving their memory and FLOPs.
+    //
+    // The correlations must then all be updated before the weights, so a fused
+    // tick only fuses the weight update with the next tick's matvec.  The
+    // results are bit-identical to the full matrices, scaled or not.
+    bool packed_correlations{false};
+
+    // Whether to keep the correlation statistics relative to a running scale,
+    // so that their momentum decay is a single multiply.
+    //
+    // This rounds differently, so the results are only close to the unscaled
+    // ones.
+    bool scaled_correlations{false};
+
+    // How the weights are stored.
+    WeightPrecision weight_precision{WeightPrecision::FP32};
+
+    // Whether Predict() runs against frozen weights.
+    //
+    // It then skips the correlation and weight updates, and starts from a copy
+    // of the training activations instead of changing them, so evaluation
+    // does not mix into learning.
+    bool frozen_predict{false};
+
+    // Seed of the initial random weights, which are the same for a given seed
+    // whatever the number of threads.
+    uint64_t seed{0};
+};
+
+// A dense model: every neuron feeds every neuron.
+class Model : public Learner {
   public:
+    // Accessors.
+    size_t num_neurons() const { return num_neurons_; }
+    virtual size_t batch_size() const { return batch_size_; }
+    const float* cur_act() const { return cur_act_; }
+    WeightPrecision weight_precision() const { return weight_precision_; }
+    const float* weight() const { return weight_; }
+    const uint16_t* weight_bf16() const { return weight_bf16_; }
+    const OnlineCorrelater& correlater() const { return correlater_; }
+
     // Free memory.
     ~Model();
 
     // Setup.
     //
     // Takes ownership of "io".
-    void Init(Adapter* io, size_t num_neurons, float correlation_momentum);
+    void Init(Adapter* io, const ModelConfig& config);
 
     // Given X and Y, learn X -> Y.
-    void Train(size_t num_ticks, const float* x, const float* y_true);
+    //
+    // Takes a batch of batch_size_ samples.  Shape: x is batch_size_ * x_dim,
+    // y_true is batch_size_ * y_dim.
+    virtual void Train(size_t num_ticks, const float* x, const float* y_true);
 
     // Given X, predict X -> Y.
-    void Predict(size_t num_ticks, const float* x, float* pred_means_per_tick,
-                 float* pred_stds_per_tick);
+    //
+    // Takes a batch of batch_size_ samples.  Shape: x is batch_size_ * x_dim,
+    // and the predictions are batch_size_ * num_ticks * y_dim.
+    virtual void Predict(size_t num_ticks, const float* x,
+                         float* pred_means_per_tick, float* pred_stds_per_tick);
+
+    // Write the weights as floats, whatever their precision (shape:
+    // num_neurons_ * num_neurons_).
+    void GetWeight(float* out) const;
+
+    // Given X, predict X -> Y for one sample against frozen weights.
+    //
+    // Nothing in the model changes.  "act" holds the activations to start from
+    // and gets the last tick's, and "new_act" is scratch (shape: num_neurons_
+    // each).  Runs on the calling thread only, so any number of threads can
+    // call it at once against one model (while nothing trains it).
+    void Infer(size_t num_ticks, const float* x, float* act, float* new_act,
+               float* pred_means_per_tick, float* pred_stds_per_tick) const;
+
+    // Add the model's learned state to a checkpoint: the activations, the
+    // weights and the correlation statistics.
+    //
+    // The big sections point into the model, which must not change until the
+    // checkpoint is saved.
+    virtual void AddToCheckpoint(CheckpointWriter* writer) const;
+
+    // Restore state added to a checkpoint by AddToCheckpoint().
+    //
+    // It must come from a model with the same shape (neurons, batch size) and
+    // storage (weight precision, packed and scaled correlations) as this one,
+    // which is Init()'d from the same config.  Returns false, changing nothing,
+    // if it doesn't or if anything is missing.
+    virtual bool RestoreFromCheckpoint(const CheckpointReader& reader);
+
+    // Save the model's learned state to a checkpoint file of its own.
+    //
+    // Returns false on any I/O error.
+    bool SaveCheckpoint(const char* filename) const;
+
+    // Restore the model's learned state from a file written by
+    // SaveCheckpoint().
+    //
+    // The file is mapped and copied straight into place.  Returns false if it
+    // is missing, corrupt or doesn't match (see RestoreFromCheckpoint()).
+    bool RestoreCheckpoint(const char* filename);
 
   private:
     // Free memory.
     void Free();
 
     // Perform one timestep.
-    void Tick();
+    //
+    // The last tick of a sample doesn't precompute the next tick's matvec (in
+    // a fused tick), as the activations are then set from the outside, which
+    // would throw it away.
+    void Tick(bool last_tick);
+
+    // Perform one timestep of Predict() against frozen weights, on
+    // infer_act_.
+    void FrozenTick();
+
+    // Update the correlations and weights (and, if "next_matvec", the next
+    // tick's matvec) for a range of rows.  Called by Tick() between the
+    // correlater's BeginUpdate() and EndUpdate().
+    void UpdateRows(size_t begin, size_t end);
+    void FusedUpdateRows(size_t begin, size_t end, bool next_matvec);
+
+    // Update the weights (and, if "next_matvec", the next tick's matvec) for a
+    // range of rows from packed correlations that are already up to date.
+    void UpdateWeightRows(size_t begin, size_t end, bool next_matvec);
+
+    // Compute row i of the next tick's matvec into cur_act_ (which becomes
+    // new_act_ after the swap), from the fresh weight row i.
+    void NextMatVecRow(size_t i, float* scratch);
+
+    // Number of floats of scratch space that each thread needs to hold a row
+    // of weights as floats (zero if they are floats already).
+    size_t RowScratchSize() const;
+
+    // Get weight row i as floats, widening it into "scratch" if need be.
+    const float* WeightRow(size_t i, float* scratch) const;
+
+    // Nudge weight row i by the correlations, by way of "scratch" if need be.
+    void NudgeWeightRow(size_t i, float* scratch);
+
+    // Multiply a range of rows of the weights by each of "num_vecs" vectors
+    // (shape: num_vecs * num_neurons_), as MatMat() would.
+    void MatMatRows(size_t begin, size_t end, const float* xs, size_t num_vecs,
+                    float* ys, float* scratch) const;
+
+    // Seed of the stochastic rounding of weight row i in the current update.
+    uint32_t RoundingSeed(size_t i) const;
+
+    // Workers that the rows of each tick are split across.
+    ThreadPool pool_;
 
     // Inputs and outputs.
     Adapter* io_{nullptr};
@@ -39,16 +222,47 @@ class Model {
     // The total number of neurons.
     size_t num_neurons_;
 
+    // Number of samples run side by side.
+    size_t batch_size_;
+
+    // Whether to fuse each tick into a single sweep (see ModelConfig).
+    bool fused_tick_;
+
+    // Whether Predict() runs against frozen weights (see ModelConfig).
+    bool frozen_predict_;
+
     // Neuron activations, and the buffer for computing the new activations.
     //
-    // Shape: num_neurons_.
+    // Shape: batch_size_ * num_neurons_.
     float* cur_act_{nullptr};
     float* new_act_{nullptr};
 
-    // Weights for each neuron feeding into each neuron.
+    // Whether new_act_ already holds the matvec for the next tick.
+    //
+    // Set by fused ticks, and cleared whenever cur_act_ is changed from the
+    // outside (eg, by setting X and Y).
+    bool new_act_ready_{false};
+
+    // Activations of frozen predictions, and the buffer for computing their
+    // new activations.
+    //
+    // Shape: batch_size_ * num_neurons_ (if frozen_predict_).
+    float* infer_act_{nullptr};
+    float* infer_new_act_{nullptr};
+
+    // How the weights are stored (see ModelConfig).
+    WeightPrecision weight_precision_;
+
+    // Weights for each neuron feeding into each neuron, in fp32 or bf16
+    // (whichever weight_precision_ says, the other is null).
     //
     // Shape: num_neurons_ * num_neurons_.
     float* weight_{nullptr};
+    uint16_t* weight_bf16_{nullptr};
+
+    // Number of rounds of reduced-precision weight updates so far, which seeds
+    // their stochastic rounding.
+    uint64_t num_weight_rounds_{0};
 
     // How neurons correlate with each other in their activity.
     //
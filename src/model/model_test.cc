@@ -0,0 +1,283 @@
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "base/cxx.h"
+#include "model/adapter.h"
+#include "model/model.h"
+
+using psyence::model::Adapter;
+using psyence::model::Model;
+using psyence::model::ModelConfig;
+using psyence::model::WeightPrecision;
+using std::vector;
+
+namespace {
+
+ModelConfig BaseConfig() {
+    ModelConfig config;
+    config.num_neurons = 64;
+    config.correlation_momentum = 0.99f;
+    config.num_threads = 1;
+    config.fused_tick = false;
+    return config;
+}
+
+void InitModel(const ModelConfig& config, Model* model) {
+    auto io = new Adapter;
+    io->Init(0.5f, 2, 8, 2, 4);
+    model->Init(io, config);
+}
+
+void RunModel(Model* model, bool predict = true) {
+    auto batch_size = model->batch_size();
+    vector<float> x(batch_size * 8);
+    vector<float> y(batch_size * 4);
+    vector<float> pred_means(batch_size * 4 * 3);
+    vector<float> pred_stds(batch_size * 4 * 3);
+    for (size_t i = 0; i < 10; ++i) {
+        for (size_t b = 0; b < batch_size; ++b) {
+            auto sample = i * batch_size + b;
+            for (size_t j = 0; j < 8; ++j) {
+                x[b * 8 + j] = static_cast<float>((sample + j) % 5) / 4;
+            }
+            for (size_t j = 0; j < 4; ++j) {
+                y[b * 4 + j] = (sample % 4 == j) ? 1 : 0;
+            }
+        }
+        model->Train(3, x.data(), y.data());
+        if (predict) {
+            model->Predict(3, x.data(), pred_means.data(), pred_stds.data());
+        }
+    }
+}
+
+bool SameFloats(const float* a, const float* b, size_t count) {
+    return !memcmp(a, b, count * sizeof(float));
+}
+
+bool CloseFloats(const float* a, const float* b, size_t count, float tol) {
+    for (size_t i = 0; i < count; ++i) {
+        if (!(fabs(a[i] - b[i]) <= tol)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main() {
+    Model want;
+    InitModel(BaseConfig(), &want);
+    RunModel(&want);
+    auto n = want.num_neurons();
+
+    // The initial weights depend on the seed, but not on the threads.
+    {
+        Model other_seed;
+        auto config = BaseConfig();
+        config.seed = 1;
+        InitModel(config, &other_seed);
+        Model fresh;
+        InitModel(BaseConfig(), &fresh);
+        assert(!SameFloats(other_seed.weight(), fresh.weight(), n * n));
+        for (size_t num_threads = 2; num_threads <= 5; ++num_threads) {
+            config = BaseConfig();
+            config.num_threads = num_threads;
+            Model got;
+            InitModel(config, &got);
+            assert(SameFloats(got.weight(), fresh.weight(), n * n));
+        }
+    }
+
+    // Neither splitting the ticks across threads, fusing them nor packing the
+    // correlations may change a single bit.
+    auto got_cor = new float[n * n];
+    for (size_t num_threads = 1; num_threads <= 5; ++num_threads) {
+        for (auto fused_tick : {false, true}) {
+            for (auto packed_correlations : {false, true}) {
+                auto config = BaseConfig();
+                config.num_threads = num_threads;
+                config.fused_tick = fused_tick;
+                config.packed_correlations = packed_correlations;
+                Model got;
+                InitModel(config, &got);
+                RunModel(&got);
+                assert(SameFloats(got.cur_act(), want.cur_act(), n));
+                assert(SameFloats(got.weight(), want.weight(), n * n));
+                got.correlater().UnpackCor(got_cor);
+                assert(SameFloats(got_cor, want.correlater().cor(), n * n));
+            }
+        }
+    }
+
+    // Scaled correlations only round differently, and packing them still
+    // doesn't change a bit.
+    {
+        auto config = BaseConfig();
+        config.scaled_correlations = true;
+        Model got;
+        InitModel(config, &got);
+        RunModel(&got);
+        assert(CloseFloats(got.weight(), want.weight(), n * n, 1e-3f));
+        got.correlater().UnpackCor(got_cor);
+        assert(CloseFloats(got_cor, want.correlater().cor(), n * n, 1e-3f));
+
+        config.packed_correlations = true;
+        Model packed;
+        InitModel(config, &packed);
+        RunModel(&packed);
+        assert(SameFloats(packed.weight(), got.weight(), n * n));
+    }
+
+    // Batches must not change a bit either, whatever the execution knobs.
+    auto batch_config = BaseConfig();
+    batch_config.batch_size = 3;
+    Model want_batch;
+    InitModel(batch_config, &want_batch);
+    RunModel(&want_batch);
+    for (size_t num_threads = 1; num_threads <= 3; ++num_threads) {
+        for (auto fused_tick : {false, true}) {
+            for (auto packed_correlations : {false, true}) {
+                auto config = batch_config;
+                config.num_threads = num_threads;
+                config.fused_tick = fused_tick;
+                config.packed_correlations = packed_correlations;
+                Model got;
+                InitModel(config, &got);
+                RunModel(&got);
+                assert(SameFloats(got.cur_act(), want_batch.cur_act(), 3 * n));
+                assert(SameFloats(got.weight(), want_batch.weight(), n * n));
+                got.correlater().UnpackCor(got_cor);
+                assert(SameFloats(got_cor, want_batch.correlater().cor(),
+                                  n * n));
+            }
+        }
+    }
+
+    // Frozen predictions must not touch the model, and Infer() must give the
+    // same predictions from any number of threads at once.
+    {
+        auto config = BaseConfig();
+        config.num_threads = 2;
+        config.fused_tick = true;
+        Model train_only;
+        InitModel(config, &train_only);
+        RunModel(&train_only, false);
+
+        config.frozen_predict = true;
+        Model got;
+        InitModel(config, &got);
+        RunModel(&got);
+        assert(SameFloats(got.cur_act(), train_only.cur_act(), n));
+        assert(SameFloats(got.weight(), train_only.weight(), n * n));
+
+        float x[8] = {0, 0.25f, 0.5f, 0.75f, 1, 0, 0.25f, 0.5f};
+        float want_means[4 * 3];
+        float want_stds[4 * 3];
+        got.Predict(3, x, want_means, want_stds);
+        assert(SameFloats(got.cur_act(), train_only.cur_act(), n));
+
+        vector<std::thread> threads;
+        for (size_t t = 0; t < 4; ++t) {
+            threads.emplace_back([&got, &x, &want_means, &want_stds, n]() {
+                vector<float> act(got.cur_act(), got.cur_act() + n);
+                vector<float> new_act(n);
+                float means[4 * 3];
+                float stds[4 * 3];
+                for (size_t i = 0; i < 10; ++i) {
+                    act.assign(got.cur_act(), got.cur_act() + n);
+                    got.Infer(3, x, act.data(), new_act.data(), means, stds);
+                    assert(SameFloats(means, want_means, 4 * 3));
+                    assert(SameFloats(stds, want_stds, 4 * 3));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // bf16 weights give the same bits whatever the execution knobs, and stay
+    // near the fp32 ones.
+    {
+        auto bf16_config = BaseConfig();
+        bf16_config.weight_precision = WeightPrecision::BF16;
+        Model want_bf16;
+        InitModel(bf16_config, &want_bf16);
+        RunModel(&want_bf16);
+        vector<float> want_weight(n * n);
+        want_bf16.GetWeight(want_weight.data());
+        assert(CloseFloats(want_weight.data(), want.weight(), n * n, 1e-2f));
+        for (size_t num_threads = 1; num_threads <= 3; ++num_threads) {
+            for (auto fused_tick : {false, true}) {
+                for (auto packed_correlations : {false, true}) {
+                    auto config = bf16_config;
+                    config.num_threads = num_threads;
+                    config.fused_tick = fused_tick;
+                    config.packed_correlations = packed_correlations;
+                    Model got;
+                    InitModel(config, &got);
+                    RunModel(&got);
+                    assert(SameFloats(got.cur_act(), want_bf16.cur_act(), n));
+                    assert(!memcmp(got.weight_bf16(), want_bf16.weight_bf16(),
+                                   n * n * sizeof(uint16_t)));
+                }
+            }
+        }
+    }
+
+    // A restored checkpoint carries on exactly where the saved model was.
+    {
+        auto filename = "model_test_checkpoint.bin";
+        for (auto precision : {WeightPrecision::FP32, WeightPrecision::BF16}) {
+            auto config = BaseConfig();
+            config.weight_precision = precision;
+            config.packed_correlations = true;
+            config.scaled_correlations = true;
+            Model saved;
+            InitModel(config, &saved);
+            RunModel(&saved);
+            auto ok = saved.SaveCheckpoint(filename);
+            assert(ok);
+            UNUSED(ok);
+
+            auto other_config = config;
+            other_config.seed = 1;
+            Model restored;
+            InitModel(other_config, &restored);
+            ok = restored.RestoreCheckpoint(filename);
+            assert(ok);
+            RunModel(&saved);
+            RunModel(&restored);
+            assert(SameFloats(restored.cur_act(), saved.cur_act(), n));
+            vector<float> saved_weight(n * n);
+            saved.GetWeight(saved_weight.data());
+            vector<float> restored_weight(n * n);
+            restored.GetWeight(restored_weight.data());
+            assert(SameFloats(restored_weight.data(), saved_weight.data(),
+                              n * n));
+
+            // Not into a model stored differently.
+            auto unpacked_config = config;
+            unpacked_config.packed_correlations = false;
+            Model unpacked;
+            InitModel(unpacked_config, &unpacked);
+            vector<float> before(n * n);
+            unpacked.GetWeight(before.data());
+            ok = unpacked.RestoreCheckpoint(filename);
+            assert(!ok);
+            vector<float> after(n * n);
+            unpacked.GetWeight(after.data());
+            assert(SameFloats(after.data(), before.data(), n * n));
+        }
+        remove(filename);
+    }
+
+    delete [] got_cor;
+}
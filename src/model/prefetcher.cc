@@ -0,0 +1,156 @@
+#include "prefetcher.h"
+
+#include <cassert>
+#include <chrono>
+
+#include "base/cxx.h"
+#include "base/time/clock.h"
+
+using namespace std::chrono_literals;
+using psyence::base::time::clock::NanoClock;
+
+namespace psyence {
+namespace model {
+
+Prefetcher::~Prefetcher() {
+    Stop();
+}
+
+void Prefetcher::Free() {
+    if (floats_) {
+        delete [] floats_;
+        floats_ = nullptr;
+    }
+    slots_.clear();
+}
+
+void Prefetcher::Start(const Dataset* dataset, const vector<size_t>& splits,
+                       const vector<pair<size_t, size_t>>& epoch,
+                       const mt19937& rng, size_t iter, size_t depth,
+                       size_t batch_size) {
+    Stop();
+
+    assert(!epoch.empty());
+    assert(depth && batch_size);
+    assert(!(epoch.size() % batch_size) && !(iter % batch_size));
+    dataset_ = dataset;
+    splits_ = splits;
+    epoch_ = epoch;
+    rng_ = rng;
+    iter_ = iter;
+    batch_size_ = batch_size;
+
+    // All the x rows, then all the y rows, so that consecutive slots can be
+    // filled by one batch.  Slots are used in order from the first, a whole
+    // number of batches to the ring, so no batch wraps around its end.
+    auto x_size = dataset->x_size();
+    auto y_size = dataset->y_size();
+    auto num_slots = depth * batch_size;
+    floats_ = new float[num_slots * (x_size + y_size)];
+    slots_.resize(num_slots);
+    size_t capacity = 1;
+    while (capacity < num_slots) {
+        capacity *= 2;
+    }
+    ready_.Init(capacity);
+    free_.Init(capacity);
+    for (size_t i = 0; i < num_slots; ++i) {
+        auto& slot = slots_[i];
+        slot.x = &floats_[i * x_size];
+        slot.y = &floats_[num_slots * x_size + i * y_size];
+        auto ok = free_.Push(size_t(i));
+        assert(ok);
+        UNUSED(ok);
+    }
+
+    fetch_ns_.Init();
+    stopping_ = false;
+    thread_ = std::thread(&Prefetcher::ProducerThread, this);
+}
+
+void Prefetcher::Stop() {
+    if (thread_.joinable()) {
+        stopping_ = true;
+        thread_.join();
+    }
+    Free();
+}
+
+const PrefetchedSample* Prefetcher::Next() {
+    // The producer should be well ahead, so this rarely waits.
+    for (size_t i = 0; i < batch_size_; ++i) {
+        size_t slot;
+        while (!ready_.Pop(&slot)) {
+            std::this_thread::yield();
+        }
+        if (!i) {
+            current_ = slot;
+        }
+        assert(slot == current_ + i);
+    }
+    return &slots_[current_];
+}
+
+void Prefetcher::Release() {
+    for (size_t i = 0; i < batch_size_; ++i) {
+        auto ok = free_.Push(current_ + i);
+        assert(ok);
+        UNUSED(ok);
+    }
+}
+
+void Prefetcher::ProducerThread() {
+    size_t indices[FETCH_BATCH];
+    size_t first;
+    while (!stopping_) {
+        if (!free_.Pop(&first)) {
+            // All slots are full: the consumer is behind, so don't spin.
+            std::this_thread::sleep_for(50us);
+            continue;
+        }
+
+        // Slots are used and released in order, so they come back free in
+        // order too.  Take the ones after this one as well, while they are
+        // free and their samples are of the same split and epoch, up to the
+        // end of the slots.
+        auto t0 = NanoClock();
+        auto split = epoch_[iter_ % epoch_.size()].first;
+        size_t count = 0;
+        bool epoch_done = false;
+        while (true) {
+            auto& slot = slots_[first + count];
+            slot.split = split;
+            slot.index_in_split = epoch_[iter_ % epoch_.size()].second;
+            indices[count] = slot.index_in_split;
+            ++count;
+            ++iter_;
+            epoch_done = iter_ % epoch_.size() == 0;
+            size_t next;
+            if (count == FETCH_BATCH || first + count == slots_.size() ||
+                    epoch_done ||
+                    epoch_[iter_ % epoch_.size()].first != split ||
+                    !free_.Pop(&next)) {
+                break;
+            }
+            assert(next == first + count);
+        }
+        dataset_->GetBatch(split, indices, count, slots_[first].x,
+                           slots_[first].y);
+        auto elapsed = NanoClock() - t0;
+        auto elapsed_ns = 0 < elapsed ? static_cast<uint64_t>(elapsed) : 0;
+        fetch_ns_.RecordCount(elapsed_ns / count, count);
+        for (size_t i = 0; i < count; ++i) {
+            auto ok = ready_.Push(first + i);
+            assert(ok);
+            UNUSED(ok);
+        }
+
+        // Reshuffle at the end of each epoch, as the trainer does.
+        if (epoch_done) {
+            dataset_->ShuffleSampleRuns(splits_, batch_size_, &rng_, &epoch_);
+        }
+    }
+}
+
+}  // namespace model
+}  // namespace psyence
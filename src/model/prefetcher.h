@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "base/stats/histogram.h"
+#include "base/thread/spsc_queue.h"
+#include "dataset/dataset.h"
+
+using psyence::base::stats::Histogram;
+using psyence::base::thread::SpscQueue;
+using psyence::dataset::Dataset;
+using std::atomic;
+using std::mt19937;
+using std::pair;
+using std::vector;
+
+namespace psyence {
+namespace model {
+
+// One sample as floats, ready for the model.
+struct PrefetchedSample {
+    // Where it came from.
+    size_t split;
+    size_t index_in_split;
+
+    // Shape: dataset x_size, y_size.
+    float* x;
+    float* y;
+};
+
+// Fetches samples on a background thread, ahead of the trainer.
+//
+// Follows the trainer's shuffled order: it takes a copy of the current epoch's
+// shuffle and of the shuffling RNG, and reshuffles with its copy at the end of
+// each epoch the same way the trainer does, so both see the same sequence.
+//
+// Samples are converted into a fixed set of slots, several consecutive ones at
+// a time when they are free (see Dataset::GetBatch()).  The consumer takes them
+// a batch at a time, from consecutive slots, so that a batch's x and y rows are
+// each contiguous.  Two single-producer
+// queues pass slot numbers back and forth: filled slots to the consumer, and
+// used ones back to the producer, so no locks are taken and no floats are
+// copied after the conversion.
+class Prefetcher {
+  public:
+    // Most samples converted by one batch.
+    static const size_t FETCH_BATCH = 8;
+
+    // Time taken to convert each sample since Start() (in ns, batches counted
+    // as their average per sample).  Read from any thread.
+    const Histogram& fetch_ns() const { return fetch_ns_; }
+
+    // Stop the thread and free memory.
+    ~Prefetcher();
+
+    // Start fetching from position "iter" of the shuffled order, up to
+    // "depth" batches of "batch_size" samples ahead.
+    //
+    // The order must be in runs of batch_size samples of one split, as from
+    // Dataset::ShuffleSampleRuns(), and "iter" at the start of one.
+    void Start(const Dataset* dataset, const vector<size_t>& splits,
+               const vector<pair<size_t, size_t>>& epoch, const mt19937& rng,
+               size_t iter, size_t depth, size_t batch_size);
+
+    // Stop the thread and drop any samples fetched but not taken.
+    void Stop();
+
+    // Consumer: wait for the next batch of batch_size samples in order, and
+    // return the first of them (the rest follow it).
+    //
+    // The x rows of the batch are consecutive, and so are its y rows.  They
+    // stay valid until Release().  Only one batch is out at a time.
+    const PrefetchedSample* Next();
+
+    // Consumer: hand the batch from Next() back for reuse.
+    void Release();
+
+  private:
+    // Loop of the producer thread.
+    void ProducerThread();
+
+    // Free memory.
+    void Free();
+
+    // Dataset, and the producer's copy of the shuffled order and position.
+    const Dataset* dataset_{nullptr};
+    vector<size_t> splits_;
+    vector<pair<size_t, size_t>> epoch_;
+    mt19937 rng_;
+    size_t iter_{0};
+
+    // Number of samples that the consumer takes at a time.
+    size_t batch_size_{1};
+
+    // The slots, and their floats (depth * batch_size_ * (x_size + y_size)).
+    vector<PrefetchedSample> slots_;
+    float* floats_{nullptr};
+
+    // Slot numbers ready for the consumer, and free for the producer.
+    SpscQueue<size_t> ready_;
+    SpscQueue<size_t> free_;
+
+    // The first slot of the batch that Next() handed out.
+    size_t current_{0};
+
+    // See fetch_ns() (written by the producer).
+    Histogram fetch_ns_;
+
+    // The producer thread, and whether it should exit.
+    std::thread thread_;
+    atomic<bool> stopping_{false};
+};
+
+}  // namespace model
+}  // namespace psyence
@@ -0,0 +1,108 @@
+#include <cassert>
+#include <cstring>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "dataset/img_clf_dataset.h"
+#include "model/prefetcher.h"
+
+using psyence::dataset::Class;
+using psyence::dataset::ImgClfDataset;
+using psyence::dataset::ImgClfDatasetSplit;
+using psyence::model::Prefetcher;
+using std::mt19937;
+using std::pair;
+using std::vector;
+
+namespace {
+
+// A split of 2x2 images whose pixels encode (split, index).
+ImgClfDatasetSplit* MakeSplit(size_t split, size_t num_samples) {
+    auto pixels = new uint8_t[num_samples * 4];
+    auto classes = new Class[num_samples];
+    for (size_t i = 0; i < num_samples; ++i) {
+        pixels[i * 4] = static_cast<uint8_t>(split);
+        pixels[i * 4 + 1] = static_cast<uint8_t>(i);
+        pixels[i * 4 + 2] = 0;
+        pixels[i * 4 + 3] = 0;
+        classes[i] = static_cast<Class>(i % 3);
+    }
+    auto out = new ImgClfDatasetSplit;
+    out->InitImgClfDatasetSplit(num_samples, {1, 2, 2}, pixels, 3, classes);
+    return out;
+}
+
+}  // namespace
+
+int main() {
+    ImgClfDataset dataset;
+    dataset.InitImgClfDataset({MakeSplit(0, 7), MakeSplit(1, 5)});
+    vector<size_t> splits = {0, 1};
+
+    // Batches get the same samples as getting them one at a time.
+    vector<size_t> indices = {6, 0, 3, 3, 1, 5, 2};
+    auto x_size = dataset.x_size();
+    auto y_size = dataset.y_size();
+    vector<float> batch_x(indices.size() * x_size);
+    vector<float> batch_y(indices.size() * y_size);
+    dataset.GetBatch(0, indices.data(), indices.size(), batch_x.data(),
+                     batch_y.data());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        vector<float> x(x_size);
+        vector<float> y(y_size);
+        dataset.Get(0, indices[i], x.data(), y.data());
+        assert(!memcmp(x.data(), &batch_x[i * x_size],
+                       x_size * sizeof(float)));
+        assert(!memcmp(y.data(), &batch_y[i * y_size],
+                       y_size * sizeof(float)));
+    }
+
+    // The samples come in the shuffled order, across several epochs, in
+    // batches of consecutive rows, whatever the batch size, depth and starting
+    // point.
+    for (size_t batch_size = 1; batch_size <= 3; ++batch_size) {
+        for (size_t depth = 1; depth <= 32; depth *= 2) {
+            for (size_t start = 0; start <= 14 * batch_size;
+                    start += 7 * batch_size) {
+                mt19937 rng(123);
+                vector<pair<size_t, size_t>> epoch;
+                dataset.ShuffleSampleRuns(splits, batch_size, &rng, &epoch);
+                for (size_t iter = 0; iter < start; ++iter) {
+                    if ((iter + 1) % epoch.size() == 0) {
+                        dataset.ShuffleSampleRuns(splits, batch_size, &rng,
+                                                  &epoch);
+                    }
+                }
+
+                Prefetcher prefetcher;
+                prefetcher.Start(&dataset, splits, epoch, rng, start, depth,
+                                 batch_size);
+                for (size_t iter = start; iter < start + 50 * batch_size;
+                        iter += batch_size) {
+                    auto samples = prefetcher.Next();
+                    for (size_t b = 0; b < batch_size; ++b) {
+                        auto& want = epoch[(iter + b) % epoch.size()];
+                        auto& got = samples[b];
+                        assert(got.split == want.first);
+                        assert(got.split == samples[0].split);
+                        assert(got.index_in_split == want.second);
+                        assert(got.x == samples[0].x + b * x_size);
+                        assert(got.y == samples[0].y + b * y_size);
+                        assert(static_cast<size_t>(got.x[0] * 255 + 0.5f) ==
+                               want.first);
+                        assert(static_cast<size_t>(got.x[1] * 255 + 0.5f) ==
+                               want.second);
+                        assert(0.5f < got.y[want.second % 3]);
+                    }
+                    prefetcher.Release();
+                    if ((iter + batch_size) % epoch.size() == 0) {
+                        dataset.ShuffleSampleRuns(splits, batch_size, &rng,
+                                                  &epoch);
+                    }
+                }
+                prefetcher.Stop();
+            }
+        }
+    }
+}
@@ -1,24 +1,61 @@
 #include <cstdio>
+#include <cstdlib>
 #include <gflags/gflags.h>
 #include <string>
+#include <vector>
 
+#include "base/checkpoint.h"
+#include "base/cxx.h"
+#include "base/file.h"
+#include "base/simd/isa.h"
+#include "base/simd/kernels.h"
 #include "base/time/trace.h"
 #include "dataset/img_clf_dataset.h"
+#include "dataset/img_clf_dataset_cache.h"
 #include "dataset/mnist.h"
 #include "model/adapter.h"
+#include "model/learner.h"
 #include "model/model.h"
+#include "model/sparse_model.h"
 #include "model/trainer.h"
 
+using psyence::base::checkpoint::CheckpointReader;
+using psyence::base::checkpoint::CheckpointWriter;
+using psyence::base::file::AccessPattern;
+using psyence::base::simd::Isa;
+using psyence::base::simd::IsaSupported;
+using psyence::base::simd::ParseIsa;
+using psyence::base::simd::SetIsa;
 using psyence::base::time::Trace;
 using psyence::dataset::ImgClfDataset;
+using psyence::dataset::ImgClfDatasetCache;
 using psyence::dataset::MNIST;
 using psyence::model::Adapter;
+using psyence::model::Learner;
 using psyence::model::Model;
+using psyence::model::ModelConfig;
+using psyence::model::ParseWeightPrecision;
+using psyence::model::SparseModel;
+using psyence::model::SparseModelConfig;
 using psyence::model::Trainer;
+using psyence::model::TrainerConfig;
 using std::string;
+using std::vector;
+
+// Hardware flags.
+DEFINE_string(simd, "", "Instruction set of the dense kernels (scalar, "
+              "sse4.2, avx2, avx512).  Empty picks the best one this CPU "
+              "supports");
 
 // Dataset flags.
 DEFINE_string(mnist_dir, "data/mnist/", "MNIST dataset directory");
+DEFINE_string(mnist_splits, "train,t10k", "Comma-separated file prefixes of "
+              "the splits in --mnist_dir, each <prefix>-images-idx3-ubyte and "
+              "<prefix>-labels-idx1-ubyte (eg Fashion-MNIST is the same as "
+              "MNIST, EMNIST is emnist-digits-train,emnist-digits-test)");
+DEFINE_string(dataset_cache_dir, "data/cache/", "Directory where the pooled "
+              "dataset is cached across launches, keyed by the contents of "
+              "its source files (empty for no cache)");
 DEFINE_uint64(train_split, 0, "Index of the MNIST split to train on");
 DEFINE_uint64(test_split, 1, "Index of the MNIST split to test on");
 
@@ -34,14 +71,59 @@ DEFINE_uint64(y_repeats, 1, "Number of consecutive repeats of Y into the "
 DEFINE_uint64(num_neurons, 512, "Total number of neurons");
 DEFINE_double(correlation_momentum, 0.99, "Momentum of inter-neuron "
               "correlation statistics.");
+DEFINE_uint64(num_threads, 1, "Number of threads that each model tick is "
+              "split across");
+DEFINE_uint64(batch_size, 1, "Number of samples of one split that each "
+              "iteration runs side by side against the shared weights");
+DEFINE_bool(fused_tick, true, "Whether to fuse each model tick into a single "
+            "sweep over the weights (same results, less memory traffic)");
+DEFINE_string(weight_precision, "fp32", "How the weights are stored (fp32, "
+              "bf16).  bf16 halves their memory and bandwidth, with "
+              "stochastically rounded updates");
+DEFINE_bool(frozen_predict, false, "Whether predictions run against frozen "
+            "weights, without updating the correlations, weights or training "
+            "activations");
+DEFINE_string(restore_checkpoint, "", "Checkpoint file to resume the model "
+              "and training progress from (empty for none)");
+DEFINE_string(save_checkpoint, "", "Checkpoint file to save the model and "
+              "training progress to when training ends, and on each request "
+              "to /checkpoint (empty for none)");
+DEFINE_uint64(seed, 0, "Seed of the initial random weights (the same whatever "
+              "the number of threads)");
+DEFINE_bool(packed_correlations, false, "Whether to store only the upper "
+            "triangle of the symmetric correlation statistics (same results, "
+            "half the memory)");
+DEFINE_bool(scaled_correlations, false, "Whether to store the correlation "
+            "statistics relative to a running scale, making their decay a "
+            "single multiply (results differ by rounding)");
+
+// Sparse model flags.
+DEFINE_uint64(fan_in, 0, "Number of incoming connections that each neuron "
+              "keeps, for a sparse model that rewires itself (0 for a dense "
+              "model).  The sparse model runs one sample at a time and only "
+              "takes the model flags above that aren't about dense storage");
+DEFINE_uint64(rewire_interval, 100, "Number of sparse model ticks between "
+              "rewirings (0 to never rewire)");
+DEFINE_double(rewire_fraction, 0.125, "Fraction of each neuron's connections "
+              "that the sparse model replaces when rewiring");
 
 // Trainer flags.
 DEFINE_uint64(ticks_per_train, 4, "Number of cycles taken to process each "
               "training sample");
 DEFINE_uint64(ticks_per_predict, 4, "Number of cycles taken to process each "
               "prediction");
+DEFINE_uint64(prefetch_depth, 16, "Number of batches of samples loaded ahead "
+              "of training on a background thread");
+DEFINE_uint64(eval_window, 1000, "Number of most recent evaluation samples "
+              "that the windowed accuracy is over");
+DEFINE_uint64(eval_dump_interval, 0, "Dump the raw results of every this "
+              "many-th evaluation sample to --eval_file (0 for none)");
 DEFINE_string(eval_file, "data/eval.bin", "Name of file containing evaluation "
               "data for analysis");
+DEFINE_uint64(eval_block_size, 1 << 20, "Bytes of evaluation data buffered "
+              "before handing them to the writer thread");
+DEFINE_double(eval_flush_interval, 1, "Seconds after which partly filled "
+              "evaluation data buffers are written anyway");
 
 // Training flags.
 DEFINE_uint64(num_iter, 1000000000, "Number of iterations of training and "
@@ -51,42 +133,178 @@ DEFINE_uint64(port, 1337, "Port at which the model trainer serves a basic "
 
 namespace {
 
+void SelectIsa() {
+    if (FLAGS_simd.empty()) {
+        return;
+    }
+    Isa isa;
+    auto ok = ParseIsa(FLAGS_simd.data(), &isa);
+    assert(ok);
+    UNUSED(ok);
+    assert(IsaSupported(isa));
+    SetIsa(isa);
+}
+
 void LoadReducedMNIST(ImgClfDataset* reduced_mnist, Trace* trace) {
+    vector<string> split_prefixes;
+    size_t begin = 0;
+    while (begin <= FLAGS_mnist_splits.size()) {
+        auto end = FLAGS_mnist_splits.find(',', begin);
+        if (end == string::npos) {
+            end = FLAGS_mnist_splits.size();
+        }
+        split_prefixes.emplace_back(FLAGS_mnist_splits.substr(begin,
+                                                              end - begin));
+        begin = end + 1;
+    }
+
+    // On a cache hit, train straight from the mapped cache entry.
+    ImgClfDatasetCache cache;
+    string key;
+    if (!FLAGS_dataset_cache_dir.empty()) {
+        cache.Init(FLAGS_dataset_cache_dir);
+        vector<string> sources;
+        for (auto& prefix : split_prefixes) {
+            sources.emplace_back(MNIST::ImagesFilename(FLAGS_mnist_dir,
+                                                       prefix));
+            sources.emplace_back(MNIST::ClassesFilename(FLAGS_mnist_dir,
+                                                        prefix));
+        }
+        trace->Enter("dataset_cache_key");
+        auto ok = cache.Key(sources, "avg_pool:1x2x2", &key);
+        trace->Exit();
+        if (!ok) {
+            key.clear();
+        } else {
+            trace->Enter("load_cached_dataset");
+            ok = cache.Load(key, AccessPattern::RANDOM, reduced_mnist);
+            trace->Exit();
+            if (ok) {
+                return;
+            }
+        }
+    }
+
+    // Pooling makes one pass over the images.
     MNIST mnist;
-    mnist.Load(FLAGS_mnist_dir, trace);
+    mnist.Load(FLAGS_mnist_dir, trace, AccessPattern::SEQUENTIAL,
+               split_prefixes);
     trace->Enter("reduce_mnist_to_14x14");
     mnist.AvgPool({1, 2, 2}, reduced_mnist);
     trace->Exit();
+
+    // Failing to cache only costs the next launch the time.
+    if (!key.empty()) {
+        trace->Enter("save_cached_dataset");
+        cache.Save(key, *reduced_mnist);
+        trace->Exit();
+    }
 }
 
-void CreateModel(const Dataset& dataset, Model* model, Trace* trace) {
-    trace->Enter("create_model");
+Adapter* CreateAdapter(const Dataset& dataset) {
     auto io = new Adapter;
     auto act_momentum = static_cast<float>(FLAGS_act_momentum);
     auto x_repeats = static_cast<size_t>(FLAGS_x_repeats);
     auto y_repeats = static_cast<size_t>(FLAGS_y_repeats);
     io->Init(act_momentum, x_repeats, dataset.x_size(), y_repeats,
              dataset.y_size());
-    auto num_neurons = static_cast<size_t>(FLAGS_num_neurons);
-    assert(io->total_size() <= num_neurons);
-    auto correlation_momentum = static_cast<float>(FLAGS_correlation_momentum);
-    model->Init(io, num_neurons, correlation_momentum);
+    return io;
+}
+
+void CreateModel(const Dataset& dataset, Model* model, Trace* trace) {
+    trace->Enter("create_model");
+    auto io = CreateAdapter(dataset);
+    ModelConfig config;
+    config.num_neurons = static_cast<size_t>(FLAGS_num_neurons);
+    assert(io->total_size() <= config.num_neurons);
+    config.correlation_momentum =
+        static_cast<float>(FLAGS_correlation_momentum);
+    config.num_threads = static_cast<size_t>(FLAGS_num_threads);
+    config.batch_size = static_cast<size_t>(FLAGS_batch_size);
+    config.fused_tick = FLAGS_fused_tick;
+    config.packed_correlations = FLAGS_packed_correlations;
+    config.scaled_correlations = FLAGS_scaled_correlations;
+    auto ok = ParseWeightPrecision(FLAGS_weight_precision.data(),
+                                   &config.weight_precision);
+    assert(ok);
+    UNUSED(ok);
+    config.frozen_predict = FLAGS_frozen_predict;
+    config.seed = FLAGS_seed;
+    model->Init(io, config);
     trace->Exit();
 }
 
-void Run(const Dataset& dataset, Model* model, Trace* trace) {
+void CreateSparseModel(const Dataset& dataset, SparseModel* model,
+                       Trace* trace) {
+    trace->Enter("create_sparse_model");
+    assert(FLAGS_batch_size == 1);
+    auto io = CreateAdapter(dataset);
+    SparseModelConfig config;
+    config.num_neurons = static_cast<size_t>(FLAGS_num_neurons);
+    assert(io->total_size() <= config.num_neurons);
+    config.fan_in = static_cast<size_t>(FLAGS_fan_in);
+    config.correlation_momentum =
+        static_cast<float>(FLAGS_correlation_momentum);
+    config.num_threads = static_cast<size_t>(FLAGS_num_threads);
+    config.rewire_interval = static_cast<size_t>(FLAGS_rewire_interval);
+    config.rewire_fraction = static_cast<float>(FLAGS_rewire_fraction);
+    config.seed = FLAGS_seed;
+    model->Init(io, config);
+    trace->Exit();
+}
+
+void Run(const Dataset& dataset, Learner* model, Trace* trace) {
     trace->Enter("run");
-    auto train_split = static_cast<size_t>(FLAGS_train_split);
-    auto test_split = static_cast<size_t>(FLAGS_test_split);
-    auto ticks_per_train = static_cast<size_t>(FLAGS_ticks_per_train);
-    auto ticks_per_predict = static_cast<size_t>(FLAGS_ticks_per_predict);
+    TrainerConfig config;
+    config.train_split = static_cast<size_t>(FLAGS_train_split);
+    config.test_split = static_cast<size_t>(FLAGS_test_split);
+    config.ticks_per_train = static_cast<size_t>(FLAGS_ticks_per_train);
+    config.ticks_per_predict = static_cast<size_t>(FLAGS_ticks_per_predict);
+    config.eval_window = static_cast<size_t>(FLAGS_eval_window);
+    config.eval_dump_interval = static_cast<size_t>(FLAGS_eval_dump_interval);
+    config.eval_filename = FLAGS_eval_file;
+    config.eval_block_size = static_cast<size_t>(FLAGS_eval_block_size);
+    config.eval_flush_interval = FLAGS_eval_flush_interval;
+    config.checkpoint_filename = FLAGS_save_checkpoint;
+    config.prefetch_depth = static_cast<size_t>(FLAGS_prefetch_depth);
     Trainer trainer;
-    trainer.Init(&dataset, train_split, test_split, model, ticks_per_train,
-                 ticks_per_predict, FLAGS_eval_file);
+    trainer.Init(&dataset, model, config);
+
+    if (!FLAGS_restore_checkpoint.empty()) {
+        trace->Enter("restore_checkpoint");
+        // Don't fall back to a fresh run, which --save_checkpoint would then
+        // write over the checkpoint with.  A miss exits before anything runs,
+        // so a model restored without its trainer is never used, and the
+        // trainer goes last as its restore is the one that touches disk (the
+        // evaluation file).
+        CheckpointReader reader;
+        if (!reader.Open(FLAGS_restore_checkpoint.data()) ||
+                !model->RestoreFromCheckpoint(reader) ||
+                !trainer.RestoreFromCheckpoint(reader)) {
+            fprintf(stderr, "Failed to restore checkpoint %s\n",
+                    FLAGS_restore_checkpoint.data());
+            exit(1);
+        }
+        trace->Exit();
+    }
     auto num_iter = static_cast<size_t>(FLAGS_num_iter);
     auto port = static_cast<uint16_t>(FLAGS_port);
     trainer.Start(num_iter, port);
     trace->Exit();
+    printf("%s\n", trainer.eval_metrics().ToJson().dump().data());
+
+    if (!FLAGS_save_checkpoint.empty()) {
+        trace->Enter("save_checkpoint");
+        CheckpointWriter writer;
+        model->AddToCheckpoint(&writer);
+        trainer.AddToCheckpoint(&writer);
+        if (!writer.Save(FLAGS_save_checkpoint.data())) {
+            fprintf(stderr, "Failed to save checkpoint %s\n",
+                    FLAGS_save_checkpoint.data());
+            exit(1);
+        }
+        trace->Exit();
+    }
 }
 
 }  // namespace
@@ -94,14 +312,24 @@ void Run(const Dataset& dataset, Model* model, Trace* trace) {
 int main(int argc, char* argv[]) {
     gflags::ParseCommandLineFlags(&argc, &argv, true);
 
+    SelectIsa();
+
     Trace trace;
     trace.Init();
 
     ImgClfDataset dataset;
     LoadReducedMNIST(&dataset, &trace);
 
-    Model model;
-    CreateModel(dataset, &model, &trace);
+    Model dense_model;
+    SparseModel sparse_model;
+    Learner* model;
+    if (FLAGS_fan_in) {
+        CreateSparseModel(dataset, &sparse_model, &trace);
+        model = &sparse_model;
+    } else {
+        CreateModel(dataset, &dense_model, &trace);
+        model = &dense_model;
+    }
 
-    Run(dataset, &model, &trace);
+    Run(dataset, model, &trace);
 }
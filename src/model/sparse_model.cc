@@ -0,0 +1,365 @@
+#include "sparse_model.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "base/momentum.h"
+#include "base/simd/kernels.h"
+
+using psyence::base::momentum::MomUpdate;
+using psyence::base::simd::Standardize;
+using psyence::base::simd::Sum;
+using psyence::base::simd::SumSquaredGaps;
+using std::vector;
+
+namespace psyence {
+namespace model {
+
+namespace {
+
+// Small random stream (SplitMix64), seeded per row so that rows can be wired
+// in any order on any thread.
+class RowRandom {
+  public:
+    RowRandom(uint64_t seed, uint64_t stream, uint64_t row) {
+        state_ = seed;
+        Next();
+        state_ ^= stream * 0xD1B54A32D192ED03ull;
+        Next();
+        state_ ^= row * 0x9E3779B97F4A7C15ull;
+    }
+
+    uint64_t Next() {
+        auto z = (state_ += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, count).
+    size_t Below(size_t count) {
+        return static_cast<size_t>(Next() % count);
+    }
+
+    // Uniform in [-1, 1).
+    float Symmetric() {
+        auto x = static_cast<float>(Next() >> 40) / 16777216.0f;
+        return x * 2 - 1;
+    }
+
+  private:
+    uint64_t state_;
+};
+
+// Whether "source" is among the first "count" of "sources".
+bool HasSource(const uint32_t* sources, size_t count, uint32_t source) {
+    for (size_t i = 0; i < count; ++i) {
+        if (sources[i] == source) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// What a checkpoint records of a sparse model besides its arrays.
+struct SparseModelMeta {
+    uint64_t num_neurons;
+    uint64_t fan_in;
+    uint64_t num_ticks;
+    uint64_t seed;
+};
+
+}  // namespace
+
+void SparseModel::Free() {
+    if (io_) {
+        delete io_;
+        io_ = nullptr;
+    }
+    if (cur_act_) {
+        delete [] cur_act_;
+    }
+    if (new_act_) {
+        delete [] new_act_;
+    }
+    if (means_) {
+        delete [] means_;
+    }
+    if (stds_) {
+        delete [] stds_;
+    }
+    if (sources_) {
+        delete [] sources_;
+    }
+    if (weight_) {
+        delete [] weight_;
+    }
+    if (cov_) {
+        delete [] cov_;
+    }
+    if (cor_) {
+        delete [] cor_;
+    }
+}
+
+SparseModel::~SparseModel() {
+    Free();
+}
+
+void SparseModel::Init(Adapter* io, const SparseModelConfig& config) {
+    Free();
+
+    pool_.Init(config.num_threads);
+
+    io_ = io;
+    num_neurons_ = config.num_neurons;
+    fan_in_ = config.fan_in;
+    assert(0 < fan_in_ && fan_in_ <= num_neurons_);
+    assert(num_neurons_ <= UINT32_MAX);
+    momentum_ = config.correlation_momentum;
+    rewire_interval_ = config.rewire_interval;
+    num_rewired_ = static_cast<size_t>(fan_in_ * config.rewire_fraction);
+    seed_ = config.seed;
+    num_ticks_ = 0;
+
+    auto n = num_neurons_;
+    cur_act_ = new float[n]();
+    new_act_ = new float[n]();
+    means_ = new float[n]();
+    stds_ = new float[n];
+    for (size_t i = 0; i < n; ++i) {
+        stds_[i] = 1;
+    }
+
+    auto count = n * fan_in_;
+    sources_ = new uint32_t[count];
+    weight_ = new float[count];
+    cov_ = new float[count]();
+    cor_ = new float[count]();
+
+    // Connect each neuron to fan_in distinct random neurons.
+    pool_.ParallelFor(n, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            RowRandom random(seed_, 0, i);
+            auto sources = &sources_[i * fan_in_];
+            for (size_t k = 0; k < fan_in_; ++k) {
+                uint32_t source;
+                do {
+                    source = static_cast<uint32_t>(random.Below(num_neurons_));
+                } while (HasSource(sources, k, source));
+                sources[k] = source;
+                weight_[i * fan_in_ + k] = random.Symmetric() / fan_in_;
+            }
+            SortRow(i);
+        }
+    });
+}
+
+void SparseModel::Train(size_t num_ticks, const float* x,
+                        const float* y_true) {
+    io_->SetX(x, cur_act_);
+    io_->SetY(y_true, cur_act_);
+    for (size_t i = 0; i < num_ticks; ++i) {
+        Tick();
+    }
+}
+
+void SparseModel::Predict(size_t num_ticks, const float* x,
+                          float* pred_means_per_tick,
+                          float* pred_stds_per_tick) {
+    io_->SetX(x, cur_act_);
+    for (size_t i = 0; i < num_ticks; ++i) {
+        Tick();
+        io_->GetY(cur_act_, &pred_means_per_tick[i * io_->y_dim()],
+                  &pred_stds_per_tick[i * io_->y_dim()]);
+    }
+}
+
+void SparseModel::AddToCheckpoint(CheckpointWriter* writer) const {
+    auto n = num_neurons_;
+    auto count = n * fan_in_;
+    SparseModelMeta meta;
+    meta.num_neurons = n;
+    meta.fan_in = fan_in_;
+    meta.num_ticks = num_ticks_;
+    meta.seed = seed_;
+    writer->AddCopy("sparse.meta", &meta, sizeof(meta));
+    writer->Add("sparse.act", cur_act_, n * sizeof(float));
+    writer->Add("sparse.means", means_, n * sizeof(float));
+    writer->Add("sparse.stds", stds_, n * sizeof(float));
+    writer->Add("sparse.sources", sources_, count * sizeof(uint32_t));
+    writer->Add("sparse.weight", weight_, count * sizeof(float));
+    writer->Add("sparse.cov", cov_, count * sizeof(float));
+    writer->Add("sparse.cor", cor_, count * sizeof(float));
+}
+
+bool SparseModel::RestoreFromCheckpoint(const CheckpointReader& reader) {
+    auto n = num_neurons_;
+    auto count = n * fan_in_;
+    SparseModelMeta meta;
+    if (!reader.CopyTo("sparse.meta", sizeof(meta), &meta) ||
+            meta.num_neurons != n || meta.fan_in != fan_in_) {
+        return false;
+    }
+
+    // Check every section before changing anything.
+    struct Array {
+        const char* name;
+        void* out;
+        size_t size;
+    };
+    const Array arrays[] = {
+        {"sparse.act", cur_act_, n * sizeof(float)},
+        {"sparse.means", means_, n * sizeof(float)},
+        {"sparse.stds", stds_, n * sizeof(float)},
+        {"sparse.sources", sources_, count * sizeof(uint32_t)},
+        {"sparse.weight", weight_, count * sizeof(float)},
+        {"sparse.cov", cov_, count * sizeof(float)},
+        {"sparse.cor", cor_, count * sizeof(float)},
+    };
+    const void* data;
+    size_t size;
+    for (auto& array : arrays) {
+        if (!reader.Get(array.name, &data, &size) || size != array.size) {
+            return false;
+        }
+    }
+    for (auto& array : arrays) {
+        reader.Get(array.name, &data, &size);
+        memcpy(array.out, data, size);
+    }
+    num_ticks_ = meta.num_ticks;
+    seed_ = meta.seed;
+    return true;
+}
+
+void SparseModel::Tick() {
+    auto n = num_neurons_;
+
+    // New activations are the weighted sums of each neuron's inputs.
+    pool_.ParallelFor(n, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            auto sources = &sources_[i * fan_in_];
+            auto weight = &weight_[i * fan_in_];
+            float sum = 0;
+            for (size_t k = 0; k < fan_in_; ++k) {
+                sum += weight[k] * cur_act_[sources[k]];
+            }
+            new_act_[i] = sum;
+        }
+    });
+
+    // Then normalize them to zero mean and unit standard deviation.
+    auto mean = Sum(new_act_, n) / n;
+    auto x = SumSquaredGaps(new_act_, n, mean);
+    auto std = static_cast<float>(sqrt(x / n));
+    Standardize(mean, std, n, new_act_);
+
+    // Fold the new activations into the connections' correlations, and nudge
+    // the weights by them.
+    pool_.ParallelFor(n, [this](size_t begin, size_t end) {
+        UpdateRows(begin, end);
+    });
+
+    // The per-neuron statistics go last, as every row reads them.
+    for (size_t i = 0; i < n; ++i) {
+        auto& act = new_act_[i];
+        assert(std::isfinite(act));
+        auto& act_mean = means_[i];
+        auto gap = act_mean - act;
+        auto sample_std = static_cast<float>(sqrt(gap * gap));
+        act_mean = MomUpdate(momentum_, act_mean, act);
+        stds_[i] = MomUpdate(momentum_, stds_[i], sample_std);
+    }
+
+    ++num_ticks_;
+    if (rewire_interval_ && num_ticks_ % rewire_interval_ == 0 &&
+            num_rewired_ && fan_in_ < n) {
+        pool_.ParallelFor(n, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                RewireRow(i);
+            }
+        });
+    }
+
+    auto tmp = cur_act_;
+    cur_act_ = new_act_;
+    new_act_ = tmp;
+}
+
+void SparseModel::UpdateRows(size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        auto x_gap = new_act_[i] - means_[i];
+        auto std_i = stds_[i] + 1e-3f;
+        for (size_t k = i * fan_in_; k < (i + 1) * fan_in_; ++k) {
+            auto j = sources_[k];
+            auto y_gap = new_act_[j] - means_[j];
+            auto& cov = cov_[k];
+            cov = MomUpdate(momentum_, cov, x_gap * y_gap / fan_in_);
+            auto std_j = stds_[j] + 1e-3f;
+            auto& cor = cor_[k];
+            cor = MomUpdate(momentum_, cor, cov / (std_i * std_j));
+            weight_[k] += cor;
+        }
+    }
+}
+
+void SparseModel::RewireRow(size_t i) {
+    // Find the weakest connections by magnitude of correlation.
+    auto row = i * fan_in_;
+    vector<size_t> order(fan_in_);
+    for (size_t k = 0; k < fan_in_; ++k) {
+        order[k] = k;
+    }
+    auto num_rewired = static_cast<ptrdiff_t>(num_rewired_);
+    std::partial_sort(order.begin(), order.begin() + num_rewired, order.end(),
+                      [this, row](size_t a, size_t b) {
+        auto cor_a = fabs(cor_[row + a]);
+        auto cor_b = fabs(cor_[row + b]);
+        return cor_a < cor_b || (!(cor_b < cor_a) && a < b);
+    });
+
+    // Replace them with fresh connections from neurons it isn't wired to.
+    RowRandom random(seed_, num_ticks_ / rewire_interval_, i);
+    auto sources = &sources_[row];
+    for (size_t r = 0; r < num_rewired_; ++r) {
+        auto k = row + order[r];
+        uint32_t source;
+        do {
+            source = static_cast<uint32_t>(random.Below(num_neurons_));
+        } while (HasSource(sources, fan_in_, source));
+        sources_[k] = source;
+        weight_[k] = 0;
+        cov_[k] = 0;
+        cor_[k] = 0;
+    }
+    SortRow(i);
+}
+
+void SparseModel::SortRow(size_t i) {
+    // Insertion sort, as rows are short and mostly sorted already.
+    auto row = i * fan_in_;
+    for (size_t a = row + 1; a < row + fan_in_; ++a) {
+        auto source = sources_[a];
+        auto weight = weight_[a];
+        auto cov = cov_[a];
+        auto cor = cor_[a];
+        auto b = a;
+        for (; row < b && source < sources_[b - 1]; --b) {
+            sources_[b] = sources_[b - 1];
+            weight_[b] = weight_[b - 1];
+            cov_[b] = cov_[b - 1];
+            cor_[b] = cor_[b - 1];
+        }
+        sources_[b] = source;
+        weight_[b] = weight;
+        cov_[b] = cov;
+        cor_[b] = cor;
+    }
+}
+
+}  // namespace model
+}  // namespace psyence
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "base/checkpoint.h"
+#include "base/thread/thread_pool.h"
+#include "model/adapter.h"
+#include "model/learner.h"
+
+using psyence::base::checkpoint::CheckpointReader;
+using psyence::base::checkpoint::CheckpointWriter;
+using psyence::base::thread::ThreadPool;
+using psyence::model::Adapter;
+using psyence::model::Learner;
+
+namespace psyence {
+namespace model {
+
+// Knobs for a SparseModel.
+struct SparseModelConfig {
+    // The total number of neurons.
+    size_t num_neurons{0};
+
+    // Number of incoming connections that each neuron keeps.
+    size_t fan_in{64};
+
+    // Momentum of the correlation statistics of each connection.
+    float correlation_momentum{0.99f};
+
+    // Number of threads that each tick is split across by rows (including the
+    // caller).  The results are bit-identical to running on one thread.
+    size_t num_threads{1};
+
+    // Rewire every this many ticks (zero to never rewire).
+    size_t rewire_interval{100};
+
+    // Fraction of each neuron's connections that are replaced when rewiring.
+    float rewire_fraction{0.125f};
+
+    // Seed of the initial wiring and weights, and of every rewiring.
+    uint64_t seed{0};
+};
+
+// A Model where each neuron only has fan_in incoming connections.
+//
+// The connections are stored ELL-style (fan_in per row, sorted by source
+// neuron), so a tick costs O(num_neurons * fan_in) instead of O(num_neurons^2).
+// Each connection keeps its own covariance and correlation statistics, updated
+// like OnlineCorrelater's (with the pairwise terms averaged over fan_in instead
+// of num_neurons), and the weights are nudged by the correlations as in Model.
+//
+// Every rewire_interval ticks, each neuron drops the connections with the
+// weakest correlations and connects to new random neurons instead, which start
+// with zero weight and statistics.  Each row draws from its own random stream,
+// so the results do not depend on the number of threads.
+//
+// Runs one sample at a time.
+class SparseModel : public Learner {
+  public:
+    // Accessors.
+    size_t num_neurons() const { return num_neurons_; }
+    virtual size_t batch_size() const { return 1; }
+    size_t fan_in() const { return fan_in_; }
+    const float* cur_act() const { return cur_act_; }
+
+    // Connections into each neuron: source neuron, weight and statistics.
+    //
+    // Shape: num_neurons_ * fan_in_.
+    const uint32_t* sources() const { return sources_; }
+    const float* weight() const { return weight_; }
+    const float* cov() const { return cov_; }
+    const float* cor() const { return cor_; }
+
+    // Free memory.
+    ~SparseModel();
+
+    // Setup.
+    //
+    // Takes ownership of "io".
+    void Init(Adapter* io, const SparseModelConfig& config);
+
+    // Given X and Y, learn X -> Y.
+    virtual void Train(size_t num_ticks, const float* x, const float* y_true);
+
+    // Given X, predict X -> Y.
+    virtual void Predict(size_t num_ticks, const float* x,
+                         float* pred_means_per_tick, float* pred_stds_per_tick);
+
+    // Add the model's learned state to a checkpoint: the activations and their
+    // statistics, the wiring, each connection's weight and statistics, and the
+    // seed and tick count that the rewirings are drawn from.
+    //
+    // The big sections point into the model, which must not change until the
+    // checkpoint is saved.
+    virtual void AddToCheckpoint(CheckpointWriter* writer) const;
+
+    // Restore state added to a checkpoint by AddToCheckpoint().
+    //
+    // It must come from a model with the same number of neurons and fan-in.
+    // Returns false, changing nothing, if it doesn't or if anything is
+    // missing.
+    virtual bool RestoreFromCheckpoint(const CheckpointReader& reader);
+
+  private:
+    // Free memory.
+    void Free();
+
+    // Perform one timestep.
+    void Tick();
+
+    // Update the statistics and weights of the connections into a range of
+    // neurons.
+    void UpdateRows(size_t begin, size_t end);
+
+    // Replace the weakest connections into neuron i.
+    void RewireRow(size_t i);
+
+    // Sort the connections into neuron i by source neuron.
+    void SortRow(size_t i);
+
+    // Workers that the rows of each tick are split across.
+    ThreadPool pool_;
+
+    // Inputs and outputs.
+    Adapter* io_{nullptr};
+
+    // Shape and knobs.
+    size_t num_neurons_;
+    size_t fan_in_;
+    float momentum_;
+    size_t rewire_interval_;
+    size_t num_rewired_;
+    uint64_t seed_;
+
+    // Number of ticks done, which also numbers the rewirings.
+    uint64_t num_ticks_;
+
+    // Neuron activations, and the buffer for computing the new activations.
+    //
+    // Shape: num_neurons_.
+    float* cur_act_{nullptr};
+    float* new_act_{nullptr};
+
+    // Moving mean and standard deviation of each neuron's activation.
+    //
+    // Shape: num_neurons_.
+    float* means_{nullptr};
+    float* stds_{nullptr};
+
+    // Connections into each neuron (see accessors).
+    //
+    // Shape: num_neurons_ * fan_in_.
+    uint32_t* sources_{nullptr};
+    float* weight_{nullptr};
+    float* cov_{nullptr};
+    float* cor_{nullptr};
+};
+
+}  // namespace model
+}  // namespace psyence
@@ -0,0 +1,115 @@
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "base/checkpoint.h"
+#include "base/cxx.h"
+#include "model/adapter.h"
+#include "model/sparse_model.h"
+
+using psyence::base::checkpoint::CheckpointReader;
+using psyence::base::checkpoint::CheckpointWriter;
+using psyence::model::Adapter;
+using psyence::model::SparseModel;
+using psyence::model::SparseModelConfig;
+using std::vector;
+
+namespace {
+
+void InitModel(size_t num_threads, uint64_t seed, size_t fan_in,
+               SparseModel* model) {
+    auto io = new Adapter;
+    io->Init(0.5f, 2, 8, 2, 4);
+    SparseModelConfig config;
+    config.num_neurons = 200;
+    config.fan_in = fan_in;
+    config.num_threads = num_threads;
+    config.rewire_interval = 7;
+    config.rewire_fraction = 0.25f;
+    config.seed = seed;
+    model->Init(io, config);
+}
+
+void RunModel(SparseModel* model) {
+    float x[8];
+    float y[4];
+    float pred_means[4 * 3];
+    float pred_stds[4 * 3];
+    for (size_t i = 0; i < 20; ++i) {
+        for (size_t j = 0; j < 8; ++j) {
+            x[j] = static_cast<float>((i + j) % 5) / 4;
+        }
+        for (size_t j = 0; j < 4; ++j) {
+            y[j] = (i % 4 == j) ? 1 : 0;
+        }
+        model->Train(3, x, y);
+        model->Predict(3, x, pred_means, pred_stds);
+    }
+}
+
+template <typename T>
+bool Same(const T* a, const T* b, size_t count) {
+    return !memcmp(a, b, count * sizeof(T));
+}
+
+}  // namespace
+
+int main() {
+    SparseModel want;
+    InitModel(1, 3, 16, &want);
+    RunModel(&want);
+    auto n = want.num_neurons();
+    auto fan_in = want.fan_in();
+
+    // After many rewirings, every neuron still has fan_in distinct inputs, in
+    // order.
+    for (size_t i = 0; i < n; ++i) {
+        auto sources = &want.sources()[i * fan_in];
+        for (size_t k = 0; k < fan_in; ++k) {
+            assert(sources[k] < n);
+            assert(!k || sources[k - 1] < sources[k]);
+        }
+    }
+
+    // Splitting the ticks and rewirings across threads may not change a bit.
+    for (size_t num_threads = 2; num_threads <= 5; ++num_threads) {
+        SparseModel got;
+        InitModel(num_threads, 3, 16, &got);
+        RunModel(&got);
+        assert(Same(got.cur_act(), want.cur_act(), n));
+        assert(Same(got.sources(), want.sources(), n * fan_in));
+        assert(Same(got.weight(), want.weight(), n * fan_in));
+        assert(Same(got.cor(), want.cor(), n * fan_in));
+    }
+
+    // A checkpoint carries on exactly, even into a model wired from another
+    // seed, but not into one of another fan-in.
+    auto filename = "/tmp/psyence_sparse_model_test.ckpt";
+    CheckpointWriter writer;
+    want.AddToCheckpoint(&writer);
+    auto ok = writer.Save(filename);
+    assert(ok);
+    UNUSED(ok);
+    CheckpointReader reader;
+    ok = reader.Open(filename);
+    assert(ok);
+    SparseModel restored;
+    InitModel(1, 4, 16, &restored);
+    ok = restored.RestoreFromCheckpoint(reader);
+    assert(ok);
+    RunModel(&want);
+    RunModel(&restored);
+    assert(Same(restored.cur_act(), want.cur_act(), n));
+    assert(Same(restored.sources(), want.sources(), n * fan_in));
+    assert(Same(restored.weight(), want.weight(), n * fan_in));
+    assert(Same(restored.cor(), want.cor(), n * fan_in));
+
+    SparseModel other;
+    InitModel(1, 3, 8, &other);
+    vector<float> before(other.weight(), other.weight() + n * 8);
+    ok = other.RestoreFromCheckpoint(reader);
+    assert(!ok);
+    assert(Same(other.weight(), before.data(), n * 8));
+    remove(filename);
+}
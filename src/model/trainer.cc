@@ -3,24 +3,41 @@
 #include <cassert>
 #include <chrono>
 #include <cstdio>
+#include <sstream>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <thread>
+#include <unistd.h>
 
 #include "base/collection/json.h"
+#include "base/cxx.h"
+#include "base/time/clock.h"
 
 using namespace std::chrono_literals;
 using psyence::base::collection::json;
+using psyence::base::time::clock::NanoClock;
+using std::istringstream;
+using std::ostringstream;
 
 namespace psyence {
 namespace model {
 
+namespace {
+
+// What a checkpoint records of a trainer besides its shuffle and RNG.
+struct TrainerMeta {
+    uint64_t iter;
+    uint64_t epoch_size;
+    uint64_t eval_offset;
+};
+
+// Most commands that can be waiting for the training loop at once (senders
+// wait for room beyond that).
+const size_t COMMAND_QUEUE_SIZE = 64;
+
+}  // namespace
+
 void Trainer::Free() {
-    if (x_) {
-        delete [] x_;
-    }
-    if (y_true_) {
-        delete [] y_true_;
-    }
     if (pred_means_per_tick_) {
         delete [] pred_means_per_tick_;
     }
@@ -33,11 +50,8 @@ Trainer::~Trainer() {
     Free();
 }
 
-void Trainer::Init(const Dataset* dataset, size_t train_split,
-                   size_t test_split, Model* model, size_t ticks_per_train,
-                   size_t ticks_per_predict, const string& eval_filename) {
-    lock_.lock();
-
+void Trainer::Init(const Dataset* dataset, Learner* model,
+                   const TrainerConfig& config) {
     Free();
 
     CROW_ROUTE(app_, "/")([]() {
@@ -45,96 +59,301 @@ void Trainer::Init(const Dataset* dataset, size_t train_split,
     });
 
     CROW_ROUTE(app_, "/stop")([this]() {
-        Stop();
-        return "Stopped.";
+        return Submit(TrainerCommand::STOP).get().dump();
+    });
+
+    CROW_ROUTE(app_, "/pause")([this]() {
+        return Submit(TrainerCommand::PAUSE).get().dump();
+    });
+
+    CROW_ROUTE(app_, "/resume")([this]() {
+        return Submit(TrainerCommand::RESUME).get().dump();
+    });
+
+    CROW_ROUTE(app_, "/step")([this]() {
+        return Submit(TrainerCommand::STEP).get().dump();
+    });
+
+    CROW_ROUTE(app_, "/checkpoint")([this]() {
+        return Checkpoint();
+    });
+
+    CROW_ROUTE(app_, "/eval")([this]() {
+        return Submit(TrainerCommand::EVAL_METRICS).get().dump();
+    });
+
+    // JSON, or Prometheus text with ?format=prometheus.
+    CROW_ROUTE(app_, "/metrics")([this](const crow::request& request) {
+        auto x = Submit(TrainerCommand::METRICS).get();
+        auto format = request.url_params.get("format");
+        if (!format || string(format) != "prometheus" || x.count("error")) {
+            return crow::response(x.dump());
+        }
+        crow::response response(ToPrometheusText("psyence_trainer", x));
+        response.set_header("Content-Type", "text/plain; version=0.0.4");
+        return response;
     });
 
     app_.loglevel(crow::LogLevel::Warning);
     app_.multithreaded();
 
-    stop_requested_ = false;
+    commands_.Init(COMMAND_QUEUE_SIZE);
+    paused_ = false;
+    stepping_ = false;
 
     dataset_ = dataset;
-    train_split_ = train_split;
-    test_split_ = test_split;
-    splits_ = {train_split, test_split};
+    train_split_ = config.train_split;
+    test_split_ = config.test_split;
+    splits_ = {train_split_, test_split_};
 
+    // Feeds the model a batch of samples of one split at a time.
     model_ = model;
-    ticks_per_train_ = ticks_per_train;
-    ticks_per_predict_ = ticks_per_predict;
-    eval_filename_ = eval_filename;
-
-    {
-        struct stat buffer;
-        if (!stat(eval_filename.data(), &buffer)) {
-            assert(!remove(eval_filename.c_str()));
-        }
-    }
-
+    batch_size_ = model->batch_size();
+    ticks_per_train_ = config.ticks_per_train;
+    ticks_per_predict_ = config.ticks_per_predict;
+    eval_dump_interval_ = config.eval_dump_interval;
+    eval_filename_ = config.eval_filename;
+    checkpoint_filename_ = config.checkpoint_filename;
+    prefetch_depth_ = config.prefetch_depth;
+    eval_block_size_ = config.eval_block_size;
+    eval_flush_interval_ = config.eval_flush_interval;
+
+    // The evaluation file is truncated to eval_offset_ when starting, so a
+    // fresh run starts it over and a restored one drops what came after.
     iter_ = 0;
-    dataset_->ShuffleSamples(splits_, &rng_, &epoch_);
+    eval_offset_ = 0;
+    dataset_->ShuffleSampleRuns(splits_, batch_size_, &rng_, &epoch_);
+    eval_metrics_.Init(ticks_per_predict_, dataset->y_size(),
+                       config.eval_window);
 
-    x_ = new float[dataset->x_size()];
-    y_true_ = new float[dataset->y_size()];
-    pred_means_per_tick_ = new float[dataset->y_size() * ticks_per_predict];
-    pred_stds_per_tick_ = new float[dataset->y_size() * ticks_per_predict];
+    auto pred_size = batch_size_ * dataset->y_size() * ticks_per_predict_;
+    pred_means_per_tick_ = new float[pred_size];
+    pred_stds_per_tick_ = new float[pred_size];
 
     rng_ = mt19937(rd_());
 
-    auto eval_meta_filename = eval_filename + ".meta.json";
+    if (!eval_dump_interval_) {
+        return;
+    }
+    auto eval_meta_filename = eval_filename_ + ".meta.json";
     auto eval_meta_file = fopen(eval_meta_filename.data(), "w");
     SaveEvalMetadata(eval_meta_file);
     fclose(eval_meta_file);
+}
+
+string Trainer::Checkpoint() {
+    if (checkpoint_filename_.empty()) {
+        return json({{"error", "no checkpoint file"}}).dump();
+    }
+    if (checkpointing_.exchange(true)) {
+        return json({{"error", "already checkpointing"}}).dump();
+    }
+
+    auto snapshot = Submit(TrainerCommand::SNAPSHOT).get();
+    if (snapshot.count("error")) {
+        checkpointing_ = false;
+        return snapshot.dump();
+    }
+
+    // Wait for the child here, off the training thread.
+    auto pid = snapshot["pid"].get<pid_t>();
+    int status = 0;
+    auto ok = waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+              !WEXITSTATUS(status);
+    auto t = NanoClock();
+    checkpointing_ = false;
+
+    size_t num_bytes = 0;
+    struct stat st;
+    if (ok && !stat(checkpoint_filename_.data(), &st)) {
+        num_bytes = static_cast<size_t>(st.st_size);
+    }
+    auto forked_at = snapshot["forked_at"].get<int64_t>();
+    auto write_sec = static_cast<double>(t - forked_at) / 1e9;
+    json x = {
+        {"ok", ok},
+        {"file", checkpoint_filename_},
+        {"stall_ms", snapshot["stall_ms"]},
+        {"write_sec", write_sec},
+        {"bytes", num_bytes},
+        {"mb_per_sec", static_cast<double>(num_bytes) / write_sec / 1e6},
+    };
+    return x.dump();
+}
+
+json Trainer::Snapshot() {
+    // The child gets the memory as it is right now, between iterations, and
+    // the parent's later writes to it are copied on write.  The evaluation
+    // results buffered so far go to the file first, so that it holds all that
+    // the checkpoint counts.
+    auto t0 = NanoClock();
+    eval_writer_.Flush();
+    CheckpointWriter writer;
+    model_->AddToCheckpoint(&writer);
+    AddToCheckpoint(&writer);
+    writer.Prepare(checkpoint_filename_.data());
+    auto pid = fork();
+    if (!pid) {
+        // Child: other threads' locks may be held forever, so only make
+        // async-signal-safe calls.  Write it out and leave without running any
+        // destructors or atexit handlers of the parent's state.
+        _exit(writer.SavePrepared() ? 0 : 1);
+    }
+    auto t1 = NanoClock();
+    if (pid < 0) {
+        return {{"error", "fork failed"}};
+    }
+    return {
+        {"pid", pid},
+        {"forked_at", t1},
+        {"stall_ms", static_cast<double>(t1 - t0) / 1e6},
+    };
+}
 
-    lock_.unlock();
+future<json> Trainer::Submit(TrainerCommand command) {
+    PendingCommand pending;
+    pending.command = command;
+    auto ack = pending.ack.get_future();
+    submit_lock_.lock();
+    while (!commands_.Push(std::move(pending))) {
+        std::this_thread::yield();
+    }
+    submit_lock_.unlock();
+    return ack;
+}
+
+json Trainer::Metrics() const {
+    auto x = metrics_.ToJson(NanoClock());
+    x["iter"] = iter_;
+    x["paused"] = paused_;
+    x["epoch"] = {
+        {"index", iter_ / epoch_.size()},
+        {"position", iter_ % epoch_.size()},
+        {"size", epoch_.size()},
+        {"progress", static_cast<double>(iter_ % epoch_.size()) /
+                     static_cast<double>(epoch_.size())},
+    };
+    x["prefetch"] = HistogramToJson(prefetcher_.fetch_ns());
+    x["eval_writer"] = {
+        {"bytes", eval_writer_.size()},
+        {"backlog_bytes", eval_writer_.is_open() ? eval_writer_.backlog() : 0},
+    };
+    return x;
+}
+
+bool Trainer::TakeCommands() {
+    PendingCommand pending;
+    while (true) {
+        if (!commands_.Pop(&pending)) {
+            if (!paused_) {
+                return true;
+            }
+            std::this_thread::sleep_for(1ms);
+            continue;
+        }
+
+        json ack = {{"iter", iter_}};
+        switch (pending.command) {
+        case TrainerCommand::STOP:
+            ack["stopped"] = true;
+            pending.ack.set_value(ack);
+            return false;
+        case TrainerCommand::PAUSE:
+        case TrainerCommand::RESUME:
+            paused_ = pending.command == TrainerCommand::PAUSE;
+            ack["paused"] = paused_;
+            pending.ack.set_value(ack);
+            break;
+        case TrainerCommand::STEP:
+            if (!paused_) {
+                pending.ack.set_value({{"error", "not paused"}});
+                break;
+            }
+            // Acknowledged once the iteration is done.
+            stepping_ = true;
+            step_ack_ = std::move(pending.ack);
+            return true;
+        case TrainerCommand::SNAPSHOT:
+            pending.ack.set_value(Snapshot());
+            break;
+        case TrainerCommand::EVAL_METRICS:
+            ack["eval"] = eval_metrics_.ToJson();
+            pending.ack.set_value(ack);
+            break;
+        case TrainerCommand::METRICS:
+            pending.ack.set_value(Metrics());
+            break;
+        }
+    }
 }
 
 void Trainer::SaveEvalMetadata(FILE* eval_meta_file) const {
     json x = {
         {"ticks_per_predict", ticks_per_predict_},
         {"y_size", dataset_->y_size()},
+        {"dump_interval", eval_dump_interval_},
     };
     fprintf(eval_meta_file, "%s\n", x.dump().data());
 }
 
-void Trainer::SaveEvalData(FILE* eval_file) const {
-    fwrite(y_true_, sizeof(float), dataset_->y_size(), eval_file);
+void Trainer::SaveEvalData(const float* y_true,
+                           const float* pred_means_per_tick,
+                           const float* pred_stds_per_tick) {
+    eval_writer_.Append(y_true, dataset_->y_size() * sizeof(float));
     auto count = dataset_->y_size() * ticks_per_predict_;
-    fwrite(pred_means_per_tick_, sizeof(float), count, eval_file);
-    fwrite(pred_stds_per_tick_, sizeof(float), count, eval_file);
-    fflush(eval_file);
+    eval_writer_.Append(pred_means_per_tick, count * sizeof(float));
+    eval_writer_.Append(pred_stds_per_tick, count * sizeof(float));
+    eval_offset_ = eval_writer_.size();
 }
 
-void Trainer::RunIteration(FILE* eval_file) {
-    // Get the split and sample index within that split.
-    auto index_in_epoch = iter_ % epoch_.size();
-    auto& pair = epoch_[index_in_epoch];
-    auto& split = pair.first;
-    auto& index_in_split = pair.second;
-
-    // Load the sample into our internal preallocated buffers.
-    dataset_->Get(split, index_in_split, x_, y_true_);
+void Trainer::RunIteration() {
+    // Take the batch, already loaded as floats into consecutive rows by the
+    // prefetcher.
+    auto t0 = NanoClock();
+    auto samples = prefetcher_.Next();
+    auto t1 = NanoClock();
+    metrics_.RecordFetch(t1 - t0);
+    for (size_t b = 0; b < batch_size_; ++b) {
+        auto& pair = epoch_[(iter_ + b) % epoch_.size()];
+        assert(samples[b].split == pair.first);
+        assert(samples[b].index_in_split == pair.second);
+        UNUSED(pair);
+    }
 
     // Run it through the model.
-    if (split) {
-        // Predict Y given X, getting for each tick both the mean and standard
-        // deviation of each output float (across Y repeats).
-        model_->Predict(ticks_per_predict_, x_, pred_means_per_tick_,
+    if (samples[0].split) {
+        // Predict Y given X, getting for each sample and tick both the mean and
+        // standard deviation of each output float (across Y repeats).
+        model_->Predict(ticks_per_predict_, samples[0].x, pred_means_per_tick_,
                         pred_stds_per_tick_);
 
-        // Then, append the resulting floats to file for later analysis.
-        SaveEvalData(eval_file);
+        // Then, fold them into the running metrics, and append every
+        // eval_dump_interval_-th sample's floats to file for later analysis.
+        auto pred_size = dataset_->y_size() * ticks_per_predict_;
+        for (size_t b = 0; b < batch_size_; ++b) {
+            auto pred_means = &pred_means_per_tick_[b * pred_size];
+            auto pred_stds = &pred_stds_per_tick_[b * pred_size];
+            eval_metrics_.Add(samples[b].y, pred_means, pred_stds);
+            if (eval_dump_interval_ && (eval_metrics_.num_samples() - 1) %
+                                       eval_dump_interval_ == 0) {
+                SaveEvalData(samples[b].y, pred_means, pred_stds);
+            }
+        }
+        metrics_.RecordPredict(NanoClock() - t1, ticks_per_predict_,
+                               batch_size_);
     } else {
         // Supposedly learn X -> Y.
-        model_->Train(ticks_per_train_, x_, y_true_);
+        model_->Train(ticks_per_train_, samples[0].x, samples[0].y);
+        metrics_.RecordTrain(NanoClock() - t1, ticks_per_train_, batch_size_);
     }
+    prefetcher_.Release();
 
-    // Increment our iteration index.
-    ++iter_;
+    // Advance our sample index.
+    iter_ += batch_size_;
 
     // Do a shuffle if we finished the epoch.
     if (iter_ % epoch_.size() == 0) {
-        dataset_->ShuffleSamples(splits_, &rng_, &epoch_);
+        dataset_->ShuffleSampleRuns(splits_, batch_size_, &rng_, &epoch_);
     }
 }
 
@@ -148,43 +367,140 @@ size_t Trainer::Start(size_t num_iter, uint16_t port) {
     std::thread(&Trainer::ServerThread, this, port).detach();
 
     // The training loop.
-    FILE* eval_file = fopen(eval_filename_.data(), "a");
+    if (eval_dump_interval_) {
+        auto ok = eval_writer_.Open(eval_filename_.data(), eval_offset_,
+                                    eval_block_size_, eval_flush_interval_);
+        assert(ok);
+        UNUSED(ok);
+    }
+    prefetcher_.Start(dataset_, splits_, epoch_, rng_, iter_, prefetch_depth_,
+                      batch_size_);
+    metrics_.Init(NanoClock());
     size_t i = 0;
     while (true) {
-        // Take the lock.
-        lock_.lock();
-
-        // If stop requested, we're done.
-        if (stop_requested_) {
-            stop_requested_ = false;
-            goto done;
+        // Take any commands, which is just an acquire load when there are none.
+        if ((!commands_.Empty() || paused_) && !TakeCommands()) {
+            break;
         }
 
         // Else, run one training or validation sample.
-        RunIteration(eval_file);
+        RunIteration();
+        if (stepping_) {
+            stepping_ = false;
+            step_ack_.set_value({{"iter", iter_}});
+        }
 
         // If we have completed the last iteration normally, we're done.
         if (i == num_iter) {
-            goto done;
+            break;
         }
 
-        // Else, keep going, releasing the lock.
-        lock_.unlock();
+        // Else, keep going.
         ++i;
     }
 
-done:
     // After either being stopped early or completing normally.
-    fclose(eval_file);
+    prefetcher_.Stop();
+    auto ok = eval_writer_.Close();
+    assert(ok);
+    UNUSED(ok);
     app_.stop();
-    lock_.unlock();
+
+    // Let anyone still waiting on a command know it won't happen.
+    PendingCommand pending;
+    while (commands_.Pop(&pending)) {
+        pending.ack.set_value({{"error", "not training"}});
+    }
+    paused_ = false;
     return i;
 }
 
 void Trainer::Stop() {
-    lock_.lock();
-    stop_requested_ = true;
-    lock_.unlock();
+    Submit(TrainerCommand::STOP);
+}
+
+void Trainer::AddToCheckpoint(CheckpointWriter* writer) const {
+    TrainerMeta meta;
+    meta.iter = iter_;
+    meta.epoch_size = epoch_.size();
+    meta.eval_offset = eval_offset_;
+    writer->AddCopy("trainer.meta", &meta, sizeof(meta));
+
+    vector<uint64_t> epoch;
+    epoch.reserve(2 * epoch_.size());
+    for (auto& it : epoch_) {
+        epoch.push_back(it.first);
+        epoch.push_back(it.second);
+    }
+    writer->AddCopy("trainer.epoch", epoch.data(),
+                    epoch.size() * sizeof(uint64_t));
+
+    // The standard text form of the RNG's state.
+    ostringstream rng;
+    rng << rng_;
+    auto rng_state = rng.str();
+    writer->AddCopy("trainer.rng", rng_state.data(), rng_state.size());
+
+    eval_metrics_.AddToCheckpoint(writer);
+}
+
+bool Trainer::RestoreFromCheckpoint(const CheckpointReader& reader) {
+    TrainerMeta meta;
+    vector<uint64_t> epoch;
+    const void* data;
+    size_t size;
+    if (!reader.CopyTo("trainer.meta", sizeof(meta), &meta) ||
+            meta.epoch_size != epoch_.size() || meta.iter % batch_size_ ||
+            !reader.Get("trainer.epoch", &data, &size) ||
+            size != 2 * epoch_.size() * sizeof(uint64_t)) {
+        return false;
+    }
+    epoch.resize(2 * epoch_.size());
+    memcpy(epoch.data(), data, size);
+    for (size_t i = 0; i < epoch_.size(); ++i) {
+        auto split = epoch[2 * i];
+        if ((split != train_split_ && split != test_split_) ||
+                dataset_->splits()[split]->num_samples() <= epoch[2 * i + 1]) {
+            return false;
+        }
+    }
+
+    mt19937 rng;
+    if (!reader.Get("trainer.rng", &data, &size)) {
+        return false;
+    }
+    istringstream rng_state(string(static_cast<const char*>(data), size));
+    rng_state >> rng;
+    if (rng_state.fail()) {
+        return false;
+    }
+
+    auto eval_metrics = eval_metrics_;
+    if (!eval_metrics.RestoreFromCheckpoint(reader)) {
+        return false;
+    }
+
+    // Drop any raw evaluation data the saved run wrote after the checkpoint.
+    if (eval_dump_interval_) {
+        struct stat st;
+        auto eval_size = stat(eval_filename_.data(), &st) ? 0 :
+                         static_cast<size_t>(st.st_size);
+        if (eval_size < meta.eval_offset ||
+                (meta.eval_offset < eval_size &&
+                 truncate(eval_filename_.data(),
+                          static_cast<off_t>(meta.eval_offset)))) {
+            return false;
+        }
+    }
+
+    iter_ = meta.iter;
+    for (size_t i = 0; i < epoch_.size(); ++i) {
+        epoch_[i] = {epoch[2 * i], epoch[2 * i + 1]};
+    }
+    rng_ = rng;
+    eval_metrics_ = eval_metrics;
+    eval_offset_ = meta.eval_offset;
+    return true;
 }
 
 }  // namespace model
@@ -1,21 +1,37 @@
 #pragma once
 
+#include <atomic>
+#include <future>
 #include <mutex>
 #include <random>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "base/checkpoint.h"
+#include "base/collection/json.h"
 #include "base/server/crow.h"
+#include "base/thread/spsc_queue.h"
 #include "dataset/dataset.h"
-#include "model/model.h"
+#include "model/eval_metrics.h"
+#include "model/eval_writer.h"
+#include "model/learner.h"
+#include "model/prefetcher.h"
+#include "model/trainer_metrics.h"
 
+using psyence::base::checkpoint::CheckpointReader;
+using psyence::base::checkpoint::CheckpointWriter;
+using psyence::base::collection::json;
 using psyence::base::server::crow::SimpleApp;
+using psyence::base::thread::SpscQueue;
 using psyence::dataset::Dataset;
-using psyence::model::Model;
+using psyence::model::Learner;
+using std::atomic;
+using std::future;
 using std::mt19937;
 using std::mutex;
 using std::pair;
+using std::promise;
 using std::random_device;
 using std::string;
 using std::vector;
@@ -23,6 +39,63 @@ using std::vector;
 namespace psyence {
 namespace model {
 
+// Commands that the training loop takes between iterations.
+enum class TrainerCommand {
+    // Stop training (Start() returns).
+    STOP,
+
+    // Stop running iterations until resumed, still taking commands.
+    PAUSE,
+    RESUME,
+
+    // Run one iteration while paused.
+    STEP,
+
+    // Fork a child process that holds a snapshot of the model and progress,
+    // for writing a checkpoint.
+    SNAPSHOT,
+
+    // Report the evaluation metrics so far (see EvalMetrics).
+    EVAL_METRICS,
+
+    // Report the loop's throughput, latencies and progress (see Metrics()).
+    METRICS,
+};
+
+// Knobs for a Trainer.
+struct TrainerConfig {
+    // Indices of the dataset splits to train and to evaluate on.
+    size_t train_split{0};
+    size_t test_split{1};
+
+    // Number of model ticks per training and per evaluation sample.
+    size_t ticks_per_train{4};
+    size_t ticks_per_predict{4};
+
+    // Number of most recent evaluation samples that the windowed accuracy is
+    // over.
+    size_t eval_window{1000};
+
+    // Evaluation results are summarized as they come (see EvalMetrics).  The
+    // raw results of every eval_dump_interval-th evaluation sample are also
+    // appended to eval_filename, for offline analysis (0 for none).
+    size_t eval_dump_interval{0};
+    string eval_filename;
+
+    // Evaluation results are buffered in blocks of this many bytes, which are
+    // written out on a thread of their own when full or after
+    // eval_flush_interval seconds.
+    size_t eval_block_size{1 << 20};
+    double eval_flush_interval{1};
+
+    // File that the /checkpoint route writes to (empty to disable it).
+    string checkpoint_filename;
+
+    // Number of batches of samples fetched ahead of training on a background
+    // thread.
+    size_t prefetch_depth{16};
+};
+
 class Trainer {
   public:
     // Free memory.
@@ -30,10 +103,11 @@ class Trainer {
 
     // Setup.
     //
-    // Set the dataset and model, and execution parameters.
-    void Init(const Dataset* dataset, size_t train_split, size_t test_split,
-              Model* model, size_t ticks_per_train, size_t ticks_per_predict,
-              const string& eval_filename);
+    // Set the dataset and model, and execution parameters.  Each iteration
+    // trains or predicts a batch of the model's batch_size samples of one
+    // split (see Dataset::ShuffleSampleRuns()).
+    void Init(const Dataset* dataset, Learner* model,
+              const TrainerConfig& config);
 
     // Train a model against a dataset.
     //
@@ -42,35 +116,94 @@ class Trainer {
     // were performed.
     //
     // While running it runs a webserver that serves a simple API on the
-    // specified port, having to do with dumping state and stopping training.
+    // specified port, having to do with dumping state and controlling
+    // training (see TrainerCommand).
     size_t Start(size_t num_iter, uint16_t port);
 
-    // Stop training execution.
+    // Send a command to the training loop, from any thread.
     //
-    // Sets the internal stop_requested_ flag that is checked at the start of
-    // each iteration.
+    // The loop takes commands between iterations, or as they come while
+    // paused, and acknowledges each with a JSON object through the future.
+    // Commands sent while not training wait for the next Start().
     //
-    // It blocks on lock_ waiting to do this, but it's a rare, manual operation
-    // so more fine-grained locking wouldn't matter.
+    // Senders take turns pushing onto a single-producer queue, so the loop
+    // itself never locks: when there are no commands, each iteration costs it
+    // one acquire load.
+    future<json> Submit(TrainerCommand command);
+
+    // Stop training execution, without waiting for it to stop.
     void Stop();
 
+    // Evaluation results so far.  Not while Start() is running (send
+    // EVAL_METRICS instead).
+    const EvalMetrics& eval_metrics() const { return eval_metrics_; }
+
+    // Add the training progress to a checkpoint: the sample index, the epoch's
+    // shuffle, the shuffling RNG, the evaluation metrics, and how much of the
+    // evaluation file has been written.
+    //
+    // Not while Start() is running.
+    void AddToCheckpoint(CheckpointWriter* writer) const;
+
+    // Restore progress added to a checkpoint by AddToCheckpoint(), so that the
+    // next Start() carries on with exactly the samples the saved run would
+    // have gone on to.
+    //
+    // Call after Init() with the same dataset, splits, batch size, ticks and
+    // evaluation window.  When dumping raw evaluation data, truncates the
+    // evaluation file back to where the saved run was, dropping anything it
+    // wrote after the checkpoint.  Returns false, changing nothing, if the
+    // progress doesn't fit this dataset or the evaluation file is shorter than
+    // that.
+    bool RestoreFromCheckpoint(const CheckpointReader& reader);
+
   private:
+    // A command and where to acknowledge it.
+    struct PendingCommand {
+        TrainerCommand command;
+        promise<json> ack;
+    };
+
+    // Write a checkpoint of the model and progress to checkpoint_filename_
+    // while training carries on, and return a JSON report of it.
+    //
+    // Training only stalls between iterations for as long as it takes to
+    // fork() (see Snapshot()).  The child process writes its copy-on-write
+    // snapshot of the memory, while the caller waits for it off the training
+    // thread.
+    string Checkpoint();
+
+    // Fork a child that writes a checkpoint and exits, and return its pid and
+    // how long it took.  On the training thread.
+    json Snapshot();
+
+    // Report throughput and latencies since Start() (see TrainerMetrics),
+    // along with epoch progress, prefetching and the evaluation writer's
+    // backlog.  On the training thread.
+    json Metrics() const;
+
+    // Take commands until the next iteration may run.
+    //
+    // Returns right away if there are none and not paused, else blocks for as
+    // long as paused.  Returns false if told to stop.  On the training thread.
+    bool TakeCommands();
+
     // Save the dimensions of the evaluation data to file.
     //
     // This is so the evaluation data file can be read correctly.
     void SaveEvalMetadata(FILE* eval_meta_file) const;
 
-    // Append one sample's worth of validation results to the file.
+    // Append one sample's worth of raw validation results to the file.
     //
-    // Stores the grouth truth and predicted weights for later analysis.
-    // Assumes it holds lock_ (do not overwrite new results into the Y buffers
-    // while using them for fwrite).
-    void SaveEvalData(FILE* eval_file) const;
+    // Stores the grouth truth and predicted weights for later analysis.  On the
+    // training thread, which only copies them into the writer's buffer.
+    void SaveEvalData(const float* y_true, const float* pred_means_per_tick,
+                      const float* pred_stds_per_tick);
 
     // Execute one iteration.
     //
-    // Called by Start().  Assumes it holds lock_.
-    void RunIteration(FILE* eval_file);
+    // Called by Start(), on the training thread.
+    void RunIteration();
 
     // Thread that spawns a webserver in the background while it's training.
     void ServerThread(uint16_t port);
@@ -78,14 +211,19 @@ class Trainer {
     // Free memory.
     void Free();
 
-    // Either train or handle a webserver request (dump, stop training).
-    mutex lock_;
-
-    // Webserver listening for stop requests while running.
+    // Webserver listening for commands while running.
     SimpleApp app_;
 
-    // Allow other threads to request us to stop training.
-    bool stop_requested_;
+    // Commands for the training loop, and the lock that their senders take
+    // turns pushing under (the loop is the only consumer).
+    SpscQueue<PendingCommand> commands_;
+    mutex submit_lock_;
+
+    // Whether the loop is paused, and the acknowledgement of the step it is
+    // taking while paused, if any (training thread only).
+    bool paused_{false};
+    bool stepping_{false};
+    promise<json> step_ack_;
 
     // Dataset.
     const Dataset* dataset_;
@@ -94,18 +232,42 @@ class Trainer {
     vector<size_t> splits_;
 
     // Model and execution config.
-    Model* model_;
+    Learner* model_;
+    size_t batch_size_;
     size_t ticks_per_train_;
     size_t ticks_per_predict_;
+    size_t eval_dump_interval_;
     string eval_filename_;
+    string checkpoint_filename_;
+    size_t prefetch_depth_;
+    size_t eval_block_size_;
+    double eval_flush_interval_;
 
-    // Execution progress.
+    // Whether a /checkpoint is being written (one at a time).
+    atomic<bool> checkpointing_{false};
+
+    // Execution progress: the index of the next sample in the shuffled order
+    // (a multiple of batch_size_).
     size_t iter_;
     vector<pair<size_t, size_t>> epoch_;
 
-    // The current sample's floats.
-    float* x_{nullptr};
-    float* y_true_{nullptr};
+    // Number of bytes of evaluation data written so far, which the file is
+    // truncated to when starting.
+    size_t eval_offset_;
+
+    // Summarizes the evaluation results.
+    EvalMetrics eval_metrics_;
+
+    // Writes the sampled raw evaluation data while training.
+    EvalWriter eval_writer_;
+
+    // Fetches the samples ahead, in epoch_ order.
+    Prefetcher prefetcher_;
+
+    // Throughput and latencies of the loop.
+    TrainerMetrics metrics_;
+
+    // The current batch's predictions.
     float* pred_means_per_tick_{nullptr};
     float* pred_stds_per_tick_{nullptr};
 
@@ -0,0 +1,103 @@
+#include "trainer_metrics.h"
+
+#include <cassert>
+#include <cctype>
+
+namespace psyence {
+namespace model {
+
+namespace {
+
+// The percentiles reported.
+const char* const QUANTILES[] = {"0.5", "0.9", "0.99", "0.999"};
+
+void AppendPrometheusText(const string& name, const json& x, string* text) {
+    if (x.is_object()) {
+        for (auto it = x.begin(); it != x.end(); ++it) {
+            if (isdigit(it.key()[0])) {
+                if (it->is_number()) {
+                    *text += name + "{quantile=\"" + it.key() + "\"} " +
+                             it->dump() + "\n";
+                }
+                continue;
+            }
+            AppendPrometheusText(name + "_" + it.key(), *it, text);
+        }
+    } else if (x.is_boolean()) {
+        *text += name + (x.get<bool>() ? " 1\n" : " 0\n");
+    } else if (x.is_number()) {
+        *text += name + " " + x.dump() + "\n";
+    }
+}
+
+}  // namespace
+
+json HistogramToJson(const Histogram& histogram) {
+    json quantiles = json::object();
+    for (auto quantile : QUANTILES) {
+        quantiles[quantile] = histogram.Percentile(100 * std::stod(quantile));
+    }
+    return {
+        {"count", histogram.count()},
+        {"mean_ns", histogram.mean()},
+        {"max_ns", histogram.max()},
+        {"ns", quantiles},
+    };
+}
+
+void TrainerMetrics::Init(int64_t now) {
+    start_ = now;
+    num_ticks_ = 0;
+    num_samples_ = 0;
+    fetch_.Init();
+    train_.Init();
+    predict_.Init();
+}
+
+void TrainerMetrics::RecordFetch(int64_t ns) {
+    fetch_.Record(static_cast<uint64_t>(ns));
+}
+
+void TrainerMetrics::RecordTrain(int64_t ns, size_t num_ticks,
+                                 size_t num_samples) {
+    train_.Record(static_cast<uint64_t>(ns));
+    num_ticks_ += num_ticks;
+    num_samples_ += num_samples;
+}
+
+void TrainerMetrics::RecordPredict(int64_t ns, size_t num_ticks,
+                                   size_t num_samples) {
+    predict_.Record(static_cast<uint64_t>(ns));
+    num_ticks_ += num_ticks;
+    num_samples_ += num_samples;
+}
+
+json TrainerMetrics::ToJson(int64_t now) const {
+    auto num_iters = train_.count() + predict_.count();
+    auto uptime_sec = static_cast<double>(now - start_) / 1e9;
+    auto iters_per_sec = uptime_sec > 0 ? num_iters / uptime_sec : 0.0;
+    auto ticks_per_sec = uptime_sec > 0 ? num_ticks_ / uptime_sec : 0.0;
+    auto samples_per_sec = uptime_sec > 0 ? num_samples_ / uptime_sec : 0.0;
+    return {
+        {"uptime_sec", uptime_sec},
+        {"iters_total", num_iters},
+        {"ticks_total", num_ticks_},
+        {"samples_total", num_samples_},
+        {"iters_per_sec", iters_per_sec},
+        {"ticks_per_sec", ticks_per_sec},
+        {"samples_per_sec", samples_per_sec},
+        {"fetch_wait", HistogramToJson(fetch_)},
+        {"train", HistogramToJson(train_)},
+        {"predict", HistogramToJson(predict_)},
+    };
+}
+
+string ToPrometheusText(const string& prefix, const json& x) {
+    assert(x.is_object());
+    string text;
+    AppendPrometheusText(prefix, x, &text);
+    return text;
+}
+
+}  // namespace model
+}  // namespace psyence
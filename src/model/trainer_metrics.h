@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "base/collection/json.h"
+#include "base/stats/histogram.h"
+
+using psyence::base::collection::json;
+using psyence::base::stats::Histogram;
+using std::string;
+
+namespace psyence {
+namespace model {
+
+// Throughput and latencies of a Trainer's loop, cheap enough to update every
+// iteration.
+//
+// On the training thread only.
+class TrainerMetrics {
+  public:
+    // Start over, as of "now" (in ns).
+    void Init(int64_t now);
+
+    // Count how long the loop waited for the next sample.
+    void RecordFetch(int64_t ns);
+
+    // Count a training or prediction iteration, of "num_ticks" model ticks
+    // over a batch of "num_samples" samples.
+    void RecordTrain(int64_t ns, size_t num_ticks, size_t num_samples);
+    void RecordPredict(int64_t ns, size_t num_ticks, size_t num_samples);
+
+    // Iterations, ticks, samples and their rates since Init() (pauses
+    // included), and the latency histograms, as JSON.
+    json ToJson(int64_t now) const;
+
+  private:
+    int64_t start_{0};
+    uint64_t num_ticks_{0};
+    uint64_t num_samples_{0};
+    Histogram fetch_;
+    Histogram train_;
+    Histogram predict_;
+};
+
+// Count, mean, max and percentiles of a histogram of durations in ns, as JSON.
+json HistogramToJson(const Histogram& histogram);
+
+// Render metrics JSON in the Prometheus text exposition format.
+//
+// Each number or bool becomes a sample named by its path of keys joined by
+// "_" after "prefix".  Objects with numeric keys are quantiles, which become
+// labels: {"train": {"ns": {"0.5": 100}}} is prefix_train_ns{quantile="0.5"}.
+// Anything else is skipped.
+string ToPrometheusText(const string& prefix, const json& x);
+
+}  // namespace model
+}  // namespace psyence
@@ -0,0 +1,58 @@
+#include <cassert>
+#include <string>
+
+#include "model/trainer_metrics.h"
+
+using psyence::model::HistogramToJson;
+using psyence::model::ToPrometheusText;
+using psyence::model::TrainerMetrics;
+using std::string;
+
+int main() {
+    // Rates are over the time since Init().
+    TrainerMetrics metrics;
+    metrics.Init(0);
+    metrics.RecordFetch(10);
+    metrics.RecordTrain(1000, 4, 8);
+    metrics.RecordFetch(10);
+    metrics.RecordPredict(2000, 2, 8);
+    auto x = metrics.ToJson(1000000000);
+    assert(x["iters_total"] == 2);
+    assert(x["ticks_total"] == 6);
+    assert(x["samples_total"] == 16);
+    assert(x["samples_per_sec"].get<double>() > 15.99);
+    assert(x["samples_per_sec"].get<double>() < 16.01);
+    assert(x["iters_per_sec"].get<double>() > 1.99);
+    assert(x["iters_per_sec"].get<double>() < 2.01);
+    assert(x["train"]["count"] == 1);
+    assert(x["predict"]["max_ns"] == 2000);
+    assert(x["fetch_wait"]["count"] == 2);
+    assert(x["fetch_wait"]["ns"]["0.5"] == 10);
+
+    // Histograms report their percentiles under "ns".
+    Histogram histogram;
+    histogram.Init();
+    for (uint64_t i = 1; i <= 1000; ++i) {
+        histogram.Record(i);
+    }
+    auto h = HistogramToJson(histogram);
+    assert(h["count"] == 1000);
+    assert(h["max_ns"] == 1000);
+    assert(h["ns"]["0.999"] == 1000);
+
+    // Nested keys are joined, quantiles become labels, and the rest is
+    // skipped.
+    json y = {
+        {"a", 1},
+        {"b", {{"c", true}, {"ns", {{"0.5", 7}}}}},
+        {"d", "skipped"},
+        {"e", {1, 2}},
+    };
+    assert(ToPrometheusText("p", y) ==
+           "p_a 1\n"
+           "p_b_c 1\n"
+           "p_b_ns{quantile=\"0.5\"} 7\n");
+    auto text = ToPrometheusText("psyence_trainer", x);
+    assert(text.find("psyence_trainer_train_ns{quantile=\"0.99\"} ") !=
+           string::npos);
+}
@@ -0,0 +1,152 @@
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "base/time/clock.h"
+#include "model/adapter.h"
+#include "model/model.h"
+
+using psyence::base::time::clock::NanoClock;
+using psyence::model::Adapter;
+using psyence::model::Model;
+using psyence::model::ModelConfig;
+using psyence::model::WeightPrecision;
+using psyence::model::WeightPrecisionName;
+using std::vector;
+
+// Compares fp32 and bf16 weights on the same synthetic train/predict stream.
+//
+// Usage: weight_precision_bench [num_neurons] [num_samples] [num_threads]
+//
+// Reports samples/sec of each precision, and how far the bf16 weights and
+// predictions drift from the fp32 ones.
+
+namespace {
+
+// Shape of the synthetic samples (like 14x14 MNIST with ten classes).
+const size_t X_DIM = 196;
+const size_t Y_DIM = 10;
+const size_t TICKS = 4;
+
+struct Result {
+    double seconds;
+    vector<float> weight;
+    vector<float> pred_means;
+};
+
+Result Run(WeightPrecision precision, size_t num_neurons, size_t num_samples,
+           size_t num_threads) {
+    auto io = new Adapter;
+    io->Init(0.5f, 1, X_DIM, 1, Y_DIM);
+    ModelConfig config;
+    config.num_neurons = num_neurons;
+    config.num_threads = num_threads;
+    config.weight_precision = precision;
+    Model model;
+    model.Init(io, config);
+
+    vector<float> x(X_DIM);
+    vector<float> y(Y_DIM);
+    vector<float> pred_stds(TICKS * Y_DIM);
+    Result result;
+    result.pred_means.resize(num_samples * TICKS * Y_DIM);
+    auto t0 = NanoClock();
+    for (size_t i = 0; i < num_samples; ++i) {
+        for (size_t j = 0; j < X_DIM; ++j) {
+            x[j] = static_cast<float>((i * 7 + j) % 11) / 10;
+        }
+        for (size_t j = 0; j < Y_DIM; ++j) {
+            y[j] = (i % Y_DIM == j) ? 1 : 0;
+        }
+        model.Train(TICKS, x.data(), y.data());
+        model.Predict(TICKS, x.data(), &result.pred_means[i * TICKS * Y_DIM],
+                      pred_stds.data());
+    }
+    auto t1 = NanoClock();
+    result.seconds = static_cast<double>(t1 - t0) / 1e9;
+    result.weight.resize(num_neurons * num_neurons);
+    model.GetWeight(result.weight.data());
+    return result;
+}
+
+double MeanAbsDiff(const vector<float>& a, const vector<float>& b) {
+    double sum = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        sum += fabs(a[i] - b[i]);
+    }
+    return sum / a.size();
+}
+
+double MeanAbs(const vector<float>& a) {
+    double sum = 0;
+    for (auto& f : a) {
+        sum += fabs(f);
+    }
+    return sum / a.size();
+}
+
+// Fraction of predictions (per sample and tick) whose top class agrees.
+double TopAgreement(const vector<float>& a, const vector<float>& b) {
+    size_t num_preds = a.size() / Y_DIM;
+    size_t num_agree = 0;
+    for (size_t i = 0; i < num_preds; ++i) {
+        size_t top_a = 0;
+        size_t top_b = 0;
+        for (size_t j = 1; j < Y_DIM; ++j) {
+            if (a[i * Y_DIM + top_a] < a[i * Y_DIM + j]) {
+                top_a = j;
+            }
+            if (b[i * Y_DIM + top_b] < b[i * Y_DIM + j]) {
+                top_b = j;
+            }
+        }
+        num_agree += top_a == top_b;
+    }
+    return static_cast<double>(num_agree) / num_preds;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    assert(argc <= 4);
+    size_t num_neurons = 2048;
+    size_t num_samples = 50;
+    size_t num_threads = 1;
+    if (1 < argc) {
+        num_neurons = strtoul(argv[1], nullptr, 10);
+    }
+    if (2 < argc) {
+        num_samples = strtoul(argv[2], nullptr, 10);
+    }
+    if (3 < argc) {
+        num_threads = strtoul(argv[3], nullptr, 10);
+    }
+    assert(X_DIM + Y_DIM <= num_neurons);
+
+    printf("num_neurons %zu, num_samples %zu, num_threads %zu\n\n",
+           num_neurons, num_samples, num_threads);
+
+    auto fp32 = Run(WeightPrecision::FP32, num_neurons, num_samples,
+                    num_threads);
+    auto bf16 = Run(WeightPrecision::BF16, num_neurons, num_samples,
+                    num_threads);
+
+    for (auto& it : {&fp32, &bf16}) {
+        auto precision = it == &fp32 ? WeightPrecision::FP32 :
+                                       WeightPrecision::BF16;
+        printf("%s: %.3f sec, %.2f samples/sec\n",
+               WeightPrecisionName(precision), it->seconds,
+               num_samples / it->seconds);
+    }
+    printf("bf16 speedup: %.2fx\n\n", fp32.seconds / bf16.seconds);
+
+    printf("weights:     mean |fp32| %.3e, mean |bf16 - fp32| %.3e\n",
+           MeanAbs(fp32.weight), MeanAbsDiff(bf16.weight, fp32.weight));
+    printf("predictions: mean |fp32| %.3e, mean |bf16 - fp32| %.3e\n",
+           MeanAbs(fp32.pred_means),
+           MeanAbsDiff(bf16.pred_means, fp32.pred_means));
+    printf("top class agreement: %.4f\n",
+           TopAgreement(bf16.pred_means, fp32.pred_means));
+}